@@ -6,11 +6,13 @@
 #include "CoreIncludes.hpp"
 #include "mesh/mesh.hpp"
 #include "mesh/polynomials.hpp"
+#include "physics/integrator.hpp"
+#include "physics/valueSource.hpp"
+#include "io/solutionWriter.hpp"
 
 #include <mpi.h>
+#include <cstdlib>
 #include <vector>
-#include <fstream>
-#include <iostream>
 
 /************************************************************************************************************************
  * Solve -div(grad(u)) = f, using FDM
@@ -20,8 +22,11 @@ int main(int argc, char *argv[]){
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rankid);
     MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    initLogging("log", rankid, LOG_LEVEL_TRACE, LOG_LEVEL_INFO); // log/log_r<rank>.txt, rank 0 echoes INFO and up
+    initProfiling(MPI_COMM_WORLD, std::getenv("HEAT_TRACE_DIR")); // Chrome traces only if HEAT_TRACE_DIR is set
+    HYPRE_Init();
 
-    if (rankid == 0) {
+    {
         //## ================== ##//
         //## Provide parameters ##//
         //## ================== ##//
@@ -30,8 +35,11 @@ int main(int argc, char *argv[]){
 
         EigenDefs::Array1D<f64> x1e = EigenDefs::Array1D<f64>::LinSpaced(nElemx+1, Lx[0], Lx[1]); /**< x1 Endpoints */
         Mesh::Geometry Domain = Mesh::Geometry(x1e, x1e, x1e);
+        Domain.decompose(MPI_COMM_WORLD);
         Domain.MasterElement.setnVars(1);
-        Domain.MasterElement.setLGLOrder(0,7);
+        Domain.MasterElement.setLGLOrder(0,7,7,7);
+
+        Physics::Integrator Heat(Domain);
 
         //## ============= ##//
         //## Problem Setup ##//
@@ -44,38 +52,23 @@ int main(int argc, char *argv[]){
         //Mesh::Simplex simplex = Mesh::Simplex(1);
         //Mesh::Cube    cube    = Mesh::Cube(3,"SEM");
 
-        // //## =============== ##//
-        // //## Export solution ##//
-        // //## =============== ##//
-        // std::ofstream dataFile("data.bin", std::ios::out | std::ios::binary | std::ios::trunc); /**< Data output file, not using std::ios::app */ 
-        // dataFile.write(reinterpret_cast<const char*>(&jmax), sizeof(jmax));
-        // dataFile.write(reinterpret_cast<const char*>(&imax), sizeof(imax));
-
-        // u32 idx = 0;
-        // for (u32 j=0; j<jmax; j++){
-        //     for (u32 i=0; i<imax; i++){
-        //         // Plotting / postprocessing currently does not need to be done in such high precision
-        //         f32 xPoint = (float) grid.x[i]; /**< f32 x-position */
-        //         f32 yPoint = (float) grid.y[j]; /**< f32 y-position */
-        //         f32 uPoint;                     /**< f32 u-solution */
-        //         if      (i==0     ) {uPoint = (float) boundaries.West[j]; }
-        //         else if (i==imax-1) {uPoint = (float) boundaries.East[j]; }
-        //         else if (j==0     ) {uPoint = (float) boundaries.South[i];}
-        //         else if (j==jmax-1) {uPoint = (float) boundaries.North[i];}
-        //         else                {uPoint = (float) u[idx]; idx++;      }
-
-        //         // INFO_MSG("idx=%d, uPoint=%f", idx, uPoint)
-        //         dataFile.write(reinterpret_cast<const char*>(&xPoint), sizeof(xPoint));
-        //         dataFile.write(reinterpret_cast<const char*>(&yPoint), sizeof(yPoint));
-        //         dataFile.write(reinterpret_cast<const char*>(&uPoint), sizeof(uPoint));
-
-        //     }
-        // }
-        // dataFile.close();
+        //## ===== ##//
+        //## Solve ##//
+        //## ===== ##//
+        EigenDefs::Vector<f64> u; /**< Block solution vector of this rank */
+        Heat.solveFastDiagonalization(0, valueSource, [](f64, f64, f64) { return 0.; }, u);
 
-        // INFO_MSG("Solution saved.");
+        //## =============== ##//
+        //## Export solution ##//
+        //## =============== ##//
+        // Every rank writes its own nodes, plotting / postprocessing currently does not need to be done in such high precision
+        IO::SolutionWriter writer(Heat, 0, IO::PRECISION_F32);
+        writer.write("data.bin", {"u"}, {&u});
     }
 
+    finalizeProfiling();
+    HYPRE_Finalize();
+    shutdownLogging();
     MPI_Finalize();
     return EXIT_SUCCESS;
 }
@@ -1,8 +1,10 @@
+import sys
 import numpy as np
 import numpy.ma as ma
 import matplotlib.pyplot as plt
 
 import src.post.binaryData as BinaryData
+import src.post.snapshotArchive as SnapshotArchive
 import src.post.filledContour as FilledContour
 
 ##// ============== //##
@@ -10,8 +12,11 @@ import src.post.filledContour as FilledContour
 ##// ============== //##
 fileName = "./bin/data.bin"
 
-# Get solution
-x, y, u  = BinaryData.read(fileName) # u[j,i], not u[i,j]
+# Get solution, or a single step of a snapshot archive: python post.py <archive> <step>
+if len(sys.argv) > 2:
+    x, y, u = SnapshotArchive.read(sys.argv[1], int(sys.argv[2])) # u[j,i], not u[i,j]
+else:
+    x, y, u = BinaryData.read(fileName) # u[j,i], not u[i,j]
 
 # Get gradients of solution
 dudy,    dudx    = np.gradient(u,    y[:,0], x[0,:], edge_order=2)
@@ -0,0 +1,309 @@
+/************************************************************************************************************************
+ * Microbenchmarks of the polynomial, master element and element operator kernels.
+ *
+ * Every kernel is timed over orders 1 to 16 (and the operator over element counts 10 to 10^6) and reported as ns per
+ * operation, GFLOP/s and GB/s in a JSON file, so that kernel regressions show before a release. The flop and byte counts
+ * are models of the work the kernels do (see the *Model functions), not hardware counters; kernels without a sensible
+ * model report null. Run on a single rank, e.g.
+ *
+ *      bin/HeatAdjointBenchmark --output bench.json --dims 3 --max-nodes 5000000
+ ************************************************************************************************************************/
+#include "CoreIncludes.hpp"
+#include "mesh/mesh.hpp"
+#include "mesh/lglTables.hpp"
+#include "mesh/polynomials.hpp"
+#include "physics/integrator.hpp"
+
+#include <mpi.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**< Keeps the compiler from removing the benchmarked work */
+static volatile f64 benchSink = 0.;
+
+/**< Command line parameters of the benchmarks */
+struct BenchParameters{
+    f64 minTime   = 0.05;                           /**< Seconds per timed batch */
+    u8  maxOrder  = Mesh::LGL_TABLE_MAX_ORDER;      /**< Orders 1..maxOrder are swept */
+    u8  nDims     = 2;                              /**< Dimensions of the operator benchmark */
+    u64 maxElems  = 1000000;                        /**< Element counts 10, 100, ... up to maxElems */
+    u64 maxNodes  = 20000000;                       /**< Operator grids with more nodes are skipped */
+    u64 nPoints   = 4096;                           /**< Points per polynomial evaluation batch */
+    std::string output = "benchmark.json";          /**< JSON file, "-" for stdout */
+};
+
+/**< Timing of one kernel at one configuration */
+struct BenchResult{
+    std::string name;
+    u8  order;
+    u64 nElems;                                     /**< 0 if the kernel has no elements */
+    u64 nOps;                                       /**< Operations per kernel call */
+    u64 nCalls;                                     /**< Kernel calls per timed batch */
+    f64 nsPerOp;                                    /**< Fastest of the timed batches */
+    f64 flopsPerOp, bytesPerOp;                     /**< Work models, negative if there is none */
+};
+
+// ------------------------ //
+// Timing                   //
+// ------------------------ //
+
+/************************************************************************************************************************
+ *  @brief Times a kernel and returns the fastest time per call.
+ *
+ *  @details
+ *  The kernel is called once to warm up, then the number of calls per batch is doubled until a batch takes minTime. The
+ *  fastest of three such batches is kept, which filters out interrupts and frequency ramps.
+ ************************************************************************************************************************/
+static f64 timeKernel(const std::function<void()>& kernel, f64 minTime, u64& nCalls) {
+
+    using clock = std::chrono::steady_clock;
+    kernel();
+
+    nCalls = 1;
+    f64 batch = 0.;
+    while (TRUE) {
+        const clock::time_point start = clock::now();
+        for (u64 c=0; c<nCalls; c++) kernel();
+        batch = std::chrono::duration<f64>(clock::now() - start).count();
+        if (batch >= minTime || nCalls >= (1ull << 40)) break;
+        nCalls = batch > 0. ? std::max<u64>(2*nCalls, (u64) (1.2*minTime/batch*nCalls)) : 2*nCalls;
+    }
+
+    f64 best = batch;
+    for (u32 repeat=0; repeat<2; repeat++) {
+        const clock::time_point start = clock::now();
+        for (u64 c=0; c<nCalls; c++) kernel();
+        best = std::min(best, std::chrono::duration<f64>(clock::now() - start).count());
+    }
+    return best / nCalls;
+}
+
+static void record(std::vector<BenchResult>& results, const BenchParameters& params, const std::string& name, u8 order,
+                   u64 nElems, u64 nOps, f64 flopsPerOp, f64 bytesPerOp, const std::function<void()>& kernel) {
+
+    BenchResult result = {name, order, nElems, nOps, 0, 0., flopsPerOp, bytesPerOp};
+    result.nsPerOp = timeKernel(kernel, params.minTime, result.nCalls) * 1e9 / nOps;
+    fprintf(stderr, "%-28s order %2i elements %8llu : %12.3f ns/op\n", name.c_str(), order, nElems, result.nsPerOp);
+    results.push_back(result);
+}
+
+// ------------------------ //
+// Work models              //
+// ------------------------ //
+
+/**< Bonnet recurrence of Legendre(n), 5 flops per step */
+static f64 legendreModel(u8 n) { return n < 2 ? 0. : 5.*(n-1); }
+
+/**< d1Legendre(n) evaluates Legendre(n-1) and Legendre(n) */
+static f64 d1LegendreModel(u8 n) { return legendreModel(n > 0 ? n-1 : 0) + legendreModel(n) + 6.; }
+
+/**< d2Legendre(n) evaluates d1Legendre(n) and Legendre(n) */
+static f64 d2LegendreModel(u8 n) { return d1LegendreModel(n) + legendreModel(n) + 7.; }
+
+/**< d3Legendre(n) evaluates d2Legendre(n) and d1Legendre(n) */
+static f64 d3LegendreModel(u8 n) { return d2LegendreModel(n) + d1LegendreModel(n) + 7.; }
+
+/**< Cartesian element operator (see Integrator::applyElement): diagonal mass and, per axis, D, scaling and D^T */
+static f64 elementFlopsModel(u8 nDims, u64 n) {
+
+    const f64 nLocal = std::pow((f64) n, nDims);
+    return 3.*nLocal + nDims*(4.*nLocal*n + 3.*nLocal);
+}
+
+// ------------------------ //
+// Benchmarks               //
+// ------------------------ //
+
+static void benchPolynomials(std::vector<BenchResult>& results, const BenchParameters& params) {
+
+    const u64 m = params.nPoints;
+    const EigenDefs::Array1D<f64> xi = EigenDefs::Array1D<f64>::LinSpaced(m, -0.999, 0.999); // d*Legendre are singular at +-1
+    EigenDefs::Array1D<f64> P, d1P, d2P, d3P;
+
+    for (u8 p=1; p<=params.maxOrder; p++) {
+        record(results, params, "Legendre", p, 0, m, legendreModel(p), 8., [&] {
+            f64 sum = 0.;
+            for (u64 i=0; i<m; i++) sum += Polynomials::Legendre(p, xi[i]);
+            benchSink = sum;
+        });
+        record(results, params, "d1Legendre", p, 0, m, d1LegendreModel(p), 8., [&] {
+            f64 sum = 0.;
+            for (u64 i=0; i<m; i++) sum += Polynomials::d1Legendre(p, xi[i]);
+            benchSink = sum;
+        });
+        record(results, params, "d2Legendre", p, 0, m, d2LegendreModel(p), 8., [&] {
+            f64 sum = 0.;
+            for (u64 i=0; i<m; i++) sum += Polynomials::d2Legendre(p, xi[i]);
+            benchSink = sum;
+        });
+        record(results, params, "d3Legendre", p, 0, m, d3LegendreModel(p), 8., [&] {
+            f64 sum = 0.;
+            for (u64 i=0; i<m; i++) sum += Polynomials::d3Legendre(p, xi[i]);
+            benchSink = sum;
+        });
+        // P and its three derivatives per point, 9 arrays streamed per recurrence step
+        record(results, params, "fusedLegendre", p, 0, m, 11.*(p-1), 104.*(p-1) + 40., [&] {
+            Polynomials::fusedLegendre(p, xi, P, d1P, d2P, d3P);
+            benchSink = P[m/2] + d3P[m/2];
+        });
+    }
+}
+
+static void benchInterpolation(std::vector<BenchResult>& results, const BenchParameters& params) {
+
+    const u64 m = params.nPoints;
+    const EigenDefs::Array1D<f64> X = EigenDefs::Array1D<f64>::LinSpaced(m, -1., 1.);
+    EigenDefs::Array1D<f64> out(m);
+
+    for (u8 p=1; p<=params.maxOrder; p++) {
+        const u64 n = p+1;
+        Mesh::MasterElement master(1);
+        master.setnVars(1);
+        master.setLGLOrder(0, p);
+        const EigenDefs::Array1D<f64>& nodes = master.getNodes(0);
+        const EigenDefs::Array1D<f64> values = nodes.sin();
+
+        // Vandermonde matrix and column-pivoted QR of an (n x n) matrix
+        record(results, params, "PolyInterp1D.fit", p, 0, 1, 4./3.*n*n*n + 3.*n*n, 8.*n*n, [&] {
+            Polynomials::PolyInterp1D poly(nodes, values);
+            benchSink = poly(0.5);
+        });
+
+        const Polynomials::PolyInterp1D poly(nodes, values);
+        record(results, params, "PolyInterp1D.evaluate", p, 0, m, 2.*(n-1), 16., [&] {
+            poly.evaluate(X, out);
+            benchSink = out[m/2];
+        });
+        record(results, params, "PolyInterp1D.operator()", p, 0, m, 2.*(n-1), 16., [&] {
+            benchSink = poly(X)[m/2];
+        });
+    }
+}
+
+static void benchMasterElement(std::vector<BenchResult>& results, const BenchParameters& params) {
+
+    for (u8 p=1; p<=params.maxOrder; p++) {
+        for (u8 nDims=1; nDims<=3; nDims++) {
+            Mesh::MasterElement master(nDims);
+            master.setnVars(1);
+            record(results, params, "MasterElement.setLGLOrder." + std::to_string(nDims) + "D", p, 0, 1, -1., -1., [&] {
+                if      (nDims == 1) master.setLGLOrder(0, p);
+                else if (nDims == 2) master.setLGLOrder(0, p, p);
+                else                 master.setLGLOrder(0, p, p, p);
+                benchSink = master.d1LagrangeMatrix(0, 0)(0, 0);
+            });
+        }
+    }
+}
+
+static void benchOperator(std::vector<BenchResult>& results, const BenchParameters& params) {
+
+    const u8 nDims = params.nDims;
+    for (u64 nElemsTarget=10; nElemsTarget<=params.maxElems; nElemsTarget*=10) {
+        const u64 nElemsAxis = std::max<u64>(1, (u64) std::llround(std::pow((f64) nElemsTarget, 1./nDims)));
+        const u64 nElems     = (u64) std::llround(std::pow((f64) nElemsAxis, nDims));
+        const EigenDefs::Array1D<f64> xe = EigenDefs::Array1D<f64>::LinSpaced(nElemsAxis+1, 0., 1.);
+
+        for (u8 p=1; p<=params.maxOrder; p++) {
+            if (std::pow((f64) (nElemsAxis*p+1), nDims) > (f64) params.maxNodes) break;
+
+            std::unique_ptr<Mesh::Geometry> geometry;
+            if      (nDims == 1) geometry = std::make_unique<Mesh::Geometry>(xe);
+            else if (nDims == 2) geometry = std::make_unique<Mesh::Geometry>(xe, xe);
+            else                 geometry = std::make_unique<Mesh::Geometry>(xe, xe, xe);
+            geometry->MasterElement.setnVars(1);
+            if      (nDims == 1) geometry->MasterElement.setLGLOrder(0, p);
+            else if (nDims == 2) geometry->MasterElement.setLGLOrder(0, p, p);
+            else                 geometry->MasterElement.setLGLOrder(0, p, p, p);
+
+            Physics::Integrator heat(*geometry);
+            heat.setHeatCoefficients(1., 1.);
+            const EigenDefs::Vector<f64> u = EigenDefs::Vector<f64>::Random(heat.nDOFs(0));
+            EigenDefs::Vector<f64> y;
+
+            // gather of u, scatter-add into y, per element node
+            const f64 nLocal = std::pow((f64) (p+1), nDims);
+            record(results, params, "Integrator.applyOmega." + std::to_string(nDims) + "D", p, nElems, nElems,
+                   elementFlopsModel(nDims, p+1), 24.*nLocal, [&] {
+                heat.applyOmega(0, u, y);
+                benchSink = y[0];
+            });
+        }
+    }
+}
+
+// ------------------------ //
+// Output                   //
+// ------------------------ //
+
+static void writeJSON(const std::vector<BenchResult>& results, const BenchParameters& params) {
+
+    FILE* file = params.output == "-" ? stdout : fopen(params.output.c_str(), "w");
+    CHECK_FATAL_ASSERT(file != nullptr, "Could not open the benchmark output file")
+
+    fprintf(file, "{\n  \"context\": {\"release\": %d, \"profile\": %d, \"threads\": %d, \"eigen\": \"%d.%d.%d\", "
+                  "\"minTime\": %g, \"points\": %llu, \"operatorDims\": %d},\n  \"benchmarks\": [\n",
+            RELEASE, PROFILE_ENABLED, threadCount(), EIGEN_WORLD_VERSION, EIGEN_MAJOR_VERSION, EIGEN_MINOR_VERSION,
+            params.minTime, params.nPoints, params.nDims);
+    for (u64 r=0; r<results.size(); r++) {
+        const BenchResult& result = results[r];
+        char gflops[32] = "null", gbytes[32] = "null";
+        if (result.flopsPerOp >= 0.) snprintf(gflops, sizeof(gflops), "%.4f", result.flopsPerOp / result.nsPerOp);
+        if (result.bytesPerOp >= 0.) snprintf(gbytes, sizeof(gbytes), "%.4f", result.bytesPerOp / result.nsPerOp);
+        fprintf(file, "    {\"name\": \"%s\", \"order\": %d, \"elements\": %llu, \"opsPerCall\": %llu, \"calls\": %llu, "
+                      "\"nsPerOp\": %.4f, \"gflops\": %s, \"gbytesPerSecond\": %s}%s\n",
+                result.name.c_str(), result.order, result.nElems, result.nOps, result.nCalls, result.nsPerOp, gflops, gbytes,
+                r+1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (file != stdout) fclose(file);
+}
+
+static void usage() {
+
+    fprintf(stderr, "syntax: HeatAdjointBenchmark [--output file|-] [--min-time s] [--max-order p] [--dims d]\n"
+                    "                             [--max-elements n] [--max-nodes n] [--points n]\n");
+}
+
+int main(int argc, char *argv[]){
+    i32 rankid, nprocs;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rankid);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    HYPRE_Init();
+    CHECK_FATAL_ASSERT(nprocs == 1, "The benchmarks run on a single rank")
+
+    BenchParameters params;
+    for (i32 a=1; a<argc; a++) {
+        const b8 hasValue = a+1 < argc;
+        if      (!strcmp(argv[a], "--output")       && hasValue) params.output   = argv[++a];
+        else if (!strcmp(argv[a], "--min-time")     && hasValue) params.minTime  = atof(argv[++a]);
+        else if (!strcmp(argv[a], "--max-order")    && hasValue) params.maxOrder = (u8) std::clamp(atoi(argv[++a]), 1, 254);
+        else if (!strcmp(argv[a], "--dims")         && hasValue) params.nDims    = (u8) std::clamp(atoi(argv[++a]), 1, 3);
+        else if (!strcmp(argv[a], "--max-elements") && hasValue) params.maxElems = strtoull(argv[++a], nullptr, 10);
+        else if (!strcmp(argv[a], "--max-nodes")    && hasValue) params.maxNodes = strtoull(argv[++a], nullptr, 10);
+        else if (!strcmp(argv[a], "--points")       && hasValue) params.nPoints  = std::max(1ull, strtoull(argv[++a], nullptr, 10));
+        else { usage(); MPI_Finalize(); return EXIT_FAILURE_UNKNOWN; }
+    }
+
+    // The setup messages of the benchmarked objects would be timed as well
+    setLogLevel(LOG_LEVEL_ERROR);
+
+    std::vector<BenchResult> results;
+    benchPolynomials(results, params);
+    benchInterpolation(results, params);
+    benchMasterElement(results, params);
+    benchOperator(results, params);
+    writeJSON(results, params);
+
+    HYPRE_Finalize();
+    MPI_Finalize();
+    return EXIT_SUCCESS;
+}
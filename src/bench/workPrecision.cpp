@@ -0,0 +1,244 @@
+/************************************************************************************************************************
+ * Work-precision sweep of -div(grad(u)) = f on the domain of main.cpp, using the manufactured solution of valueSource.hpp.
+ *
+ * Every combination of elements per axis (h) and polynomial order (p) is set up and solved as in main.cpp, and its L2/H1
+ * error, DOFs, wall time (fastest of --repeats) and memory are recorded. Rank 0 reports the full table, the Pareto-optimal
+ * (h, p) pairs in (time, L2 error) and, per target error, the cheapest pair reaching it, and writes the table to a CSV
+ * file, e.g.
+ *
+ *      mpiexec -n 4 bin/HeatAdjointWorkPrecision --dims 3 --max-elements 32 --max-order 8 --output workPrecision.csv
+ ************************************************************************************************************************/
+#include "CoreIncludes.hpp"
+#include "mesh/mesh.hpp"
+#include "mesh/polynomials.hpp"
+#include "physics/integrator.hpp"
+#include "physics/valueSource.hpp"
+
+#include <mpi.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**< Command line parameters of the sweep */
+struct SweepParameters{
+    u8  nDims     = 3;                              /**< Dimensions, main.cpp solves in 3D */
+    u64 maxElems  = 32;                             /**< Elements per axis 2, 4, ... up to maxElems */
+    u8  maxOrder  = 8;                              /**< Orders 1..maxOrder */
+    u64 maxDOFs   = 2000000;                        /**< Combinations with more global DOFs are skipped */
+    u32 nRepeats  = 3;                              /**< Solves per combination, the fastest is kept */
+    std::string output = "workPrecision.csv";
+};
+
+/**< Cost and accuracy of one (h, p) pair */
+struct SweepResult{
+    u64 nElemsAxis;
+    u8  order;
+    u64 nDOFs;
+    Physics::ErrorNorms error;
+    f64 time;                                       /**< Seconds of setup and solve, slowest rank */
+    f64 memory;                                     /**< MB of peak resident memory growth, largest rank, negative if unknown */
+    b8  isPareto;
+};
+
+// ------------------------ //
+// Memory                   //
+// ------------------------ //
+
+/**< Returns the value (kB) of key in /proc/self/status, negative if unavailable */
+static f64 statusKB(const char* key) {
+
+    FILE* file = fopen("/proc/self/status", "r");
+    if (!file) return -1.;
+    char line[256];
+    f64 value = -1.;
+    const u64 length = strlen(key);
+    while (fgets(line, sizeof(line), file)) {
+        if (!strncmp(line, key, length) && line[length] == ':') { value = atof(line + length + 1); break; }
+    }
+    fclose(file);
+    return value;
+}
+
+/**< Resets the peak resident memory (VmHWM) to the current one, returns FALSE if the kernel does not allow it */
+static b8 resetPeakMemory() {
+
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (!file) return FALSE;
+    const b8 isReset = fputs("5", file) >= 0;
+    return fclose(file) == 0 && isReset;
+}
+
+// ------------------------ //
+// Sweep                    //
+// ------------------------ //
+
+static f64 zero(f64, f64, f64) { return 0.; }
+
+/**< Element size of a result, EIGEN_PI is a long double */
+static f64 h(const SweepResult& result) { return (f64) EIGEN_PI/result.nElemsAxis; }
+
+/**< Sets up and solves one (h, p) pair as main.cpp does, timed from the mesh to the solution */
+template<u8 nDims>
+static void solve(u64 nElemsAxis, u8 p, Physics::ExactSolution exact, SweepResult& result) {
+
+    const f64 Lx[2] = {0., 1.*EIGEN_PI}; /**< domain endpoints, as in main.cpp */
+
+    const b8  hasPeak = resetPeakMemory();
+    const f64 rssBefore = statusKB("VmRSS");
+    MPI_Barrier(MPI_COMM_WORLD);
+    const f64 start = MPI_Wtime();
+
+    EigenDefs::Array1D<f64> x1e = EigenDefs::Array1D<f64>::LinSpaced(nElemsAxis+1, Lx[0], Lx[1]); /**< x1 Endpoints */
+    std::unique_ptr<Mesh::Geometry> Domain;
+    if      (nDims == 1) Domain = std::make_unique<Mesh::Geometry>(x1e);
+    else if (nDims == 2) Domain = std::make_unique<Mesh::Geometry>(x1e, x1e);
+    else                 Domain = std::make_unique<Mesh::Geometry>(x1e, x1e, x1e);
+    Domain->decompose(MPI_COMM_WORLD);
+    Domain->MasterElement.setnVars(1);
+    Domain->MasterElement.setLGLOrder(0, p, p, p); // only the first nDims orders are read
+
+    Physics::Integrator Heat(*Domain);
+    EigenDefs::Vector<f64> u;
+    Heat.solveFastDiagonalization(0, manufacturedSource<nDims>, zero, u);
+
+    f64 time = MPI_Wtime() - start;
+    f64 memory = (hasPeak && rssBefore >= 0.) ? (statusKB("VmHWM") - rssBefore)/1024. : -1.;
+    f64 memoryMin = memory;
+    MPI_Allreduce(MPI_IN_PLACE, &time,      1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &memory,    1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &memoryMin, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+    if (memoryMin < 0.) memory = -1.; // some rank could not measure
+
+    result.time   = std::min(result.time, time);
+    result.memory = std::max(result.memory, memory);
+    result.nDOFs  = Heat.nGlobalDOFs(0);
+    result.error  = Heat.errorOmega(0, u, exact);
+}
+
+/**< Best time over the repeats, the error does not change between them */
+template<u8 nDims>
+static SweepResult solveCase(u64 nElemsAxis, u8 p, u32 nRepeats) {
+
+    const Physics::ExactSolution exact = {manufacturedSolution<nDims>, {manufacturedGradient<nDims,0>, manufacturedGradient<nDims,1>,
+                                                                        manufacturedGradient<nDims,2>}};
+    SweepResult result = {nElemsAxis, p, 0, {}, INFINITY, -1., FALSE};
+    for (u32 repeat=0; repeat<nRepeats; repeat++) solve<nDims>(nElemsAxis, p, exact, result);
+    return result;
+}
+
+/**< Marks the pairs no other pair beats in both time and L2 error */
+static void markPareto(std::vector<SweepResult>& results) {
+
+    std::vector<SweepResult*> byTime;
+    for (SweepResult& result : results) byTime.push_back(&result);
+    std::sort(byTime.begin(), byTime.end(), [](const SweepResult* a, const SweepResult* b) {
+        return a->time < b->time || (a->time == b->time && a->error.L2 < b->error.L2);
+    });
+
+    f64 bestError = INFINITY;
+    for (SweepResult* result : byTime) {
+        result->isPareto = result->error.L2 < bestError;
+        bestError = std::min(bestError, result->error.L2);
+    }
+}
+
+static void report(std::vector<SweepResult>& results, const SweepParameters& params) {
+
+    markPareto(results);
+
+    INFO_MSG("Work-precision sweep in %iD on [0,pi]^%i (* Pareto-optimal in time and L2 error):", params.nDims, params.nDims)
+    INFO_MSG("%8s %10s %5s %12s %12s %12s %10s %10s", "elements", "h", "p", "DOFs", "L2 error", "H1 error", "time [s]", "mem [MB]")
+    for (const SweepResult& r : results) {
+        INFO_MSG("%8llu %10.4e %5i %12llu %12.4e %12.4e %10.3e %10.1f %s", r.nElemsAxis, h(r), r.order, r.nDOFs,
+                 r.error.L2, r.error.H1, r.time, r.memory, r.isPareto ? "*" : "")
+    }
+
+    INFO_MSG("Time to accuracy (cheapest pair reaching each L2 error):")
+    INFO_MSG("%10s %10s %8s %5s %12s", "L2 error", "time [s]", "elements", "p", "DOFs")
+    for (i32 exponent=-1; exponent>=-12; exponent--) {
+        const f64 target = std::pow(10., exponent);
+        const SweepResult* best = nullptr;
+        for (const SweepResult& r : results) {
+            if (r.error.L2 <= target && (!best || r.time < best->time)) best = &r;
+        }
+        if (!best) break;
+        INFO_MSG("%10.0e %10.3e %8llu %5i %12llu", target, best->time, best->nElemsAxis, best->order, best->nDOFs)
+    }
+
+    FILE* file = fopen(params.output.c_str(), "w");
+    if (!file) {
+        WARN_MSG("Could not open %s, the table is only logged", params.output.c_str())
+        return;
+    }
+    fprintf(file, "nDims,elementsPerAxis,h,order,DOFs,errorL2,errorH1semi,errorH1,timeSeconds,memoryMB,pareto\n");
+    for (const SweepResult& r : results) {
+        fprintf(file, "%i,%llu,%.10e,%i,%llu,%.10e,%.10e,%.10e,%.6f,%.3f,%i\n", params.nDims, r.nElemsAxis, h(r),
+                r.order, r.nDOFs, r.error.L2, r.error.H1semi, r.error.H1, r.time, r.memory, (i32) r.isPareto);
+    }
+    fclose(file);
+    INFO_MSG("Work-precision table written to %s", params.output.c_str())
+}
+
+static void usage() {
+
+    fprintf(stderr, "syntax: HeatAdjointWorkPrecision [--dims d] [--max-elements n] [--max-order p] [--max-dofs n] [--repeats n] [--output file]\n");
+}
+
+int main(int argc, char *argv[]){
+    i32 rankid, nprocs;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rankid);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    HYPRE_Init();
+
+    SweepParameters params;
+    for (i32 a=1; a<argc; a++) {
+        const b8 hasValue = a+1 < argc;
+        if      (!strcmp(argv[a], "--dims")         && hasValue) params.nDims    = (u8) std::clamp(atoi(argv[++a]), 1, 3);
+        else if (!strcmp(argv[a], "--max-elements") && hasValue) params.maxElems = strtoull(argv[++a], nullptr, 10);
+        else if (!strcmp(argv[a], "--max-order")    && hasValue) params.maxOrder = (u8) std::clamp(atoi(argv[++a]), 1, 254);
+        else if (!strcmp(argv[a], "--max-dofs")     && hasValue) params.maxDOFs  = strtoull(argv[++a], nullptr, 10);
+        else if (!strcmp(argv[a], "--repeats")      && hasValue) params.nRepeats = (u32) std::max(atoi(argv[++a]), 1);
+        else if (!strcmp(argv[a], "--output")       && hasValue) params.output   = argv[++a];
+        else {
+            if (rankid == 0) usage();
+            MPI_Finalize();
+            return EXIT_FAILURE_UNKNOWN;
+        }
+    }
+    initLogging("log", rankid, LOG_LEVEL_INFO, LOG_LEVEL_INFO);
+
+    // Geometry::decompose needs at least as many elements as blocks along every axis
+    i32 procDims[3] = {0, 0, 0};
+    MPI_Dims_create(nprocs, params.nDims, procDims);
+    const u64 minElems = (u64) *std::max_element(procDims, procDims + params.nDims);
+
+    std::vector<SweepResult> results;
+    for (u64 nElemsAxis=2; nElemsAxis<=params.maxElems; nElemsAxis*=2) {
+        if (nElemsAxis < minElems) continue;
+        for (u8 p=1; p<=params.maxOrder; p++) {
+            if (std::pow((f64) (nElemsAxis*p+1), params.nDims) > (f64) params.maxDOFs) break;
+
+            setLogLevel(LOG_LEVEL_WARN); // keeps the per-solve messages out of the timings
+            SweepResult result;
+            if      (params.nDims == 1) result = solveCase<1>(nElemsAxis, p, params.nRepeats);
+            else if (params.nDims == 2) result = solveCase<2>(nElemsAxis, p, params.nRepeats);
+            else                        result = solveCase<3>(nElemsAxis, p, params.nRepeats);
+            setLogLevel(LOG_LEVEL_INFO);
+
+            INFO_MSG("elements %llu, p %i : %llu DOFs, L2 error %.4e, H1 error %.4e in %.3e s", nElemsAxis, p, result.nDOFs,
+                     result.error.L2, result.error.H1, result.time)
+            results.push_back(result);
+        }
+    }
+    if (rankid == 0) report(results, params);
+
+    HYPRE_Finalize();
+    shutdownLogging();
+    MPI_Finalize();
+    return EXIT_SUCCESS;
+}
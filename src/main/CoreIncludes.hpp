@@ -2,6 +2,9 @@
 #include "core/definesEigen.hpp"
 #include "core/logger.hpp"
 #include "core/fatals.hpp"
+#include "core/threads.hpp"
+#include "core/profiler.hpp"
+#include "core/allocations.hpp"
 #if RELEASE==0
     #include <iostream>
     #include <iomanip>
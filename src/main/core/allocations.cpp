@@ -0,0 +1,90 @@
+#include "allocations.hpp"
+#include "logger.hpp"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#if ALLOCATION_CHECK_ENABLED == 1
+
+// ------------------------ //
+// Counting malloc          //
+// ------------------------ //
+// The executable's definitions take precedence over the ones of glibc (also for the shared libraries), which remain
+// reachable through their __libc_ names. free is left untouched, the memory comes from the glibc allocator either way.
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+}
+
+/**< Trivially constructed, so that it can be used before the thread is fully set up */
+static thread_local u64 nThreadAllocations = 0;
+
+extern "C" {
+
+void* malloc(size_t size) noexcept {
+
+    nThreadAllocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) noexcept {
+
+    nThreadAllocations++;
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept {
+
+    nThreadAllocations++;
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept {
+
+    nThreadAllocations++;
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept {
+
+    nThreadAllocations++;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) noexcept {
+
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment-1)) != 0) return EINVAL;
+    nThreadAllocations++;
+    void* out = __libc_memalign(alignment, size);
+    if (!out) return ENOMEM;
+    *ptr = out;
+    return 0;
+}
+
+} // end extern "C"
+
+u64 threadAllocations() {
+
+    return nThreadAllocations;
+}
+
+#else
+
+u64 threadAllocations() {
+
+    return 0;
+}
+
+#endif
+
+NoAllocationScope::~NoAllocationScope() {
+
+    const u64 nAllocations = threadAllocations() - start;
+    if (nAllocations > 0) {
+        FATAL_MSG("Allocation Failure: %llu heap allocations in the allocation-free scope %s", nAllocations, name)
+        exit(EXIT_FAILURE_ASSERTION);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "definesStandard.hpp"
+
+#include <cstddef>
+
+#ifndef ALLOCATION_CHECK
+    #if RELEASE == 1 || !defined(__GLIBC__)
+        /** DISABLED --> RELEASE flag has been enabled (or no glibc), build with ALLOCATION_CHECK=1 to keep the counter */
+        #define ALLOCATION_CHECK_ENABLED 0
+    #else
+        /** Count the heap allocations of every thread and check the allocation-free scopes */
+        #define ALLOCATION_CHECK_ENABLED 1
+    #endif
+#else
+    /** Allocation counter explicitly enabled (ALLOCATION_CHECK=1) or disabled (ALLOCATION_CHECK=0), needs glibc */
+    #define ALLOCATION_CHECK_ENABLED ALLOCATION_CHECK
+#endif
+
+/************************************************************************************************************************
+*  @brief   Returns the number of heap allocations made by the calling thread so far.
+*
+*  @details Counts every call into the malloc family (malloc, calloc, realloc and the aligned variants), which includes
+*           operator new and the Eigen allocations. Always 0 without ALLOCATION_CHECK_ENABLED.
+************************************************************************************************************************/
+u64 threadAllocations();
+
+/************************************************************************************************************************
+*  @brief   Fatal if the calling thread allocated on the heap between construction and destruction, see
+*           @ref ASSERT_NO_ALLOCATION.
+************************************************************************************************************************/
+class NoAllocationScope {
+
+    public:
+
+        explicit NoAllocationScope(const char* name_) : name(name_), start(threadAllocations()) {}
+        ~NoAllocationScope();
+
+        NoAllocationScope(const NoAllocationScope&) = delete;
+        NoAllocationScope& operator =(const NoAllocationScope&) = delete;
+
+    private:
+
+        const char* name;
+        u64 start;
+};
+
+#define ALLOCATION_CONCAT_(a, b) a##b
+#define ALLOCATION_CONCAT(a, b) ALLOCATION_CONCAT_(a, b)
+
+#if ALLOCATION_CHECK_ENABLED == 1
+/************************************************************************************************************************
+ *  @brief Asserts that the calling thread makes no heap allocation in the rest of the enclosing scope, e.g. the element
+ *  loop of a kernel inside its parallel region.
+ *
+ *  @param name a string literal naming the scope in the failure message, e.g. "Integrator.applyOmega"
+ ************************************************************************************************************************/
+#define ASSERT_NO_ALLOCATION(name)                                                                                     \
+    NoAllocationScope ALLOCATION_CONCAT(noAllocation_, __LINE__)(name);
+#else
+/** DISABLED --> ALLOCATION_CHECK_ENABLED is 0 */
+#define ASSERT_NO_ALLOCATION(name)
+#endif
@@ -1,46 +1,277 @@
 #include "logger.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdlib.h>
 
+std::atomic<i32> logThreshold(LOG_LEVEL_TRACE);
+
+static const char* levelStrings[6] = { "[FATAL]: ",
+                                       "[ERROR]: ",
+                                       "[WARN] : ",
+                                       "[INFO] : ",
+                                       "[DEBUG]: ",
+                                       "[TRACE]: "
+                                     };
+
+// ------------------------ //
+// Rings                    //
+// ------------------------ //
+
+/**< Message formatted by a logging thread */
+struct LogRecord{
+    f64  time;                                          /**< Seconds since initLogging */
+    u32  length;                                        /**< Characters of text, without the terminating null */
+    u32  level;
+    char text[LOG_RECORD_LENGTH];
+};
+
+/**< Single-producer single-consumer ring of a logging thread, drained by the drain thread */
+struct LogRing{
+    LogRecord records[LOG_RING_RECORDS];
+    alignas(64) std::atomic<u64> head{0};               /**< Records written by the owning thread */
+    alignas(64) std::atomic<u64> tail{0};               /**< Records written out by the drain thread */
+    std::atomic<b8> isOwned{TRUE};                      /**< FALSE once the owning thread exited, the ring is then reused */
+};
+
+/**< State of the asynchronous logging, never freed so that exiting threads can always release their rings */
+struct Logger{
+    std::atomic<b8> isActive{FALSE};
+    i32 rank = 0;
+    logLevel echoLevel = LOG_LEVEL_INFO;
+    FILE* sink = nullptr;
+    std::chrono::steady_clock::time_point start;
+
+    std::mutex ringMutex;                               /**< Guards rings, only taken to register a thread and to drain */
+    std::vector<std::unique_ptr<LogRing>> rings;
+
+    std::thread drainer;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    b8 stopping = FALSE;
+};
+
+static Logger& logger() {
+
+    static Logger* instance = new Logger;
+    return *instance;
+}
+
+/**< Ring of the calling thread, released when the thread exits */
+struct LogRingHandle{
+    LogRing* ring = nullptr;
+    ~LogRingHandle() { if (ring) ring->isOwned.store(FALSE, std::memory_order_release); }
+};
+static thread_local LogRingHandle ringHandle;
+
+static LogRing* threadRing() {
+
+    if (ringHandle.ring) return ringHandle.ring;
+
+    Logger& L = logger();
+    std::lock_guard<std::mutex> lock(L.ringMutex);
+    for (std::unique_ptr<LogRing>& ring : L.rings) {
+        if (!ring->isOwned.load(std::memory_order_acquire) &&
+            ring->tail.load(std::memory_order_acquire) == ring->head.load(std::memory_order_relaxed)) {
+            ring->isOwned.store(TRUE, std::memory_order_relaxed);
+            ringHandle.ring = ring.get();
+            return ringHandle.ring;
+        }
+    }
+    L.rings.push_back(std::make_unique<LogRing>());
+    ringHandle.ring = L.rings.back().get();
+    return ringHandle.ring;
+}
+
+// ------------------------ //
+// Drain thread             //
+// ------------------------ //
+
+/**< Writes out every buffered record, returns the number of records written */
+static u64 drainRings(Logger& L) {
+
+    u64 nDrained = 0;
+    std::lock_guard<std::mutex> lock(L.ringMutex);
+    for (std::unique_ptr<LogRing>& ring : L.rings) {
+        const u64 head = ring->head.load(std::memory_order_acquire);
+        u64 tail = ring->tail.load(std::memory_order_relaxed);
+        for (; tail<head; tail++) {
+            const LogRecord& record = ring->records[tail % LOG_RING_RECORDS];
+            u32 length = record.length;
+            while (length > 0 && record.text[length-1] == '\n') length--;
+
+            fprintf(L.sink, "[%12.6f] [rank %d] %s%.*s\n", record.time, L.rank, levelStrings[record.level], (i32) length,
+                    record.text);
+            // fatal and error messages were written to stderr by the logging thread already
+            if (L.rank == 0 && record.level <= (u32) L.echoLevel && record.level > LOG_LEVEL_ERROR) {
+                printf("%s%.*s\n", levelStrings[record.level], (i32) length, record.text);
+            }
+            ring->tail.store(tail+1, std::memory_order_release);
+            nDrained++;
+        }
+    }
+    if (nDrained > 0) {
+        fflush(L.sink);
+        if (L.rank == 0) fflush(stdout);
+    }
+    return nDrained;
+}
+
+static void drainLoop() {
+
+    Logger& L = logger();
+    while (TRUE) {
+        if (drainRings(L) > 0) continue;
+
+        std::unique_lock<std::mutex> lock(L.wakeMutex);
+        if (L.stopping) break;
+        L.wake.wait_for(lock, std::chrono::milliseconds(2));
+    }
+    drainRings(L);
+}
+
+// ------------------------ //
+// Interface                //
+// ------------------------ //
+
+void initLogging(const char* directory, i32 rank, logLevel level, logLevel echoLevel){
+
+    static std::once_flag registerExit;
+    Logger& L = logger();
+    if (L.isActive.load()) shutdownLogging();
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    const std::string fileName = std::string(directory) + "/log_r" + std::to_string(rank) + ".txt";
+    FILE* sink = fopen(fileName.c_str(), "w");
+    if (!sink) {
+        fprintf(stderr, "[ERROR]: Could not open the log file %s, logging stays on stdout\n", fileName.c_str());
+        setLogLevel(level);
+        return;
+    }
+
+    L.rank      = rank;
+    L.echoLevel = echoLevel;
+    L.sink      = sink;
+    L.start     = std::chrono::steady_clock::now();
+    L.stopping  = FALSE;
+    setLogLevel(level);
+
+    L.drainer = std::thread(drainLoop);
+    L.isActive.store(TRUE, std::memory_order_release);
+
+    // messages still buffered when the code exits (e.g. through a fatal assertion) are written out at exit
+    std::call_once(registerExit, [] { atexit(shutdownLogging); });
+}
+
+void shutdownLogging(){
+
+    Logger& L = logger();
+    if (!L.isActive.exchange(FALSE)) return;
+
+    {
+        std::lock_guard<std::mutex> lock(L.wakeMutex);
+        L.stopping = TRUE;
+    }
+    L.wake.notify_one();
+    L.drainer.join();
+    fclose(L.sink);
+    L.sink = nullptr;
+}
+
+void flushLogging(){
+
+    Logger& L = logger();
+    if (!L.isActive.load(std::memory_order_acquire)) { fflush(stdout); return; }
+
+    // snapshot the heads, then wait until the drain thread passed them
+    std::vector<std::pair<LogRing*, u64>> heads;
+    {
+        std::lock_guard<std::mutex> lock(L.ringMutex);
+        for (std::unique_ptr<LogRing>& ring : L.rings) heads.push_back({ring.get(), ring->head.load(std::memory_order_acquire)});
+    }
+    for (const std::pair<LogRing*, u64>& head : heads) {
+        while (head.first->tail.load(std::memory_order_acquire) < head.second) {
+            L.wake.notify_one();
+            std::this_thread::yield();
+        }
+    }
+}
+
+void setLogLevel(logLevel level){
+
+    logThreshold.store(level, std::memory_order_relaxed);
+}
 
 void logOutput(logLevel level, const char* message, ...){
-    const char* levelStrings[6] = { "[FATAL]: ", 
-                                    "[ERROR]: ", 
-                                    "[WARN] : ", 
-                                    "[INFO] : ", 
-                                    "[DEBUG]: ", 
-                                    "[TRACE]: "
-                                  };
-    b8 isError = level < LOG_LEVEL_WARN;
-
-    // avoid dynamic memory allocation
-    // 16k char limit, but its OK
-    // TODO: clean this up
-    const i32 msgLength = 16000;
-    char outMessage[msgLength];
-    memset(outMessage, 0, sizeof(outMessage));
-
-    // format original message
+
+    if (!logEnabled(level)) return;
+
     // NOTE: MS headers override the GCC/Clang va_list type with "typedef char* va_list" sometimes.
     // Results in a srange error. Workaround is to use __builtin_va_list, tye type GCC/Clang va_start
     // expects.
-
-    // take arg list, create pointer
     __builtin_va_list argPtr; // instead of va_list
 
-    // take all arguments after message -> append all to message
-    va_start(argPtr, message);              
-    vsnprintf(outMessage, msgLength, message, argPtr);
+    Logger& L = logger();
+    if (!L.isActive.load(std::memory_order_acquire)) {
+        // synchronous fallback before initLogging, formatted once behind the level string
+        const i32 msgLength = 16000;
+        char outMessage[msgLength+2];
+        const u64 prefix = strlen(levelStrings[level]);
+        memcpy(outMessage, levelStrings[level], prefix);
+
+        va_start(argPtr, message);
+        i32 length = vsnprintf(outMessage + prefix, msgLength - prefix, message, argPtr);
+        va_end(argPtr);
+        if (length < 0) return;
+        length = std::min<i32>(length, msgLength - prefix - 1) + prefix;
+        outMessage[length++] = '\n';
+        fwrite(outMessage, 1, length, level < LOG_LEVEL_WARN ? stderr : stdout);
+        return;
+    }
+
+    // ------------------------ //
+    // Format into the ring     //
+    // ------------------------ //
+    LogRing* ring = threadRing();
+    const u64 head = ring->head.load(std::memory_order_relaxed);
+    while (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_RECORDS) {
+        L.wake.notify_one();
+        std::this_thread::yield();
+    }
+
+    LogRecord& record = ring->records[head % LOG_RING_RECORDS];
+    record.time  = std::chrono::duration<f64>(std::chrono::steady_clock::now() - L.start).count();
+    record.level = level;
+    va_start(argPtr, message);
+    const i32 length = vsnprintf(record.text, LOG_RECORD_LENGTH, message, argPtr);
     va_end(argPtr);
+    if (length < 0) {
+        record.length = 0;
+    } else if (length >= LOG_RECORD_LENGTH) {
+        record.length = LOG_RECORD_LENGTH-1;
+        memcpy(record.text + LOG_RECORD_LENGTH-4, "...", 3); // truncated
+    } else {
+        record.length = (u32) length;
+    }
 
-    // prepend some stuff
-    char outMessage2[msgLength+1];
-    snprintf(outMessage2, msgLength+1, "%s%s\n", levelStrings[level], outMessage);
-    
-    // TODO: Platform-specific output
-    printf("%s", outMessage2);
-    
-};
+    // fatal and error messages are shown right away, the code usually exits right after them
+    if (level < LOG_LEVEL_WARN) {
+        u32 shown = record.length;
+        while (shown > 0 && record.text[shown-1] == '\n') shown--;
+        fprintf(stderr, "[rank %d] %s%.*s\n", L.rank, levelStrings[level], (i32) shown, record.text);
+    }
 
+    ring->head.store(head+1, std::memory_order_release);
+    if (level < LOG_LEVEL_WARN) flushLogging();
+}
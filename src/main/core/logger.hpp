@@ -2,6 +2,8 @@
 
 #include "definesStandard.hpp"
 
+#include <atomic>
+
 /** Enable logging of warning statements */
 #define LOG_WARN_ENABLED  1
 /** Enable logging of info statements */
@@ -18,6 +20,11 @@
     #define LOG_TRACE_ENABLED 1
 #endif
 
+/** Characters per log message, longer messages are truncated */
+#define LOG_RECORD_LENGTH 480
+/** Messages buffered per logging thread before it waits for the drain thread */
+#define LOG_RING_RECORDS  1024
+
 /* list of logging flags (with an equivalant numeric value) */
 typedef enum logLevel{
     LOG_LEVEL_FATAL = 0, /**< used for events that cause fatal crash */
@@ -28,10 +35,44 @@ typedef enum logLevel{
     LOG_LEVEL_TRACE = 5, /**< used for tracing events */
 } logLevel;
 
+/** Most verbose level that is logged at runtime, on top of the compile-time LOG_*_ENABLED flags */
+extern std::atomic<i32> logThreshold;
+
+/** Returns TRUE if messages of \p level pass the runtime filter */
+inline b8 logEnabled(logLevel level) { return level <= logThreshold.load(std::memory_order_relaxed); }
+
+/************************************************************************************************************************
+*  @brief   Starts the asynchronous logging of this rank into its own log file.
+* 
+*  @details Every thread formats its messages into its own lock-free ring of LOG_RING_RECORDS messages, tagged with the 
+*           time since this call. A background thread drains the rings into directory/log_r<rank>.txt, prefixing each
+*           message with its time, rank and level. Messages up to \p echoLevel of rank 0 are also echoed to stdout, fatal
+*           and error messages of every rank are written to stderr right away. Until this call, and after 
+*           @ref shutdownLogging, messages are written to stdout synchronously.
+*
+*  @param directory  directory of the log files, created if needed
+*  @param rank       rank of the calling process, used for the file name and the message tags
+*  @param level      most verbose level that is logged, see @ref setLogLevel
+*  @param echoLevel  most verbose level of rank 0 that is echoed to stdout
+* 
+*  @return None
+************************************************************************************************************************/
+void initLogging(const char* directory, i32 rank, logLevel level = LOG_LEVEL_TRACE, logLevel echoLevel = LOG_LEVEL_INFO);
+
+/** Drains all buffered messages and stops the drain thread, called at exit if not called before */
+void shutdownLogging();
+
+/** Waits until all messages logged so far are written */
+void flushLogging();
+
+/** Sets the most verbose level that is logged at runtime, messages above it are dropped before formatting */
+void setLogLevel(logLevel level);
+
 /************************************************************************************************************************
-*  @brief   Writes to the console a log message of \p level severity.
+*  @brief   Logs a message of \p level severity.
 * 
-*  @details A message function purely intended for logging purposes. 
+*  @details A message function purely intended for logging purposes. The message is formatted once, into the ring of
+*           the calling thread, and written by the drain thread (see @ref initLogging).
 * 
 *           Example:
 * 
@@ -89,7 +130,7 @@ void logOutput(logLevel level, const char* message, ... );
  * 
  *  @return None
  ************************************************************************************************************************/ 
-#define WARN_MSG(message, ...)  logOutput(LOG_LEVEL_WARN,  message, ##__VA_ARGS__);
+#define WARN_MSG(message, ...)  { if (logEnabled(LOG_LEVEL_WARN)) logOutput(LOG_LEVEL_WARN,  message, ##__VA_ARGS__); }
 #else
 /** DISABLED --> @ref LOG_WARN_ENABLED is set to 0 */
 #define WARN_MSG(message, ...)
@@ -106,7 +147,7 @@ void logOutput(logLevel level, const char* message, ... );
  * 
  *  @return None
  ************************************************************************************************************************/ 
-#define INFO_MSG(message, ...)  logOutput(LOG_LEVEL_INFO,  message, ##__VA_ARGS__);
+#define INFO_MSG(message, ...)  { if (logEnabled(LOG_LEVEL_INFO)) logOutput(LOG_LEVEL_INFO,  message, ##__VA_ARGS__); }
 #else
 /** DISABLED --> @ref LOG_INFO_ENABLED is set to 0 */
 #define INFO_MSG(message, ...)
@@ -123,7 +164,7 @@ void logOutput(logLevel level, const char* message, ... );
  * 
  *  @return None
  ************************************************************************************************************************/ 
-#define DEBUG_MSG(message, ...) logOutput(LOG_LEVEL_DEBUG, message, ##__VA_ARGS__);
+#define DEBUG_MSG(message, ...) { if (logEnabled(LOG_LEVEL_DEBUG)) logOutput(LOG_LEVEL_DEBUG, message, ##__VA_ARGS__); }
 #else
 /** DISABLED --> @ref LOG_DEBUG_ENABLED is set to 0 */
 #define DEBUG_MSG(message, ...)
@@ -140,7 +181,7 @@ void logOutput(logLevel level, const char* message, ... );
  * 
  *  @return None
  ************************************************************************************************************************/ 
-#define TRACE_MSG(message, ...) logOutput(LOG_LEVEL_TRACE, message, ##__VA_ARGS__);
+#define TRACE_MSG(message, ...) { if (logEnabled(LOG_LEVEL_TRACE)) logOutput(LOG_LEVEL_TRACE, message, ##__VA_ARGS__); }
 #else
 /** DISABLED --> @ref LOG_TRACE_ENABLED is set to 0 */
 #define TRACE_MSG(message, ...)
@@ -0,0 +1,235 @@
+#include "profiler.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdio.h>
+
+// ------------------------ //
+// Registry                 //
+// ------------------------ //
+
+/**< Time spent in a region by one thread */
+struct ProfileStats{
+    u64 calls = 0;
+    f64 total = 0.;                                     /**< Seconds */
+};
+
+/**< Complete region of the trace, in microseconds since the time origin */
+struct ProfileEvent{
+    u32 id;
+    f64 start, duration;
+};
+
+/**< Regions recorded by one thread, only written by that thread */
+struct ProfileThread{
+    u32 index;                                          /**< Track of the thread in the trace */
+    std::vector<ProfileStats> stats;                    /**< Per region id */
+    std::vector<ProfileEvent> events;
+    u64 nDropped = 0;                                   /**< Events beyond PROFILE_TRACE_EVENTS */
+};
+
+/**< State of the profiling, never freed so that regions can still close during exit */
+struct Profiler{
+    std::mutex mutex;                                   /**< Guards names, ids and threads */
+    std::vector<std::string> names;
+    std::unordered_map<std::string, u32> ids;
+    std::vector<std::unique_ptr<ProfileThread>> threads;
+
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::atomic<b8> isTracing{FALSE};
+    std::string traceDirectory;
+    MPI_Comm comm = MPI_COMM_WORLD;
+};
+
+static Profiler& profiler() {
+
+    static Profiler* instance = new Profiler;
+    return *instance;
+}
+
+static thread_local ProfileThread* profileThread = nullptr;
+
+static ProfileThread& threadRecord() {
+
+    if (profileThread) return *profileThread;
+
+    Profiler& P = profiler();
+    std::lock_guard<std::mutex> lock(P.mutex);
+    P.threads.push_back(std::make_unique<ProfileThread>());
+    profileThread = P.threads.back().get();
+    profileThread->index = (u32) P.threads.size()-1;
+    return *profileThread;
+}
+
+u32 profileRegion(const char* name) {
+
+    Profiler& P = profiler();
+    std::lock_guard<std::mutex> lock(P.mutex);
+    auto found = P.ids.find(name);
+    if (found != P.ids.end()) return found->second;
+
+    const u32 id = (u32) P.names.size();
+    P.names.push_back(name);
+    P.ids.emplace(name, id);
+    return id;
+}
+
+ProfileScope::~ProfileScope() {
+
+    const std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+    ProfileThread& T = threadRecord();
+    if (T.stats.size() <= id) T.stats.resize(id+1);
+
+    ProfileStats& stats = T.stats[id];
+    stats.calls++;
+    stats.total += std::chrono::duration<f64>(stop - start).count();
+
+    Profiler& P = profiler();
+    if (P.isTracing.load(std::memory_order_relaxed)) {
+        if (T.events.size() < PROFILE_TRACE_EVENTS) {
+            T.events.push_back({id, std::chrono::duration<f64, std::micro>(start - P.origin).count(),
+                                    std::chrono::duration<f64, std::micro>(stop - start).count()});
+        } else {
+            T.nDropped++;
+        }
+    }
+}
+
+// ------------------------ //
+// Interface                //
+// ------------------------ //
+
+void initProfiling(MPI_Comm comm, const char* traceDirectory) {
+
+    Profiler& P = profiler();
+    P.comm = comm;
+    P.traceDirectory = traceDirectory ? traceDirectory : "";
+
+    MPI_Barrier(comm);
+    P.origin = std::chrono::steady_clock::now();
+    P.isTracing.store(traceDirectory != nullptr && PROFILE_ENABLED);
+}
+
+/**< Writes the trace-event file of this rank */
+static void writeTrace(Profiler& P, i32 rankid) {
+
+    std::error_code error;
+    std::filesystem::create_directories(P.traceDirectory, error);
+    const std::string fileName = P.traceDirectory + "/trace_r" + std::to_string(rankid) + ".json";
+    FILE* file = fopen(fileName.c_str(), "w");
+    if (!file) {
+        WARN_MSG("finalizeProfiling : could not open the trace file %s", fileName.c_str())
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}}", rankid, rankid);
+    u64 nDropped = 0;
+    for (const std::unique_ptr<ProfileThread>& T : P.threads) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                rankid, T->index, T->index);
+        for (const ProfileEvent& event : T->events) {
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    P.names[event.id].c_str(), rankid, T->index, event.start, event.duration);
+        }
+        nDropped += T->nDropped;
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    if (nDropped > 0) WARN_MSG("finalizeProfiling : %llu trace events dropped on rank %d, the summary includes them", nDropped, rankid)
+}
+
+void finalizeProfiling() {
+
+    Profiler& P = profiler();
+    std::lock_guard<std::mutex> lock(P.mutex);
+    i32 rankid, nprocs;
+    MPI_Comm_rank(P.comm, &rankid);
+    MPI_Comm_size(P.comm, &nprocs);
+
+    // ------------------------ //
+    // Union of region names    //
+    // ------------------------ //
+    // Regions are numbered in order of first use, which differs between ranks, so the names are matched instead
+    std::string local;
+    for (u32 id=0; id<P.names.size(); id++) {
+        b8 isUsed = FALSE;
+        for (const std::unique_ptr<ProfileThread>& T : P.threads) isUsed |= id < T->stats.size() && T->stats[id].calls > 0;
+        if (isUsed) local.append(P.names[id]).push_back('\0');
+    }
+
+    i32 localBytes = (i32) local.size();
+    std::vector<i32> bytes(rankid == 0 ? nprocs : 0), displs(rankid == 0 ? nprocs : 0);
+    MPI_Gather(&localBytes, 1, MPI_INT, bytes.data(), 1, MPI_INT, 0, P.comm);
+    std::string all;
+    if (rankid == 0) {
+        std::exclusive_scan(bytes.begin(), bytes.end(), displs.begin(), 0);
+        all.resize(displs.back() + bytes.back());
+    }
+    MPI_Gatherv(local.data(), localBytes, MPI_CHAR, all.data(), bytes.data(), displs.data(), MPI_CHAR, 0, P.comm);
+
+    std::string joined;
+    if (rankid == 0) {
+        std::set<std::string> unique;
+        for (u64 begin=0; begin<all.size(); ) {
+            std::string name(all.c_str() + begin);
+            begin += name.size()+1;
+            unique.insert(std::move(name));
+        }
+        for (const std::string& name : unique) joined.append(name).push_back('\0');
+    }
+    i32 joinedBytes = (i32) joined.size();
+    MPI_Bcast(&joinedBytes, 1, MPI_INT, 0, P.comm);
+    joined.resize(joinedBytes);
+    MPI_Bcast(joined.data(), joinedBytes, MPI_CHAR, 0, P.comm);
+
+    std::vector<std::string> regions;
+    for (u64 begin=0; begin<joined.size(); begin += regions.back().size()+1) regions.push_back(joined.c_str() + begin);
+    const u64 nRegions = regions.size();
+
+    // ------------------------ //
+    // Reduce over ranks        //
+    // ------------------------ //
+    // A rank spends the largest per-thread time in a region, a rank that never entered it spends none
+    std::vector<f64> time(nRegions, 0.), timeMin(nRegions), timeMax(nRegions), timeSum(nRegions);
+    std::vector<u64> calls(nRegions, 0), callsSum(nRegions);
+    for (u64 r=0; r<nRegions; r++) {
+        auto found = P.ids.find(regions[r]);
+        if (found == P.ids.end()) continue;
+        for (const std::unique_ptr<ProfileThread>& T : P.threads) {
+            if (found->second >= T->stats.size()) continue;
+            time[r]   = std::max(time[r], T->stats[found->second].total);
+            calls[r] += T->stats[found->second].calls;
+        }
+    }
+    MPI_Reduce(time.data(),  timeMin.data(),  (i32) nRegions, MPI_DOUBLE,             MPI_MIN, 0, P.comm);
+    MPI_Reduce(time.data(),  timeMax.data(),  (i32) nRegions, MPI_DOUBLE,             MPI_MAX, 0, P.comm);
+    MPI_Reduce(time.data(),  timeSum.data(),  (i32) nRegions, MPI_DOUBLE,             MPI_SUM, 0, P.comm);
+    MPI_Reduce(calls.data(), callsSum.data(), (i32) nRegions, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, P.comm);
+
+    if (rankid == 0 && nRegions > 0) {
+        std::vector<u64> order(nRegions);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](u64 a, u64 b) { return timeMax[a] > timeMax[b]; });
+
+        INFO_MSG("Profile over %d ranks (seconds per rank, the largest per-thread time):", nprocs)
+        INFO_MSG("%-40s %12s %12s %12s %12s %9s", "region", "calls", "min", "avg", "max", "max/avg")
+        for (u64 r : order) {
+            const f64 timeAvg = timeSum[r]/nprocs;
+            INFO_MSG("%-40s %12llu %12.6f %12.6f %12.6f %9.3f", regions[r].c_str(), callsSum[r], timeMin[r], timeAvg,
+                     timeMax[r], timeAvg > 0. ? timeMax[r]/timeAvg : 1.)
+        }
+    }
+
+    if (P.isTracing.exchange(FALSE)) writeTrace(P, rankid);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "definesStandard.hpp"
+
+#include <mpi.h>
+#include <chrono>
+
+#ifndef PROFILE
+    #if RELEASE == 1
+        /** DISABLED --> RELEASE flag has been enabled, build with PROFILE=1 to keep the profiling regions */
+        #define PROFILE_ENABLED 0
+    #else
+        /** Enable the profiling regions */
+        #define PROFILE_ENABLED 1
+    #endif
+#else
+    /** Profiling regions explicitly enabled (PROFILE=1) or disabled (PROFILE=0) */
+    #define PROFILE_ENABLED PROFILE
+#endif
+
+/** Trace events kept per thread, later events are only counted in the summary */
+#define PROFILE_TRACE_EVENTS 1048576
+
+/************************************************************************************************************************
+*  @brief   Starts the profiling of this rank, collective over \p comm.
+*
+*  @details Regions entered before this call are timed as well, but the time origin of the trace is taken here, right
+*           after a barrier, so that the traces of all ranks line up. Regions are only recorded with PROFILE_ENABLED.
+*
+*  @param comm            communicator of the run, used by @ref finalizeProfiling
+*  @param traceDirectory  directory of the Chrome trace-event files trace_r<rank>.json (created if needed), nullptr to
+*                         only collect the summary
+*
+*  @return None
+************************************************************************************************************************/
+void initProfiling(MPI_Comm comm, const char* traceDirectory = nullptr);
+
+/************************************************************************************************************************
+*  @brief   Reports the profiling regions and writes the trace of this rank, collective over the profiling communicator.
+*
+*  @details Rank 0 logs, per region, the calls and the min/avg/max over the ranks of the time spent in it (the largest
+*           per-thread time on each rank), together with the max/avg imbalance. The trace files can be opened in
+*           chrome://tracing or ui.perfetto.dev, with one process per rank and one track per thread.
+*
+*  @return None
+************************************************************************************************************************/
+void finalizeProfiling();
+
+/** Returns the id of the region called name, registered on first use */
+u32 profileRegion(const char* name);
+
+/************************************************************************************************************************
+*  @brief   Times the enclosing scope as region \p id, see @ref PROFILE_SCOPE.
+************************************************************************************************************************/
+class ProfileScope {
+
+    public:
+
+        explicit ProfileScope(u32 id_) : id(id_), start(std::chrono::steady_clock::now()) {}
+        ~ProfileScope();
+
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator =(const ProfileScope&) = delete;
+
+    private:
+
+        u32 id;
+        std::chrono::steady_clock::time_point start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#if PROFILE_ENABLED == 1
+/************************************************************************************************************************
+ *  @brief Times the rest of the enclosing scope as profiling region \p name. The name is looked up once per call site,
+ *  entering the region costs two clock reads.
+ *
+ *  @param name a string literal, e.g. "Integrator.assemble"
+ ************************************************************************************************************************/
+#define PROFILE_SCOPE(name)                                                                                            \
+    static const u32 PROFILE_CONCAT(profileId_, __LINE__) = profileRegion(name);                                       \
+    ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(PROFILE_CONCAT(profileId_, __LINE__));
+#else
+/** DISABLED --> PROFILE_ENABLED is 0 */
+#define PROFILE_SCOPE(name)
+#endif
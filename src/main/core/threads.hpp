@@ -0,0 +1,52 @@
+#pragma once
+
+#include "definesStandard.hpp"
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+/************************************************************************************************************************ 
+ *  @brief Returns the id of the calling thread within the current parallel region, 0 outside of one.
+ ************************************************************************************************************************/ 
+inline i32 threadId() {
+    #ifdef _OPENMP
+        return omp_get_thread_num();
+    #else
+        return 0;
+    #endif
+}
+
+/************************************************************************************************************************ 
+ *  @brief Returns the number of threads used by the next parallel region.
+ * 
+ *  @details
+ *  Defaults to OMP_NUM_THREADS (or the number of cores) and can be changed with @ref setThreadCount. Always 1 when 
+ *  compiled without OpenMP.
+ ************************************************************************************************************************/ 
+inline i32 threadCount() {
+    #ifdef _OPENMP
+        return omp_get_max_threads();
+    #else
+        return 1;
+    #endif
+}
+
+/************************************************************************************************************************ 
+ *  @brief Sets the number of threads of all following parallel regions of this rank.
+ * 
+ *  @details
+ *  Element data is first-touched by the threads that later work on it, so the thread count should be set before the
+ *  geometry metrics and integrators are built.
+ * 
+ *  @param nThreads   Number of threads, must be bigger than 0.
+ * 
+ *  @return None
+ ************************************************************************************************************************/ 
+inline void setThreadCount(i32 nThreads) {
+    #ifdef _OPENMP
+        omp_set_num_threads(nThreads);
+    #else
+        (void) nThreads;
+    #endif
+}
@@ -0,0 +1,419 @@
+#include "CoreIncludes.hpp"
+#include "restart.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace IO {
+
+// ---------------- //
+// RestartWriter    //
+// ---------------- //
+
+RestartWriter::RestartWriter(const std::string& prefix, MPI_Comm comm_, const Mesh::Geometry& geometry)
+    : comm(comm_), offset(0), revision(geometry.revision), isOpen(FALSE) {
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, RestartHeader::magicString, sizeof(header.magic));
+    header.version = RestartHeader::currentVersion;
+    MPI_Comm_rank(comm, &header.rank);
+    MPI_Comm_size(comm, &header.nRanks);
+    for (u8 axis=0; axis<3; axis++) {
+        header.procDims[axis]   = geometry.procDims[axis];
+        header.procCoords[axis] = geometry.procCoords[axis];
+    }
+
+    // The header is rewritten with the section table on close
+    fileName = restartFile(prefix, header.rank);
+    file.open(fileName + ".tmp", std::ios::out | std::ios::binary | std::ios::trunc);
+    CHECK_FATAL_ASSERT(file.is_open(), "Could not open the restart file for writing")
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    offset  = sizeof(header);
+    isOpen  = TRUE;
+
+    // ------------------------ //
+    // Geometry                 //
+    // ------------------------ //
+    const Mesh::MasterElement& master = geometry.MasterElement;
+    RestartGeometry G = {};
+    G.nDims        = geometry.nDims;
+    G.isDecomposed = (geometry.comm != MPI_COMM_SELF) ? 1 : 0;
+    G.isCartesian  = geometry.isCartesian ? 1 : 0;
+    G.nVars        = master.nVars;
+    G.nQuad        = geometry.nQuad;
+    G.revision     = geometry.revision;
+    G.metricRows   = geometry.metrics.rows();
+    G.metricCols   = geometry.metrics.cols();
+    addSection("geometry", &G, sizeof(G));
+    for (u8 axis=0; axis<geometry.nDims; axis++) {
+        addSection("geometry.xe" + std::to_string(axis), geometry.xe[axis].data(), geometry.xe[axis].size()*sizeof(f64));
+    }
+    if (!geometry.isCartesian) addSection("geometry.metrics", geometry.metrics.data(), geometry.metrics.size()*sizeof(f64));
+
+    // ------------------------ //
+    // Master element           //
+    // ------------------------ //
+    std::vector<u8> orders;
+    for (u8 Var=0; Var<master.nVars; Var++) {
+        for (u8 axis=0; axis<master.nDims; axis++) orders.push_back(master.polyOrders[Var][axis]);
+    }
+    addSection("master.orders", orders.data(), orders.size());
+    for (u8 Var=0; Var<master.nVars; Var++) {
+        for (u8 axis=0; axis<master.nDims; axis++) {
+            const std::string base = "master" + std::to_string(Var) + "." + std::to_string(axis);
+            addSection(base + ".nodes",   master.nodes[Var][axis].data(),       master.nodes[Var][axis].size()*sizeof(f64));
+            addSection(base + ".weights", master.weights[Var][axis].data(),     master.weights[Var][axis].size()*sizeof(f64));
+            addSection(base + ".bary",    master.baryWeights[Var][axis].data(), master.baryWeights[Var][axis].size()*sizeof(f64));
+            addSection(base + ".D",       master.d1lagrange[Var][axis].data(),  master.d1lagrange[Var][axis].size()*sizeof(f64));
+        }
+    }
+}
+
+RestartWriter::~RestartWriter() {
+
+    if (isOpen) close();
+}
+
+std::string RestartWriter::restartFile(const std::string& prefix, i32 rank) {
+
+    return prefix + "_r" + std::to_string(rank) + ".rst";
+}
+
+void RestartWriter::addSection(const std::string& name, const void* data, u64 bytes) {
+
+    CHECK_FATAL_ASSERT(isOpen, "Section added to a closed restart file")
+    CHECK_FATAL_ASSERT(name.size() < sizeof(RestartSection::name), "Restart section name too long")
+
+    static const char zeros[64] = {};
+    const u64 start = ((offset + 63)/64)*64;
+    file.write(zeros, (std::streamsize) (start - offset));
+    file.write(reinterpret_cast<const char*>(data), (std::streamsize) bytes);
+    offset = start + bytes;
+
+    RestartSection entry = {};
+    std::memcpy(entry.name, name.data(), name.size());
+    entry.offset = start;
+    entry.bytes  = bytes;
+    sections.push_back(entry);
+}
+
+void RestartWriter::add(const std::string& name, const EigenDefs::Vector<f64>& v) {
+
+    addSection("vector." + name, v.data(), v.size()*sizeof(f64));
+}
+
+void RestartWriter::add(const Physics::Integrator& integrator) {
+
+    const f64 coeffs[2] = {integrator.massCoeff, integrator.diffCoeff};
+    addSection("integrator", coeffs, sizeof(coeffs));
+
+    // Factors of older metrics would be rebuilt anyway
+    for (u8 Var=0; Var<integrator.nVars; Var++) {
+        const Physics::Integrator::FastDiagonalization& F = integrator.fdm[Var];
+        if (!F.isSet || F.revision != revision) continue;
+
+        const std::string base = "fdm" + std::to_string(Var);
+        RestartFastDiagonalization R = {};
+        R.massCoeff  = F.massCoeff;
+        R.diffCoeff  = F.diffCoeff;
+        R.revision   = F.revision;
+        for (u8 axis=0; axis<3; axis++) {
+            R.n[axis]     = F.n[axis];
+            R.vRows[axis] = F.V[axis].rows();
+            R.vCols[axis] = F.V[axis].cols();
+        }
+        R.nInterface = F.interfaceNodes.size();
+        addSection(base, &R, sizeof(R));
+        for (u8 axis=0; axis<3; axis++) addSection(base + ".V" + std::to_string(axis), F.V[axis].data(), F.V[axis].size()*sizeof(f64));
+        addSection(base + ".invLambda",        F.invLambda.data(),        F.invLambda.size()*sizeof(f64));
+        addSection(base + ".interfaceNodes",   F.interfaceNodes.data(),   F.interfaceNodes.size()*sizeof(u64));
+        addSection(base + ".interfaceInvDiag", F.interfaceInvDiag.data(), F.interfaceInvDiag.size()*sizeof(f64));
+    }
+}
+
+void RestartWriter::add(const Physics::Transient& transient, const Physics::TransientState& state) {
+
+    RestartTransient T = {};
+    T.Var            = transient.Var;
+    T.scheme         = transient.scheme;
+    T.dt             = transient.dt;
+    T.diffusivity    = transient.diffusivity;
+    T.step           = state.step;
+    T.preconditioner = transient.preconditioner;
+    T.precondOperator = transient.active;
+    const Physics::Transient::StepOperator& S = transient.operators[transient.active];
+    const b8 current = S.precondRevision == revision && transient.massRevision == revision;
+    T.precondMass    = current ? S.precondMass : -1.;
+    T.precondDiff    = current ? S.precondDiff : -1.;
+    addSection("transient", &T, sizeof(T));
+    addSection("transient.u",      state.u.data(),          state.u.size()*sizeof(f64));
+    addSection("transient.uPrev",  state.uPrev.data(),      state.uPrev.size()*sizeof(f64));
+    addSection("transient.mass",   transient.mass.data(),   transient.mass.size()*sizeof(f64));
+    addSection("transient.source", transient.source.data(), transient.source.size()*sizeof(f64));
+}
+
+void RestartWriter::close() {
+
+    PROFILE_SCOPE("RestartWriter.close")
+
+    CHECK_FATAL_ASSERT(isOpen, "Restart file closed twice")
+
+    // ------------------------ //
+    // Section table            //
+    // ------------------------ //
+    header.nSections   = (u32) sections.size();
+    header.tableOffset = ((offset + 63)/64)*64;
+    static const char zeros[64] = {};
+    file.write(zeros, (std::streamsize) (header.tableOffset - offset));
+    file.write(reinterpret_cast<const char*>(sections.data()), (std::streamsize) (sections.size()*sizeof(RestartSection)));
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+    CHECK_FATAL_ASSERT(!file.fail(), "Could not write the restart file")
+    isOpen = FALSE;
+
+    // Replacing the old restart only now keeps it valid if the job is killed while writing
+    std::filesystem::rename(fileName + ".tmp", fileName);
+    MPI_Barrier(comm);
+    INFO_MSG("RestartWriter.close : %u sections (%.1f MB) written to %s", header.nSections,
+             (f64) (header.tableOffset + sections.size()*sizeof(RestartSection))/1.e6, fileName.c_str())
+}
+
+// ---------------- //
+// RestartReader    //
+// ---------------- //
+
+RestartReader::RestartReader(const std::string& prefix, MPI_Comm comm_) : comm(comm_), mapped(nullptr), mappedBytes(0) {
+
+    i32 rank, nRanks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nRanks);
+    fileName = RestartWriter::restartFile(prefix, rank);
+
+    const i32 fd = open(fileName.c_str(), O_RDONLY);
+    CHECK_FATAL_ASSERT(fd >= 0, "Could not open the restart file for reading")
+    struct stat info;
+    fstat(fd, &info);
+    mappedBytes = (u64) info.st_size;
+    CHECK_FATAL_ASSERT(mappedBytes >= sizeof(RestartHeader), "Restart file is truncated")
+    void* map = mmap(nullptr, mappedBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    CHECK_FATAL_ASSERT(map != MAP_FAILED, "Could not map the restart file")
+    mapped = static_cast<const char*>(map);
+
+    header   = reinterpret_cast<const RestartHeader*>(mapped);
+    CHECK_FATAL_ASSERT(std::memcmp(header->magic, RestartHeader::magicString, sizeof(header->magic)) == 0, "Not a restart file")
+    CHECK_FATAL_ASSERT(header->version == RestartHeader::currentVersion, "Unsupported restart file version")
+    CHECK_FATAL_ASSERT(header->rank == rank && header->nRanks == nRanks, "Restart was written by a different number of ranks")
+    CHECK_FATAL_ASSERT(header->tableOffset + header->nSections*sizeof(RestartSection) <= mappedBytes, "Restart file is truncated")
+    sections = reinterpret_cast<const RestartSection*>(mapped + header->tableOffset);
+    TRACE_MSG("RestartReader : %u sections mapped from %s", header->nSections, fileName.c_str())
+}
+
+RestartReader::~RestartReader() {
+
+    if (mapped) munmap(const_cast<char*>(mapped), mappedBytes);
+}
+
+const RestartSection* RestartReader::find(const std::string& name) const {
+
+    for (u32 s=0; s<header->nSections; s++) {
+        if (std::strncmp(sections[s].name, name.c_str(), sizeof(RestartSection::name)) == 0) return &sections[s];
+    }
+    return nullptr;
+}
+
+const char* RestartReader::section(const std::string& name, u64 bytes) const {
+
+    const RestartSection* entry = find(name);
+    CHECK_FATAL_ASSERT(entry != nullptr, "Restart file lacks a requested section")
+    CHECK_FATAL_ASSERT(entry->bytes == bytes, "Restart section does not match the size of the restored object")
+    CHECK_FATAL_ASSERT(entry->offset + entry->bytes <= mappedBytes, "Restart file is truncated")
+    return mapped + entry->offset;
+}
+
+template<typename T> u64 RestartReader::count(const std::string& name) const {
+
+    const RestartSection* entry = find(name);
+    CHECK_FATAL_ASSERT(entry != nullptr, "Restart file lacks a requested section")
+    return entry->bytes/sizeof(T);
+}
+
+std::unique_ptr<Mesh::Geometry> RestartReader::geometry() const {
+
+    PROFILE_SCOPE("RestartReader.geometry")
+
+    const RestartGeometry& G = *reinterpret_cast<const RestartGeometry*>(section("geometry", sizeof(RestartGeometry)));
+
+    // ------------------------ //
+    // Grid and decomposition   //
+    // ------------------------ //
+    std::vector<EigenDefs::Array1D<f64>> xe(G.nDims);
+    for (u8 axis=0; axis<G.nDims; axis++) {
+        const std::string name = "xe" + std::to_string(axis);
+        const u64 n = count<f64>("geometry." + name);
+        xe[axis] = Eigen::Map<const EigenDefs::Array1D<f64>>(reinterpret_cast<const f64*>(section("geometry." + name, n*sizeof(f64))), n);
+    }
+    std::unique_ptr<Mesh::Geometry> geometry;
+    if      (G.nDims == 1) geometry = std::make_unique<Mesh::Geometry>(std::move(xe[0]));
+    else if (G.nDims == 2) geometry = std::make_unique<Mesh::Geometry>(std::move(xe[0]), std::move(xe[1]));
+    else                   geometry = std::make_unique<Mesh::Geometry>(std::move(xe[0]), std::move(xe[1]), std::move(xe[2]));
+
+    if (G.isDecomposed) geometry->decompose(comm);
+    for (u8 axis=0; axis<3; axis++) {
+        CHECK_FATAL_ASSERT(geometry->procDims[axis] == header->procDims[axis] && geometry->procCoords[axis] == header->procCoords[axis],
+                           "Restart was written with a different decomposition")
+    }
+
+    // ------------------------ //
+    // Metrics                  //
+    // ------------------------ //
+    // Copied by the threads that work on each element, as in setMetrics
+    if (!G.isCartesian) {
+        const f64* in = reinterpret_cast<const f64*>(section("geometry.metrics", G.metricRows*G.metricCols*sizeof(f64)));
+        Mesh::Geometry& geom = *geometry;
+        geom.nQuad = G.nQuad;
+        geom.metrics.resize(G.metricRows, G.metricCols);
+        #pragma omp parallel
+        {
+            for (const std::vector<std::vector<u64>>* colors : {&geom.interfaceColors, &geom.interiorColors}) {
+                for (const std::vector<u64>& elems : *colors) {
+                    #pragma omp for schedule(static)
+                    for (u64 n=0; n<elems.size(); n++) {
+                        for (u64 term=0; term<G.metricCols; term++) {
+                            for (u64 row=elems[n]*G.nQuad; row<(elems[n]+1)*G.nQuad; row++) {
+                                geom.metrics(row, term) = in[row + G.metricRows*term];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        geom.isCartesian = FALSE;
+    }
+    geometry->revision = G.revision;
+
+    // ------------------------ //
+    // Master element           //
+    // ------------------------ //
+    Mesh::MasterElement& master = geometry->MasterElement;
+    if (G.nVars > 0) master.setnVars((u8) G.nVars);
+    const u8* orders = reinterpret_cast<const u8*>(section("master.orders", G.nVars*G.nDims));
+    for (u8 Var=0; Var<G.nVars; Var++) {
+        for (u8 axis=0; axis<G.nDims; axis++) {
+            const u64 n = orders[Var*G.nDims + axis] + 1;
+            const std::string base = "master" + std::to_string(Var) + "." + std::to_string(axis);
+            master.polyOrders[Var][axis]  = orders[Var*G.nDims + axis];
+            master.nodes[Var][axis]       = Eigen::Map<const EigenDefs::Array1D<f64>>(reinterpret_cast<const f64*>(section(base + ".nodes",   n*sizeof(f64))), n);
+            master.weights[Var][axis]     = Eigen::Map<const EigenDefs::Array1D<f64>>(reinterpret_cast<const f64*>(section(base + ".weights", n*sizeof(f64))), n);
+            master.baryWeights[Var][axis] = Eigen::Map<const EigenDefs::Array1D<f64>>(reinterpret_cast<const f64*>(section(base + ".bary",    n*sizeof(f64))), n);
+            master.d1lagrange[Var][axis]  = Eigen::Map<const EigenDefs::Matrix<f64>>(reinterpret_cast<const f64*>(section(base + ".D",      n*n*sizeof(f64))), n, n);
+        }
+    }
+
+    INFO_MSG("RestartReader.geometry : %uD geometry with %u variables restored from %s", G.nDims, G.nVars, fileName.c_str())
+    return geometry;
+}
+
+b8 RestartReader::hasVector(const std::string& name) const {
+
+    return find("vector." + name) != nullptr;
+}
+
+void RestartReader::vector(const std::string& name, EigenDefs::Vector<f64>& v) const {
+
+    const u64 n = count<f64>("vector." + name);
+    v = Eigen::Map<const EigenDefs::Vector<f64>>(reinterpret_cast<const f64*>(section("vector." + name, n*sizeof(f64))), n);
+}
+
+void RestartReader::restore(Physics::Integrator& integrator) const {
+
+    PROFILE_SCOPE("RestartReader.restore")
+
+    const f64* coeffs = reinterpret_cast<const f64*>(section("integrator", 2*sizeof(f64)));
+    integrator.setHeatCoefficients(coeffs[0], coeffs[1]);
+
+    for (u8 Var=0; Var<integrator.nVars; Var++) {
+        const std::string base = "fdm" + std::to_string(Var);
+        if (!find(base)) continue;
+
+        const RestartFastDiagonalization& R = *reinterpret_cast<const RestartFastDiagonalization*>(section(base, sizeof(RestartFastDiagonalization)));
+        CHECK_FATAL_ASSERT(R.revision == integrator.geometry.revision, "Fast diagonalization restored onto another geometry")
+        Physics::Integrator::FastDiagonalization& F = integrator.fdm[Var];
+        const u64 nInner = R.n[0]*R.n[1]*R.n[2];
+        F.V.resize(3);
+        F.Vt.resize(3);
+        for (u8 axis=0; axis<3; axis++) {
+            const u64 size = R.vRows[axis]*R.vCols[axis];
+            const f64* V   = reinterpret_cast<const f64*>(section(base + ".V" + std::to_string(axis), size*sizeof(f64)));
+            F.V[axis]  = Eigen::Map<const EigenDefs::Matrix<f64>>(V, R.vRows[axis], R.vCols[axis]);
+            F.Vt[axis] = F.V[axis].transpose();
+        }
+        F.invLambda        = Eigen::Map<const EigenDefs::Array1D<f64>>(reinterpret_cast<const f64*>(section(base + ".invLambda", nInner*sizeof(f64))), nInner);
+        const u64* nodes   = reinterpret_cast<const u64*>(section(base + ".interfaceNodes", R.nInterface*sizeof(u64)));
+        F.interfaceNodes.assign(nodes, nodes + R.nInterface);
+        F.interfaceInvDiag = Eigen::Map<const EigenDefs::Array1D<f64>>(reinterpret_cast<const f64*>(section(base + ".interfaceInvDiag", R.nInterface*sizeof(f64))), R.nInterface);
+        F.bufA.resize(nInner);
+        F.bufB.resize(nInner);
+        for (u8 axis=0; axis<3; axis++) F.n[axis] = R.n[axis];
+        F.massCoeff = R.massCoeff;
+        F.diffCoeff = R.diffCoeff;
+        F.revision  = R.revision;
+        F.isSet     = TRUE;
+    }
+    TRACE_MSG("RestartReader.restore : integrator caches restored from %s", fileName.c_str())
+}
+
+void RestartReader::restore(Physics::Transient& transient, Physics::PointFunction f, Physics::PointFunction g,
+                            Physics::TransientState& state) const {
+
+    PROFILE_SCOPE("RestartReader.restore")
+
+    const RestartTransient& T = *reinterpret_cast<const RestartTransient*>(section("transient", sizeof(RestartTransient)));
+    CHECK_FATAL_ASSERT(T.Var == transient.Var && T.scheme == (u32) transient.scheme && T.dt == transient.dt && T.diffusivity == transient.diffusivity,
+                       "Transient does not match the one of the restart")
+
+    // ------------------------ //
+    // Problem and history      //
+    // ------------------------ //
+    const u64 n = transient.integrator.nDOFs(transient.Var);
+    const auto block = [&](const std::string& name, EigenDefs::Vector<f64>& v) {
+        const u64 size = count<f64>(name);
+        CHECK_FATAL_ASSERT(size == n || (size == 0 && name == "transient.uPrev"), "Restart vector does not match the number of DOFs")
+        v = Eigen::Map<const EigenDefs::Vector<f64>>(reinterpret_cast<const f64*>(section(name, size*sizeof(f64))), size);
+    };
+    block("transient.mass",   transient.mass);
+    block("transient.source", transient.source);
+    transient.f            = f;
+    transient.g            = g;
+    transient.hasProblem   = TRUE;
+    transient.massRevision = transient.integrator.geometry.revision;
+
+    state.step = T.step;
+    block("transient.u",     state.u);
+    block("transient.uPrev", state.uPrev);
+
+    // ------------------------ //
+    // Preconditioner           //
+    // ------------------------ //
+    // The fast diagonalization is kept if the integrator got it back for the heat coefficients of the last step, the
+    // parked preconditioner of the other step operator is not written and gets rebuilt on its first use
+    transient.invalidateOperators();
+    const Physics::Integrator::FastDiagonalization& F = transient.integrator.fdm[transient.Var];
+    if (transient.preconditioner == Physics::TRANSIENT_PRECOND_FDM && T.preconditioner == Physics::TRANSIENT_PRECOND_FDM &&
+        T.precondOperator < 2 && F.isSet && F.massCoeff == T.precondMass && F.diffCoeff == T.precondDiff &&
+        F.revision == transient.massRevision) {
+        transient.active = (u8) T.precondOperator;
+        Physics::Transient::StepOperator& S = transient.operators[transient.active];
+        S.precondMass     = T.precondMass;
+        S.precondDiff     = T.precondDiff;
+        S.precondRevision = F.revision;
+    }
+    INFO_MSG("RestartReader.restore : transient restored at step %llu from %s", state.step, fileName.c_str())
+}
+
+} // end IO
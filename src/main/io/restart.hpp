@@ -0,0 +1,240 @@
+#pragma once
+
+#include "CoreIncludes.hpp"
+#include "mesh.hpp"
+#include "integrator.hpp"
+#include "transient.hpp"
+
+#include <mpi.h>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace IO {
+
+/************************************************************************************************************************
+ *  @brief Header of a restart file, followed by named raw sections and the section table.
+ *
+ *  @details
+ *  Every section starts at a multiple of 64 bytes and holds native (little-endian) values, so that the whole file can be
+ *  memory-mapped and every array used in place. The table of nSections RestartSection entries starts at tableOffset.
+ ************************************************************************************************************************/
+struct RestartHeader{
+    static constexpr char magicString[8] = {'H','E','A','T','R','S','T','\0'};
+    static constexpr u32  currentVersion = 1;
+
+    char magic[8];                      /**< "HEATRST" */
+    u32  version;                       /**< File format version */
+    u32  nSections;                     /**< Number of entries of the section table */
+    i32  rank, nRanks;                  /**< Rank of the file and number of ranks of the run */
+    i32  procDims[3];                   /**< Blocks per axis of the decomposition */
+    i32  procCoords[3];                 /**< Block coordinates of the rank */
+    u64  tableOffset;                   /**< Byte offset of the section table */
+};
+static_assert(sizeof(RestartHeader) == 56, "Restart file header must not be padded");
+
+/**< Entry of the section table of a restart file */
+struct RestartSection{
+    char name[40];                      /**< Section name (null-padded) */
+    u64  offset;                        /**< Byte offset of the section */
+    u64  bytes;                         /**< Size of the section */
+};
+static_assert(sizeof(RestartSection) == 56, "Restart section entry must not be padded");
+
+/**< Section "geometry", followed by the sections "geometry.xe<axis>" and, for general metrics, "geometry.metrics" */
+struct RestartGeometry{
+    u32 nDims;
+    u32 isDecomposed;                   /**< 1 if the geometry was decomposed over the ranks of the run */
+    u32 isCartesian;
+    u32 nVars;                          /**< Variables of the master element, followed by "master.orders" and the bases */
+    u64 nQuad;
+    u64 revision;
+    u64 metricRows, metricCols;
+};
+
+/**< Section "integrator" and, per variable with a current fast diagonalization, "fdm<Var>" */
+struct RestartFastDiagonalization{
+    f64 massCoeff, diffCoeff;
+    u64 revision;
+    u64 n[3];
+    u64 vRows[3], vCols[3];             /**< Size of the 1D eigenvector matrices "fdm<Var>.V<axis>" */
+    u64 nInterface;
+};
+
+/**< Section "transient", followed by "transient.u", "transient.uPrev", "transient.mass" and "transient.source" */
+struct RestartTransient{
+    u32 Var, scheme;
+    f64 dt, diffusivity;
+    u64 step;
+    u32 preconditioner, precondOperator; /**< precondOperator is the step operator of the preconditioner, see Transient::stepOperator */
+    f64 precondMass, precondDiff;       /**< Heat coefficients of the preconditioner, negative if none */
+};
+
+/************************************************************************************************************************
+ *  @brief Writes the solver state of this rank to its restart file, see RestartReader.
+ *
+ *  @details
+ *  The geometry (element endpoints, metrics and decomposition) and its master element (orders and 1D bases) are written
+ *  on construction, solution vectors, time integrators and the cached fast diagonalizations of integrators are added on
+ *  request. The file is written to a temporary name and only replaces an older restart file on @ref close, so that a job
+ *  killed while writing keeps its previous restart.
+ ************************************************************************************************************************/
+class RestartWriter {
+
+    public:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /************************************************************************************************************************
+         *  @brief Opens the restart file of this rank and writes the geometry.
+         *
+         *  @param prefix     Path prefix of the restart files, see @ref restartFile.
+         *  @param comm_      Communicator of the run, the geometry is decomposed over it (if decomposed).
+         *  @param geometry   Geometry and master element of the run.
+         ************************************************************************************************************************/
+        RestartWriter(const std::string& prefix, MPI_Comm comm_, const Mesh::Geometry& geometry);
+
+        /**< Closes the restart file if still open */
+        ~RestartWriter();
+
+        /**< Disabled construction using another RestartWriter */
+        RestartWriter(const RestartWriter&) = delete;
+
+        /**< Disabled construction by equating to another RestartWriter */
+        RestartWriter& operator =(const RestartWriter&) = delete;
+
+        /**< Adds a block vector under name */
+        void add(const std::string& name, const EigenDefs::Vector<f64>& v);
+
+        /**< Adds the heat coefficients and the current fast diagonalizations of an integrator on the geometry */
+        void add(const Physics::Integrator& integrator);
+
+        /**< Adds a time integrator with its lumped mass, source and forward state (the time stepper history) */
+        void add(const Physics::Transient& transient, const Physics::TransientState& state);
+
+        /**< Writes the section table and replaces the restart file of this rank, collective */
+        void close();
+
+        /**< Returns the restart file of rank of a run */
+        static std::string restartFile(const std::string& prefix, i32 rank);
+
+    private:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /**< Appends a section of bytes at data, aligned to 64 bytes */
+        void addSection(const std::string& name, const void* data, u64 bytes);
+
+        // ---------------- //
+        // member variables //
+        // ---------------- //
+
+        MPI_Comm comm;
+        RestartHeader header;
+        std::string fileName;
+        std::ofstream file;
+        u64 offset;                                     /**< End of the last section */
+        std::vector<RestartSection> sections;
+        u64 revision;                                   /**< Geometry revision, fast diagonalizations of older ones are skipped */
+        b8  isOpen;
+
+};
+
+/************************************************************************************************************************
+ *  @brief Restores the solver state written by RestartWriter, on the same number of ranks and the same decomposition.
+ *
+ *  @details
+ *  The restart file of this rank is memory-mapped and the sections are copied straight into the restored objects: the
+ *  geometry keeps its metrics and revision, the master element its 1D bases, and neither is recomputed. Integrators and
+ *  time integrators are constructed on the restored geometry as usual and then get their caches back, so that the first
+ *  step after a restart does not rebuild the fast diagonalization. The hypre (BoomerAMG) setups and p-multigrid levels
+ *  are not part of the restart and are rebuilt when first used.
+ ************************************************************************************************************************/
+class RestartReader {
+
+    public:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /************************************************************************************************************************
+         *  @brief Maps the restart file of this rank.
+         *
+         *  @param prefix     Path prefix of the restart files, see RestartWriter::restartFile.
+         *  @param comm_      Communicator of the run, must have as many ranks as the one that wrote the restart.
+         ************************************************************************************************************************/
+        RestartReader(const std::string& prefix, MPI_Comm comm_);
+
+        /**< Unmaps the restart file */
+        ~RestartReader();
+
+        /**< Disabled construction using another RestartReader */
+        RestartReader(const RestartReader&) = delete;
+
+        /**< Disabled construction by equating to another RestartReader */
+        RestartReader& operator =(const RestartReader&) = delete;
+
+        /**< Returns the restored geometry and master element, decomposed like the written one, collective if decomposed */
+        std::unique_ptr<Mesh::Geometry> geometry() const;
+
+        /**< Returns TRUE if the restart holds a block vector under name */
+        b8 hasVector(const std::string& name) const;
+
+        /**< Restores the block vector under name */
+        void vector(const std::string& name, EigenDefs::Vector<f64>& v) const;
+
+        /**< Restores the heat coefficients and fast diagonalizations of an integrator on the restored geometry */
+        void restore(Physics::Integrator& integrator) const;
+
+        /************************************************************************************************************************
+         *  @brief Restores a time integrator constructed with the written variable, scheme, time step and diffusivity.
+         *
+         *  @details
+         *  Replaces setProblem, the source integral is restored instead of recomputed. The preconditioner is only kept if
+         *  it is the fast diagonalization of an integrator restored with @ref restore beforehand.
+         *
+         *  @param transient  Time integrator on an integrator of the restored geometry.
+         *  @param f          Source term f(x,y,z) of the written run.
+         *  @param g          Dirichlet boundary value g(x,y,z) of the written run.
+         *  @param state      Output, forward state of the written run.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void restore(Physics::Transient& transient, Physics::PointFunction f, Physics::PointFunction g,
+                     Physics::TransientState& state) const;
+
+    private:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /**< Returns the section of name, nullptr if there is none */
+        const RestartSection* find(const std::string& name) const;
+
+        /**< Returns the mapped bytes of section name, checking that it holds bytes bytes */
+        const char* section(const std::string& name, u64 bytes) const;
+
+        /**< Returns the number of values of type T in section name */
+        template<typename T> u64 count(const std::string& name) const;
+
+        // ---------------- //
+        // member variables //
+        // ---------------- //
+
+        MPI_Comm comm;
+        std::string fileName;
+        const char* mapped;                             /**< Memory-mapped restart file */
+        u64 mappedBytes;
+        const RestartHeader* header;
+        const RestartSection* sections;
+
+};
+
+} // end IO
@@ -0,0 +1,192 @@
+#include "CoreIncludes.hpp"
+#include "snapshotArchive.hpp"
+
+#include <climits>
+#include <cstring>
+
+namespace IO {
+
+SnapshotArchive::SnapshotArchive(Physics::Integrator& integrator_, u8 Var_, const std::string& fileName_,
+                                 const std::vector<SnapshotField>& fields_)
+    : integrator(integrator_), Var(Var_), fileName(fileName_), fields(fields_), isOpen(FALSE), recordType(MPI_DATATYPE_NULL),
+      current(0) {
+
+    CHECK_FATAL_ASSERT(integrator.nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(!fields.empty(), "A snapshot archive requires at least one field")
+    for (const SnapshotField& field : fields) {
+        CHECK_FATAL_ASSERT(field.name.size() < sizeof(SnapshotFieldEntry::name), "Field name too long for the snapshot archive")
+        CHECK_FATAL_ASSERT(field.precision == PRECISION_F32 || field.precision == PRECISION_F64, "Unknown snapshot precision")
+    }
+
+    for (u8 axis=0; axis<3; axis++) nGlobal[axis] = integrator.nGlobal[Var][axis];
+    integrator.ownedBox(Var, integrator.geometry.procCoords, ownStart, ownCount);
+    owned = integrator.ownedBlockNodes(Var);
+    bufferBytes = 0;
+    for (const SnapshotField& field : fields) bufferBytes += owned.size()*(u64) field.precision;
+    CHECK_FATAL_ASSERT(bufferBytes < (u64) INT_MAX, "Owned values of a snapshot exceed the MPI-IO write range")
+    for (u8 axis=0; axis<3; axis++) {
+        CHECK_FATAL_ASSERT(nGlobal[axis]*sizeof(f64) < (u64) INT_MAX, "Global nodes per axis exceed the MPI-IO subarray range")
+    }
+
+    // ------------------------ //
+    // File layout              //
+    // ------------------------ //
+    const u64 nTotal = nGlobal[0]*nGlobal[1]*nGlobal[2];
+    fieldOffset.assign(fields.size()+1, 0);
+    for (u64 f=0; f<fields.size(); f++) fieldOffset[f+1] = fieldOffset[f] + nTotal*(u64) fields[f].precision;
+    recordBytes = ((fieldOffset.back() + 63)/64)*64;
+
+    u64 coordBytes = 0;
+    for (u8 axis=0; axis<integrator.nDims; axis++) coordBytes += nGlobal[axis]*sizeof(f64);
+    const u64 coordOffset = sizeof(SnapshotHeader) + fields.size()*sizeof(SnapshotFieldEntry);
+    dataOffset = ((coordOffset + coordBytes + 63)/64)*64;
+
+    // ------------------------ //
+    // Record file type         //
+    // ------------------------ //
+    // Per field a C-ordered (z, y, x bytes) subarray at its offset in the record, resized so that consecutive records tile
+    std::vector<MPI_Datatype> fieldTypes(fields.size());
+    std::vector<i32>          blockLengths(fields.size(), 1);
+    std::vector<MPI_Aint>     displacements(fields.size());
+    for (u64 f=0; f<fields.size(); f++) {
+        const i32 valueBytes  = (i32) fields[f].precision;
+        const i32 sizes[3]    = {(i32) nGlobal[2],  (i32) nGlobal[1],  (i32) nGlobal[0]*valueBytes};
+        const i32 subsizes[3] = {(i32) ownCount[2], (i32) ownCount[1], (i32) ownCount[0]*valueBytes};
+        const i32 starts[3]   = {(i32) ownStart[2], (i32) ownStart[1], (i32) ownStart[0]*valueBytes};
+        MPI_Type_create_subarray(3, sizes, subsizes, starts, MPI_ORDER_C, MPI_BYTE, &fieldTypes[f]);
+        displacements[f] = (MPI_Aint) fieldOffset[f];
+    }
+    MPI_Datatype fieldsType;
+    MPI_Type_create_struct((i32) fields.size(), blockLengths.data(), displacements.data(), fieldTypes.data(), &fieldsType);
+    MPI_Type_create_resized(fieldsType, 0, (MPI_Aint) recordBytes, &recordType);
+    MPI_Type_commit(&recordType);
+    MPI_Type_free(&fieldsType);
+    for (MPI_Datatype& fieldType : fieldTypes) MPI_Type_free(&fieldType);
+
+    // ------------------------ //
+    // Header                   //
+    // ------------------------ //
+    CHECK_FATAL_ASSERT(MPI_File_open(integrator.comm, fileName.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                                     &file) == MPI_SUCCESS, "Could not create the snapshot archive")
+    MPI_File_set_size(file, 0);
+
+    // The header and coordinates are small, written by rank 0 alone
+    if (integrator.rankid == 0) {
+        std::vector<char> head(dataOffset, '\0');
+        SnapshotHeader header;
+        std::memcpy(header.magic, SnapshotHeader::magicString, sizeof(header.magic));
+        header.version     = SnapshotHeader::currentVersion;
+        header.nDims       = integrator.nDims;
+        header.nFields     = (u32) fields.size();
+        header.padding     = 0;
+        for (u8 axis=0; axis<3; axis++) header.nNodes[axis] = nGlobal[axis];
+        header.dataOffset  = dataOffset;
+        header.recordBytes = recordBytes;
+        std::memcpy(head.data(), &header, sizeof(SnapshotHeader));
+
+        for (u64 f=0; f<fields.size(); f++) {
+            SnapshotFieldEntry entry = {};
+            std::memcpy(entry.name, fields[f].name.data(), fields[f].name.size());
+            entry.valueBytes = (u32) fields[f].precision;
+            std::memcpy(head.data() + sizeof(SnapshotHeader) + f*sizeof(SnapshotFieldEntry), &entry, sizeof(entry));
+        }
+        char* coords = head.data() + coordOffset;
+        for (u8 axis=0; axis<integrator.nDims; axis++) {
+            std::memcpy(coords, integrator.xNodes[Var][axis].data(), nGlobal[axis]*sizeof(f64));
+            coords += nGlobal[axis]*sizeof(f64);
+        }
+        CHECK_FATAL_ASSERT(MPI_File_write_at(file, 0, head.data(), (i32) head.size(), MPI_BYTE, MPI_STATUS_IGNORE) == MPI_SUCCESS,
+                           "Could not write the snapshot archive header")
+    }
+
+    // Offsets within the view count the owned bytes only, snapshot n starts at n*bufferBytes
+    MPI_File_set_view(file, (MPI_Offset) dataOffset, MPI_BYTE, recordType, "native", MPI_INFO_NULL);
+    requests[0] = requests[1] = MPI_REQUEST_NULL;
+    isOpen = TRUE;
+
+    TRACE_MSG("SnapshotArchive : %llu fields of %llu nodes per snapshot, %llu bytes per record", (u64) fields.size(), nTotal,
+              recordBytes)
+}
+
+SnapshotArchive::~SnapshotArchive() {
+
+    if (isOpen) close();
+    if (recordType != MPI_DATATYPE_NULL) MPI_Type_free(&recordType);
+}
+
+void SnapshotArchive::append(u64 step, f64 time, const std::vector<const EigenDefs::Vector<f64>*>& values) {
+
+    PROFILE_SCOPE("SnapshotArchive.append")
+
+    CHECK_FATAL_ASSERT(isOpen, "Snapshot appended to a closed archive")
+    CHECK_FATAL_ASSERT(values.size() == fields.size(), "Every field of the snapshot archive requires exactly one vector")
+    for (const EigenDefs::Vector<f64>* value : values) {
+        CHECK_FATAL_ASSERT((u64) value->size() == integrator.nDOFs(Var), "Snapshot size does not match the block of the variable")
+    }
+
+    // Wait for the write of the snapshot before the last one to release its buffer
+    const u32 b = current;
+    CHECK_FATAL_ASSERT(MPI_Wait(&requests[b], MPI_STATUS_IGNORE) == MPI_SUCCESS, "Could not write to the snapshot archive")
+
+    // ------------------------ //
+    // Copy owned values        //
+    // ------------------------ //
+    const u64 nOwned = owned.size();
+    std::vector<char>& buffer = buffers[b];
+    buffer.resize(bufferBytes);
+    char* out = buffer.data();
+    for (u64 f=0; f<fields.size(); f++) {
+        const f64* value = values[f]->data();
+        if (fields[f].precision == PRECISION_F32) {
+            f32* outF32 = reinterpret_cast<f32*>(out);
+            #pragma omp parallel for schedule(static)
+            for (u64 n=0; n<nOwned; n++) outF32[n] = (f32) value[owned[n]];
+        } else {
+            f64* outF64 = reinterpret_cast<f64*>(out);
+            #pragma omp parallel for schedule(static)
+            for (u64 n=0; n<nOwned; n++) outF64[n] = value[owned[n]];
+        }
+        out += nOwned*(u64) fields[f].precision;
+    }
+
+    CHECK_FATAL_ASSERT(MPI_File_iwrite_at(file, (MPI_Offset) (index.size()*bufferBytes), buffer.data(), (i32) bufferBytes,
+                                          MPI_BYTE, &requests[b]) == MPI_SUCCESS, "Could not write to the snapshot archive")
+    index.push_back({step, time, dataOffset + index.size()*recordBytes});
+    current = 1-b;
+}
+
+void SnapshotArchive::flush() {
+
+    CHECK_FATAL_ASSERT(MPI_Waitall(2, requests, MPI_STATUSES_IGNORE) == MPI_SUCCESS, "Could not write to the snapshot archive")
+}
+
+void SnapshotArchive::close() {
+
+    PROFILE_SCOPE("SnapshotArchive.close")
+
+    CHECK_FATAL_ASSERT(isOpen, "Snapshot archive closed twice")
+    flush();
+
+    // ------------------------ //
+    // Index                    //
+    // ------------------------ //
+    // Every rank appended the same snapshots, rank 0 writes the index behind the last record
+    MPI_File_set_view(file, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+    if (integrator.rankid == 0) {
+        SnapshotFooter footer;
+        footer.nSnapshots  = index.size();
+        footer.indexOffset = dataOffset + index.size()*recordBytes;
+        std::memcpy(footer.magic, SnapshotFooter::magicString, sizeof(footer.magic));
+
+        std::vector<char> tail(index.size()*sizeof(SnapshotEntry) + sizeof(SnapshotFooter));
+        std::memcpy(tail.data(), index.data(), index.size()*sizeof(SnapshotEntry));
+        std::memcpy(tail.data() + index.size()*sizeof(SnapshotEntry), &footer, sizeof(footer));
+        CHECK_FATAL_ASSERT(MPI_File_write_at(file, (MPI_Offset) footer.indexOffset, tail.data(), (i32) tail.size(), MPI_BYTE,
+                                             MPI_STATUS_IGNORE) == MPI_SUCCESS, "Could not write the snapshot archive index")
+    }
+    MPI_File_close(&file);
+    isOpen = FALSE;
+    INFO_MSG("SnapshotArchive.close : %llu snapshots written to %s", (u64) index.size(), fileName.c_str())
+}
+
+} // end IO
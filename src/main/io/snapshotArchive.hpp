@@ -0,0 +1,156 @@
+#pragma once
+
+#include "CoreIncludes.hpp"
+#include "integrator.hpp"
+#include "solutionWriter.hpp"
+
+#include <string>
+#include <vector>
+
+namespace IO {
+
+/************************************************************************************************************************
+ *  @brief Header of a snapshot archive, followed by nFields SnapshotFieldEntry and the f64 global node coordinates.
+ *
+ *  @details
+ *  All integers are little-endian. The coordinates of every used axis (nNodes[axis] values each) follow the field entries,
+ *  the snapshot records start at dataOffset. A record holds every field over all global nodes, x fastest, in the
+ *  precision of its entry, fields one after the other; records are padded to recordBytes, a multiple of 64 bytes. The
+ *  archive ends with the index, nSnapshots SnapshotEntry, and the SnapshotFooter.
+ ************************************************************************************************************************/
+struct SnapshotHeader{
+    static constexpr char magicString[8] = {'H','E','A','T','S','N','P','\0'};
+    static constexpr u32  currentVersion = 1;
+
+    char magic[8];                      /**< "HEATSNP" */
+    u32  version;                       /**< File format version */
+    u32  nDims;                         /**< Number of used axes */
+    u32  nFields;                       /**< Number of fields per snapshot */
+    u32  padding;
+    u64  nNodes[3];                     /**< Global nodes per axis, unused axes are 1 */
+    u64  dataOffset;                    /**< Byte offset of the first snapshot record */
+    u64  recordBytes;                   /**< Bytes per snapshot record */
+};
+static_assert(sizeof(SnapshotHeader) == 64, "Snapshot archive header must not be padded");
+
+/**< Field description of a snapshot archive */
+struct SnapshotFieldEntry{
+    char name[28];                      /**< Field name (null-padded) */
+    u32  valueBytes;                    /**< Bytes per value, 4 (f32) or 8 (f64) */
+};
+static_assert(sizeof(SnapshotFieldEntry) == 32, "Snapshot field entry must not be padded");
+
+/**< Index entry of a snapshot */
+struct SnapshotEntry{
+    u64 step;                           /**< Time step of the snapshot */
+    f64 time;                           /**< Time of the snapshot */
+    u64 offset;                         /**< Byte offset of the snapshot record */
+};
+
+/**< Last bytes of a snapshot archive, locating the index */
+struct SnapshotFooter{
+    static constexpr char magicString[8] = {'H','E','A','T','I','D','X','\0'};
+
+    u64  nSnapshots;                    /**< Number of index entries */
+    u64  indexOffset;                   /**< Byte offset of the first index entry */
+    char magic[8];                      /**< "HEATIDX" */
+};
+
+/**< Field of a snapshot archive and the precision it is stored in */
+struct SnapshotField{
+    std::string name;                                   /**< Field name, at most 27 characters */
+    valuePrecision precision = PRECISION_F32;           /**< Stored precision, f32 suffices for plotting */
+};
+
+/************************************************************************************************************************
+ *  @brief Append-only archive of the snapshots of a time integration, written in the background.
+ *
+ *  @details
+ *  Every rank copies (and downcasts) the nodes it owns of the appended block vectors into one of two buffers and starts a
+ *  nonblocking MPI-IO write of it into the shared archive file, which completes while the time integration continues. The
+ *  file view of each rank tiles its owned boxes over the records, whose offsets are known in advance, so the ranks write
+ *  independently, without any communication. Appending only blocks while both buffers are still being written, i.e. when
+ *  snapshots are produced faster than the file system takes them.
+ *  The index of step -> record offset is written by @ref close, after which any single snapshot can be memory-mapped
+ *  (see src/post/snapshotArchive.py).
+ ************************************************************************************************************************/
+class SnapshotArchive {
+
+    public:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /************************************************************************************************************************
+         *  @brief Creates the archive file, collective over the ranks of the integrator.
+         *
+         *  @param integrator_  Integrator of the block vectors, held by reference and must outlive the archive.
+         *  @param Var_         Variable of the archived block vectors.
+         *  @param fileName_    Name of the archive file, overwritten if it exists.
+         *  @param fields_      Names and stored precisions of the fields of every snapshot.
+         ************************************************************************************************************************/
+        SnapshotArchive(Physics::Integrator& integrator_, u8 Var_, const std::string& fileName_,
+                        const std::vector<SnapshotField>& fields_);
+
+        /**< Closes the archive if still open */
+        ~SnapshotArchive();
+
+        /**< Disabled construction using another SnapshotArchive */
+        SnapshotArchive(const SnapshotArchive&) = delete;
+
+        /**< Disabled construction by equating to another SnapshotArchive */
+        SnapshotArchive& operator =(const SnapshotArchive&) = delete;
+
+        /************************************************************************************************************************
+         *  @brief Appends a snapshot, returning as soon as the owned values are copied.
+         *
+         *  @details
+         *  Must be called by all ranks with the same steps in the same order. The block vectors may be changed right after.
+         *
+         *  @param step       Time step of the snapshot.
+         *  @param time       Time of the snapshot.
+         *  @param values     Block vectors (size nDOFs(Var)), one per field, consistent across ranks on interface nodes.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void append(u64 step, f64 time, const std::vector<const EigenDefs::Vector<f64>*>& values);
+
+        /**< Waits until all appended snapshots of this rank are written */
+        void flush();
+
+        /**< Writes the remaining snapshots and the index and closes the file, collective */
+        void close();
+
+        /**< Returns the number of appended snapshots */
+        u64 nSnapshots() const { return index.size(); }
+
+    private:
+
+        // ---------------- //
+        // member variables //
+        // ---------------- //
+
+        Physics::Integrator& integrator;
+        u8  Var;
+        std::string fileName;
+        std::vector<SnapshotField> fields;
+        u64 nGlobal[3];                                 /**< Global nodes per axis */
+        u64 ownStart[3], ownCount[3];                   /**< Global box of the nodes owned by this rank */
+        std::vector<u64> owned;                         /**< Block indices of the owned nodes, in lexicographic order */
+        std::vector<u64> fieldOffset;                   /**< Byte offset per field within a record, nFields+1 entries */
+        u64 dataOffset, recordBytes;
+        u64 bufferBytes;                                /**< Bytes of the owned values of all fields */
+        std::vector<SnapshotEntry> index;
+        b8  isOpen;
+
+        // nonblocking writes
+        MPI_File file;                                  /**< Archive file, shared by all ranks */
+        MPI_Datatype recordType;                        /**< Owned box of every field within a record, tiled by recordBytes */
+        std::vector<char> buffers[2];                   /**< Owned values of all fields, in the stored precision */
+        MPI_Request requests[2];                        /**< Pending write of each buffer, MPI_REQUEST_NULL if none */
+        u32 current;                                    /**< Buffer the next snapshot is copied into */
+
+};
+
+} // end IO
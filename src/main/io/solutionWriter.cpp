@@ -0,0 +1,136 @@
+#include "CoreIncludes.hpp"
+#include "solutionWriter.hpp"
+
+#include <climits>
+#include <cstring>
+
+namespace IO {
+
+SolutionWriter::SolutionWriter(Physics::Integrator& integrator_, u8 Var_, valuePrecision precision_)
+    : integrator(integrator_), Var(Var_), precision(precision_), fileType(MPI_DATATYPE_NULL), fileTypeFields(0) {
+
+    CHECK_FATAL_ASSERT(integrator.nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(precision == PRECISION_F32 || precision == PRECISION_F64, "Unknown solution file precision")
+
+    valueType = (precision == PRECISION_F32) ? MPI_FLOAT : MPI_DOUBLE;
+    for (u8 axis=0; axis<3; axis++) nGlobal[axis] = integrator.nGlobal[Var][axis];
+    integrator.ownedBox(Var, integrator.geometry.procCoords, ownStart, ownCount);
+    owned = integrator.ownedBlockNodes(Var);
+    for (u8 axis=0; axis<3; axis++) {
+        CHECK_FATAL_ASSERT(nGlobal[axis] < (u64) INT_MAX, "Global nodes per axis exceed the MPI-IO subarray range")
+    }
+}
+
+SolutionWriter::~SolutionWriter() {
+
+    if (fileType != MPI_DATATYPE_NULL) MPI_Type_free(&fileType);
+}
+
+void SolutionWriter::setFileType(u32 nFields) {
+
+    if (fileType != MPI_DATATYPE_NULL && fileTypeFields == nFields) return;
+    if (fileType != MPI_DATATYPE_NULL) MPI_Type_free(&fileType);
+
+    // Fields are stored one after the other, x fastest: a C-ordered (field, z, y, x) array
+    const i32 sizes[4]    = {(i32) nFields, (i32) nGlobal[2],  (i32) nGlobal[1],  (i32) nGlobal[0]};
+    const i32 subsizes[4] = {(i32) nFields, (i32) ownCount[2], (i32) ownCount[1], (i32) ownCount[0]};
+    const i32 starts[4]   = {0,             (i32) ownStart[2], (i32) ownStart[1], (i32) ownStart[0]};
+    MPI_Type_create_subarray(4, sizes, subsizes, starts, MPI_ORDER_C, valueType, &fileType);
+    MPI_Type_commit(&fileType);
+    fileTypeFields = nFields;
+}
+
+void SolutionWriter::convert(const f64* in, u64 n, char* out) const {
+
+    if (precision == PRECISION_F64) { std::memcpy(out, in, n*sizeof(f64)); return; }
+    f32* outF32 = reinterpret_cast<f32*>(out);
+    for (u64 i=0; i<n; i++) outF32[i] = (f32) in[i];
+}
+
+void SolutionWriter::write(const std::string& fileName, const std::vector<std::string>& names,
+                           const std::vector<const EigenDefs::Vector<f64>*>& fields) {
+
+    PROFILE_SCOPE("SolutionWriter.write")
+
+    const u32 nFields = (u32) fields.size();
+    CHECK_FATAL_ASSERT(nFields > 0 && names.size() == nFields, "Every written field requires exactly one name")
+    for (u32 f=0; f<nFields; f++) {
+        CHECK_FATAL_ASSERT((u64) fields[f]->size() == integrator.nDOFs(Var), "Field size does not match the block of the variable")
+        CHECK_FATAL_ASSERT(names[f].size() < SolutionHeader::nameLength, "Field name too long for the solution file header")
+    }
+
+    const f64 tStart = MPI_Wtime();
+    const u64 valueBytes = (u64) precision;
+    const u64 nOwned     = owned.size();
+    const u64 nTotal     = nGlobal[0]*nGlobal[1]*nGlobal[2];
+    CHECK_FATAL_ASSERT(nFields*nOwned < (u64) INT_MAX, "Owned values per rank exceed the MPI-IO count range")
+
+    // ------------------------ //
+    // File layout              //
+    // ------------------------ //
+    SolutionHeader header;
+    std::memcpy(header.magic, SolutionHeader::magicString, sizeof(header.magic));
+    header.version    = SolutionHeader::currentVersion;
+    header.nDims      = integrator.nDims;
+    header.nFields    = nFields;
+    header.valueBytes = (u32) valueBytes;
+    for (u8 axis=0; axis<3; axis++) header.nNodes[axis] = nGlobal[axis];
+    header.dataOffset = ((sizeof(SolutionHeader) + nFields*SolutionHeader::nameLength + 63)/64)*64;
+
+    u64 coordBytes = 0;
+    for (u8 axis=0; axis<integrator.nDims; axis++) coordBytes += nGlobal[axis]*valueBytes;
+    const u64 fieldOffset = header.dataOffset + coordBytes;
+    const u64 fileSize    = fieldOffset + nFields*nTotal*valueBytes;
+
+    // ------------------------ //
+    // Pack owned values        //
+    // ------------------------ //
+    buffer.resize(nFields*nOwned*valueBytes);
+    for (u32 f=0; f<nFields; f++) {
+        const f64* field = fields[f]->data();
+        char* out = buffer.data() + f*nOwned*valueBytes;
+        if (precision == PRECISION_F32) {
+            f32* outF32 = reinterpret_cast<f32*>(out);
+            #pragma omp parallel for schedule(static)
+            for (u64 n=0; n<nOwned; n++) outF32[n] = (f32) field[owned[n]];
+        } else {
+            f64* outF64 = reinterpret_cast<f64*>(out);
+            #pragma omp parallel for schedule(static)
+            for (u64 n=0; n<nOwned; n++) outF64[n] = field[owned[n]];
+        }
+    }
+
+    // ------------------------ //
+    // Collective write         //
+    // ------------------------ //
+    MPI_File file;
+    CHECK_FATAL_ASSERT(MPI_File_open(integrator.comm, fileName.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                                     &file) == MPI_SUCCESS, "Solution file could not be opened for writing")
+    MPI_File_set_size(file, (MPI_Offset) fileSize);
+
+    // The header, names and coordinates are small, written by rank 0 alone
+    if (integrator.rankid == 0) {
+        std::vector<char> head(fieldOffset, '\0');
+        std::memcpy(head.data(), &header, sizeof(SolutionHeader));
+        for (u32 f=0; f<nFields; f++) {
+            std::memcpy(head.data() + sizeof(SolutionHeader) + f*SolutionHeader::nameLength, names[f].data(), names[f].size());
+        }
+        char* coords = head.data() + header.dataOffset;
+        for (u8 axis=0; axis<integrator.nDims; axis++) {
+            convert(integrator.xNodes[Var][axis].data(), nGlobal[axis], coords);
+            coords += nGlobal[axis]*valueBytes;
+        }
+        MPI_File_write_at(file, 0, head.data(), (i32) head.size(), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+
+    setFileType(nFields);
+    MPI_File_set_view(file, (MPI_Offset) fieldOffset, valueType, fileType, "native", MPI_INFO_NULL);
+    CHECK_FATAL_ASSERT(MPI_File_write_at_all(file, 0, buffer.data(), (i32) (nFields*nOwned), valueType, MPI_STATUS_IGNORE)
+                       == MPI_SUCCESS, "Collective write of the solution file failed")
+    MPI_File_close(&file);
+
+    INFO_MSG("SolutionWriter.write : %u fields of %llu nodes written to %s (%.1f MB) in %.3f s", nFields, nTotal,
+             fileName.c_str(), (f64) fileSize/1.e6, MPI_Wtime()-tStart)
+}
+
+} // end IO
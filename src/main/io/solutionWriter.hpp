@@ -0,0 +1,125 @@
+#pragma once
+
+#include "CoreIncludes.hpp"
+#include "integrator.hpp"
+
+#include <mpi.h>
+#include <string>
+#include <vector>
+
+/************************************************************************************************************************
+ *  @brief Any file input/output of solutions is represented in this namespace.
+ *
+ *  @details
+ *  Files are written collectively by all ranks of the decomposition through MPI-IO, each rank writing the nodes it owns,
+ *  and are laid out so that the postprocessing (src/post) can memory-map them without parsing or copying.
+ ************************************************************************************************************************/
+namespace IO {
+
+/* list of value types stored in solution files */
+typedef enum valuePrecision{
+    PRECISION_F32 = 4, /**< single precision, sufficient for plotting / postprocessing */
+    PRECISION_F64 = 8, /**< double precision, e.g. for restarts or convergence studies */
+} valuePrecision;
+
+/************************************************************************************************************************
+ *  @brief Header of a solution file, followed by nFields names of nameLength characters (null-padded).
+ *
+ *  @details
+ *  All integers are little-endian. From dataOffset on, the file holds in valueBytes precision:
+ *    - the global node coordinates per used axis, nNodes[axis] values each (the grid is a tensor product),
+ *    - every field over all nNodes[0]*nNodes[1]*nNodes[2] global nodes, x fastest, fields one after the other.
+ *  dataOffset is a multiple of 64 bytes, so that every array is aligned when the file is memory-mapped.
+ ************************************************************************************************************************/
+struct SolutionHeader{
+    static constexpr char magicString[8] = {'H','E','A','T','S','O','L','\0'};
+    static constexpr u32  currentVersion = 1;
+    static constexpr u32  nameLength     = 32;
+
+    char magic[8];                      /**< "HEATSOL" */
+    u32  version;                       /**< File format version */
+    u32  nDims;                         /**< Number of used axes */
+    u32  nFields;                       /**< Number of fields */
+    u32  valueBytes;                    /**< Bytes per value, 4 (f32) or 8 (f64) */
+    u64  nNodes[3];                     /**< Global nodes per axis, unused axes are 1 */
+    u64  dataOffset;                    /**< Byte offset of the first coordinate array */
+};
+static_assert(sizeof(SolutionHeader) == 56, "Solution file header must not be padded");
+
+/************************************************************************************************************************
+ *  @brief Parallel writer of block vectors into a single self-describing solution file.
+ *
+ *  @details
+ *  The block vectors are stored as global structure-of-arrays fields in lexicographic node order. Each rank packs the nodes
+ *  it owns (its block minus the upper interface nodes, see Integrator::ownedBox) into one contiguous buffer and all ranks
+ *  write through a subarray file view with a single MPI_File_write_at_all, so that the bandwidth scales with the number
+ *  of ranks and nothing is gathered on rank 0. Rank 0 only writes the header and the 1D coordinate arrays.
+ ************************************************************************************************************************/
+class SolutionWriter {
+
+    public:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /************************************************************************************************************************
+         *  @brief Sets up the file layout of variable \p Var_ of an existing integrator.
+         *
+         *  @param integrator_  Integrator of the block vectors, held by reference and must outlive the writer.
+         *  @param Var_         Variable of the written block vectors.
+         *  @param precision_   Precision of the stored values, coordinates included.
+         ************************************************************************************************************************/
+        SolutionWriter(Physics::Integrator& integrator_, u8 Var_, valuePrecision precision_ = PRECISION_F32);
+
+        /**< Frees the file view datatype */
+        ~SolutionWriter();
+
+        /**< Disabled construction using another SolutionWriter */
+        SolutionWriter(const SolutionWriter&) = delete;
+
+        /**< Disabled construction by equating to another SolutionWriter */
+        SolutionWriter& operator =(const SolutionWriter&) = delete;
+
+        /************************************************************************************************************************
+         *  @brief Writes block vectors as the fields of a solution file, collective over the ranks of the integrator.
+         *
+         *  @param fileName   Name of the file, overwritten if it exists.
+         *  @param names      Field names, at most SolutionHeader::nameLength-1 characters each.
+         *  @param fields     Block vectors (size nDOFs(Var)), one per name, consistent across ranks on interface nodes.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void write(const std::string& fileName, const std::vector<std::string>& names,
+                   const std::vector<const EigenDefs::Vector<f64>*>& fields);
+
+    private:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /**< Rebuilds the file view datatype for nFields fields, if it was built for another number */
+        void setFileType(u32 nFields);
+
+        /**< Converts n values to the stored precision at out */
+        void convert(const f64* in, u64 n, char* out) const;
+
+        // ---------------- //
+        // member variables //
+        // ---------------- //
+
+        Physics::Integrator& integrator;
+        u8  Var;
+        valuePrecision precision;
+        MPI_Datatype valueType;                         /**< MPI_FLOAT or MPI_DOUBLE */
+        MPI_Datatype fileType;                          /**< Owned box of every field within the global fields, MPI_DATATYPE_NULL if unset */
+        u32 fileTypeFields;                             /**< Number of fields fileType was built for */
+        u64 nGlobal[3];                                 /**< Global nodes per axis */
+        u64 ownStart[3], ownCount[3];                   /**< Global box of the nodes owned by this rank */
+        std::vector<u64> owned;                         /**< Block indices of the owned nodes, in lexicographic order */
+        std::vector<char> buffer;                       /**< Owned values of all fields in the stored precision */
+
+};
+
+} // end IO
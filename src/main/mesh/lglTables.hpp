@@ -0,0 +1,170 @@
+#pragma once
+
+#include "CoreIncludes.hpp"
+#include <array>
+#include <utility>
+
+namespace Mesh{
+
+/** Highest polynomial order for which the LGL tables are generated at compile-time */
+constexpr u8 LGL_TABLE_MAX_ORDER = 16;
+
+/************************************************************************************************************************
+ *  @brief Compile-time helpers used to generate the LGL tables. Not intended to be called directly.
+ ************************************************************************************************************************/
+namespace LGLDetail{
+
+/**< Constexpr cosine on [0,pi], only used for the initial guess of the nodes (refined by Newton afterwards) */
+constexpr f64 cos(f64 x) {
+    f64 term = 1., sum = 1.;
+    for (u8 k=1; k<40; k++) {
+        term *= -x*x / ((2*k-1)*(2*k));
+        sum  += term;
+    }
+    return sum;
+}
+
+/**< Constexpr absolute value */
+constexpr f64 abs(f64 x) { return x < 0. ? -x : x; }
+
+/**< Evaluates P_n, P'_n and P''_n in a single Bonnet recurrence, P'_{k+1} = P'_{k-1} + (2k+1) P_k */
+constexpr void legendre(u8 n, f64 xi, f64& P, f64& dP, f64& d2P) {
+    f64 P0 = 1., P1 = xi, dP0 = 0., dP1 = 1., d2P0 = 0., d2P1 = 0.;
+    if (n == 0) { P = P0; dP = dP0; d2P = d2P0; return; }
+    for (u8 k=1; k<n; k++) {
+        f64 P2   = ((2*k+1)*xi*P1 - k*P0) / (k+1);
+        f64 dP2  = dP0  + (2*k+1)*P1;
+        f64 d2P2 = d2P0 + (2*k+1)*dP1;
+        P0   = P1;   P1   = P2;
+        dP0  = dP1;  dP1  = dP2;
+        d2P0 = d2P1; d2P1 = d2P2;
+    }
+    P = P1; dP = dP1; d2P = d2P1;
+}
+
+/**< Table storage, matrices are column-major to match Eigen's default */
+template<u8 Order>
+struct LGLData{
+    std::array<f64, Order+1>           nodes{};
+    std::array<f64, Order+1>           weights{};
+    std::array<f64, Order+1>           baryWeights{};
+    std::array<f64, (Order+1)*(Order+1)> D{};
+};
+
+/**< Generates nodes (Newton on P'_p starting from Chebyshev-Gauss-Lobatto points), weights and derivative matrix */
+template<u8 Order>
+constexpr LGLData<Order> makeLGL() {
+    constexpr u8 n = Order+1;
+    LGLData<Order> data;
+    f64 P = 0., dP = 0., d2P = 0.;
+
+    data.nodes[0] = -1.;  data.nodes[n-1] = 1.;
+    for (u8 i=1; i<n-1; i++) {
+        f64 xi = -LGLDetail::cos(EIGEN_PI*i/Order);
+        for (u8 iter=0; iter<100; iter++) {
+            LGLDetail::legendre(Order, xi, P, dP, d2P);
+            f64 dxi = dP/d2P;
+            xi -= dxi;
+            if (LGLDetail::abs(dxi) < 1e-16) break;
+        }
+        data.nodes[i] = xi;
+    }
+    // Enforce exact symmetry
+    for (u8 i=0; i<n/2; i++) {
+        f64 xi = 0.5*(data.nodes[n-1-i] - data.nodes[i]);
+        data.nodes[i] = -xi;  data.nodes[n-1-i] = xi;
+    }
+    if (n%2 != 0) data.nodes[n/2] = 0.;
+
+    for (u8 i=0; i<n; i++) {
+        LGLDetail::legendre(Order, data.nodes[i], P, dP, d2P);
+        data.weights[i] = 2. / (Order*(Order+1)*P*P);
+
+        f64 prod = 1.;
+        for (u8 k=0; k<n; k++) {
+            if (k != i) prod *= (data.nodes[i]-data.nodes[k]);
+        }
+        data.baryWeights[i] = 1./prod;
+    }
+
+    for (u8 i=0; i<n; i++) {
+        f64 diag = 0.;
+        for (u8 j=0; j<n; j++) {
+            if (i != j) {
+                f64 Dij = (data.baryWeights[j]/data.baryWeights[i]) / (data.nodes[i]-data.nodes[j]);
+                data.D[i + n*j] = Dij;
+                diag -= Dij;
+            }
+        }
+        data.D[i + n*i] = diag;
+    }
+    return data;
+}
+
+} // end LGLDetail
+
+/************************************************************************************************************************
+ *  @brief Compile-time LGL nodes, weights, barycentric weights and nodal derivative matrix of polynomial order \p Order.
+ *
+ *  @details
+ *  Generated once by the compiler, so no Halley/Newton iterations are performed at startup for the standard orders. The
+ *  fixed-size accessors give Eigen types whose sizes are known at compile-time, allowing element kernels to unroll.
+ *
+ *  Example:
+ *
+ *  @code{.cpp}
+ *  const auto& D = Mesh::LGLTable<7>::d1Matrix(); // Eigen::Map of a (8 x 8) matrix
+ *  @endcode
+ ************************************************************************************************************************/
+template<u8 Order>
+struct LGLTable{
+
+    static_assert(Order > 0 && Order <= LGL_TABLE_MAX_ORDER, "LGL table order outside of the generated range");
+
+    /** Number of nodes */
+    static constexpr u8 n = Order+1;
+    /** Fixed-size (n x n) matrix type */
+    using MatrixN = Eigen::Matrix<f64, n, n>;
+    /** Fixed-size n array type */
+    using ArrayN  = Eigen::Array<f64, n, 1>;
+    /** All tables */
+    static constexpr LGLDetail::LGLData<Order> data = LGLDetail::makeLGL<Order>();
+
+    /**< Nodes as a fixed-size Eigen array */
+    static Eigen::Map<const ArrayN>  nodes()       { return Eigen::Map<const ArrayN>(data.nodes.data()); }
+    /**< Weights as a fixed-size Eigen array */
+    static Eigen::Map<const ArrayN>  weights()     { return Eigen::Map<const ArrayN>(data.weights.data()); }
+    /**< Barycentric weights as a fixed-size Eigen array */
+    static Eigen::Map<const ArrayN>  baryWeights() { return Eigen::Map<const ArrayN>(data.baryWeights.data()); }
+    /**< Nodal derivative matrix D(i,j) = l'_j(xi_i) as a fixed-size Eigen matrix */
+    static Eigen::Map<const MatrixN> d1Matrix()    { return Eigen::Map<const MatrixN>(data.D.data()); }
+};
+
+/************************************************************************************************************************
+ *  @brief Copies the compile-time LGL tables of a runtime \p polyOrder into dynamically-sized arrays.
+ *
+ *  @param polyOrder  Polynomial order, must be in [1, LGL_TABLE_MAX_ORDER].
+ *  @param x          Output, nodes.
+ *  @param w          Output, weights.
+ *  @param lambda     Output, barycentric weights.
+ *  @param D          Output, nodal derivative matrix.
+ *
+ *  @return TRUE if a table exists for polyOrder, FALSE otherwise (outputs untouched).
+ ************************************************************************************************************************/
+inline b8 copyLGLTable(u8 polyOrder, EigenDefs::Array1D<f64>& x, EigenDefs::Array1D<f64>& w,
+                       EigenDefs::Array1D<f64>& lambda, EigenDefs::Matrix<f64>& D) {
+
+    if (polyOrder < 1 || polyOrder > LGL_TABLE_MAX_ORDER) return FALSE;
+
+    b8 found = FALSE;
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+        ((polyOrder == I+1 ? (x      = LGLTable<I+1>::nodes(),
+                              w      = LGLTable<I+1>::weights(),
+                              lambda = LGLTable<I+1>::baryWeights(),
+                              D      = LGLTable<I+1>::d1Matrix(),
+                              found  = TRUE) : 0), ...);
+    }(std::make_index_sequence<LGL_TABLE_MAX_ORDER>{});
+    return found;
+}
+
+} // end Mesh
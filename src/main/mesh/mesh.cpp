@@ -1,8 +1,8 @@
 #include "CoreIncludes.hpp"
 #include "mesh.hpp"
 #include "polynomials.hpp"
+#include "lglTables.hpp"
 #include <math.h>
-#include <stdarg.h>
 
 namespace Mesh{
 
@@ -16,9 +16,18 @@ void MasterElement::setnVars(u8 nVars_) {
     CHECK_FATAL_ASSERT(nDims  > 0, "nDims must be set first before calling upon this function")
     CHECK_FATAL_ASSERT(nVars_ > 0, "Number of variables must be bigger than 0")
     nVars = nVars_;
+
+    // Each variable holds a set of 1D bases per axis
+    weights.assign(nVars, std::vector<EigenDefs::Array1D<f64>>(nDims));
+    nodes.assign(nVars, std::vector<EigenDefs::Array1D<f64>>(nDims));
+    baryWeights.assign(nVars, std::vector<EigenDefs::Array1D<f64>>(nDims));
+    d1lagrange.assign(nVars, std::vector<EigenDefs::Matrix<f64>>(nDims));
+    polyOrders.assign(nVars, std::vector<u8>(nDims, 0));
 }
 
-void MasterElement::setLGLOrder(u8 Var, ...){
+void MasterElement::setLGLOrders(u8 Var, std::span<const u8> orders){
+
+    PROFILE_SCOPE("MasterElement.setLGLOrder")
 
     DEBUG_MSG("MasterElement.setLGLOrder : ===========")
     DEBUG_MSG("MasterElement.setLGLOrder : Var %i", Var)
@@ -27,152 +36,217 @@ void MasterElement::setLGLOrder(u8 Var, ...){
     CHECK_FATAL_ASSERT(nDims > 0, "nDims must be set first before calling upon this function")
     CHECK_FATAL_ASSERT(nVars > 0, "nVars must be set first before calling upon this function")
     CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
-    f64 epsilon = 1e-15;
-    std::vector<u8> tmp; 
+    CHECK_FATAL_ASSERT(orders.size() >= nDims, "Number of polyOrder inputs is smaller than nDim")
+    for (u8 axis=0; axis<nDims; axis++) {
+        CHECK_FATAL_ASSERT(orders[axis] > 0,   "Polynomial order must be larger than 0")
+        CHECK_FATAL_ASSERT(orders[axis] < 255, "Polynomial order must be smaller than 255")
+    }
+    polyOrders[Var].assign(orders.begin(), orders.begin() + nDims);
+
     i32 polyOrder;
-    va_list  argPtr;
-    va_start(argPtr, Var);
-    for (u8 i=0; i<nDims; i++) {
-        polyOrder = va_arg(argPtr, i32);
-	if (!polyOrder) break;
-	
-	INFO_MSG("%i", polyOrder)
-	CHECK_FATAL_ASSERT(polyOrder > 1,   "Polynomial order must be larger than 1")
-	tmp.push_back( polyOrder);	
-	
-    }
-    va_end(argPtr);
-    INFO_MSG("%i %i", tmp.size(), nDims)
-    CHECK_FATAL_ASSERT(tmp.size() == nDims, "Number of polyOrder inputs does not match nDim")
-
-    // CHECK_FATAL_ASSERT(polyOrder > 1, "Polynomial Order must be larger than 1")
-    // // --------------------- //
-    // // LGL Weights and Nodes //
-    // // --------------------- // 
-
-    // u8  n       = polyOrder + 1; // Number of gridpoints 
-    // EigenDefs::Array1D<f64> x  = EigenDefs::Array1D<f64>::Zero(n);
-    // EigenDefs::Array1D<f64> w  = EigenDefs::Array1D<f64>::Zero(n);
-    // x[0] = -1;              x[n-1] = 1;
-    // w[0] = 2.0/(n*(n-1));   w[n-1] = w[0];
-
-    // u8 n_2 = n/2; // Floor division if n is odd
-    // f64 error;
-    // f64 xi, dxi;
-    // f64 y1, y2, y3;
-    // TRACE_MSG("MasterElement.setLGLOrder : Passed variable declaration / initialisation") 
-
-    // for (u8 i=1; i<n_2; i++) {
-    //     xi = (1 - 3*(n-2) / (8 * (n-1)*(n-1)*(n-1))) \
-    //          * std::cos((4*i+1)*EIGEN_PI/(4*(n-1)+1));
-
-    //     error = 1.;
-
-    //     do{
-    //         y1 = Polynomials::d1Legendre(n-1, xi);
-    //         y2 = Polynomials::d2Legendre(n-1, xi);
-    //         y3 = Polynomials::d3Legendre(n-1, xi);
-
-    //         dxi = 2*y1*y2 / (2*y2*y2-y1*y3);
-    //         xi -= dxi;
-    //         error = std::abs(dxi);
-
-    //     } while (error > epsilon);
-
-    //     x[i]     = -xi;
-    //     x[n-i-1] =  xi;
-
-    //     w[i]     = 2/(n*(n-1)*std::pow(Polynomials::Legendre(n-1,x[i]),2));
-    //     w[n-i-1] = w[i];
-    // }
-
-    // if (n%2 != 0) {
-    //     x[n_2] = 0;
-    //     w[n_2] = 2/(n*(n-1)*std::pow(Polynomials::Legendre(n-1,x[n_2]),2));
-    // } 
-
-    // nodes.push_back(x);
-    // weights.push_back(w);
-
-    // // DEBUG SUMMARY
-    // TRACE_MSG("MasterElement.setLGLOrder : Var %i - x, w array pushed", Var)
-    // #if RELEASE==0
-    //     std::stringstream printArr;
-    //     f64 SUM = 0.;
-    //     // print x array
-    //     printArr << std::fixed << std::setprecision( 4 );
-    //     printArr << "MasterElement.setLGLOrder : x = [ ";
-    //     for (u8 i=0; i<x.size(); i++) printArr << x[i] << " ";   
-    //     printArr << "]";
-    //     DEBUG_MSG("%s", printArr.str().c_str())
-    //     
-    //     printArr.str(std::string());
-    //     // print w array + sum
-    //     printArr << std::fixed << std::setprecision( 4 );
-    //     printArr << "MasterElement.setLGLOrder : w = [ ";
-    //     for (u8 i=0; i<w.size(); i++) {printArr << w[i] << " "; SUM += w[i];}  
-    //     printArr << "], SUM = " << SUM;
-    //     DEBUG_MSG("%s", printArr.str().c_str())
-    // #endif
-
-    // // ----------------------------- //
-    // // LGL-Lagranges and Derivatives //
-    // // ----------------------------- // 
-
-    // EigenDefs::Array1D<f64> y = EigenDefs::Array1D<f64>::Zero(x.rows());
-    // std::vector<Polynomials::PolyInterp1D> lagrange_;
-    // std::vector<Polynomials::PolyInterp1D> d1lagrange_;
-    // for (u8 i=0; i<x.rows(); i++){
-    //     DEBUG_MSG("MasterElement.setLGLOrder : -----------")
-    //     DEBUG_MSG("MasterElement.setLGLOrder : n = %i", i)
-    //     DEBUG_MSG("MasterElement.setLGLOrder : -----------")
-    //     y.setZero();
-    //     y[i] = 1.;
-
-    //     Polynomials::PolyInterp1D   lagrange__(x,y);
-    //     Polynomials::PolyInterp1D d1lagrange__ = lagrange__.derivative();
-
-    //     // Push to subvector
-    //     lagrange_.push_back(lagrange__);
-    //     d1lagrange_.push_back(d1lagrange__);
-
-    //     // DEBUG SUMMARY
-    //     TRACE_MSG("MasterElement.setLGLOrder : P_%i, dP_%i pushed to subvector, n=%i", polyOrder, polyOrder, i)
-    //     #if RELEASE==0
-    //         std::stringstream printArr;
-    //         EigenDefs::Array1D<f64> out; 
-    //         // print p(x)
-    //         out = lagrange_[i](x);
-    //         printArr << std::fixed << std::setprecision( 4 );
-    //         printArr << "MasterElement.setLGLOrder : P(x)   = [ ";
-    //         for (u64 j=0; j<out.size(); j++) printArr << out[j] << " ";
-    //         printArr << "] ?= [ ";
-    //         for (u64 j=0; j<out.size(); j++) printArr << y[j] << " ";
-    //         printArr << "]";
-    //         DEBUG_MSG("%s", printArr.str().c_str())
-
-    //         printArr.str(std::string());
-    //         // print d1p(x)
-    //         out = d1lagrange_[i](x);
-    //         printArr << std::fixed << std::setprecision( 4 );
-    //         printArr << "MasterElement.setLGLOrder : d1P(x) = [ ";
-    //         for (u64 j=0; j<out.size(); j++) printArr << out[j] << " ";
-    //         printArr << "]";
-    //         DEBUG_MSG("%s", printArr.str().c_str())
-    //     #endif
-    // }
-    // // Push to vector
-    // lagrange.push_back(lagrange_);
-    // d1lagrange.push_back(d1lagrange_);
-    // TRACE_MSG("MasterElement.setLGLOrder : { P_%i, dP_%i } subvector pushed to main std::vector", polyOrder, polyOrder)
-
-    // INFO_MSG("Variable %i - FEM space set to piecewise LGL-Lagrange polynomials of order %i", Var, polyOrder)
+    for (u8 axis=0; axis<nDims; axis++) {
+        polyOrder = polyOrders[Var][axis];
+
+        // ------------------------------------------- //
+        // LGL Weights, Nodes and Lagrange Derivatives //
+        // ------------------------------------------- // 
+
+        // Filled in place, x, w and D are views of the stored arrays
+        u8  n = polyOrder + 1; // Number of gridpoints 
+        EigenDefs::Array1D<f64>& x = nodes[Var][axis];
+        EigenDefs::Array1D<f64>& w = weights[Var][axis];
+        EigenDefs::Matrix<f64>&  D = d1lagrange[Var][axis];
+        if (copyLGLTable(polyOrder, x, w, baryWeights[Var][axis], D)) {
+            TRACE_MSG("MasterElement.setLGLOrder : Var %i, axis %i - copied compile-time LGL table", Var, axis)
+        }
+        else {
+            computeLGL(polyOrder, x, w, baryWeights[Var][axis], D);
+            TRACE_MSG("MasterElement.setLGLOrder : Var %i, axis %i - computed LGL nodes at runtime", Var, axis)
+        }
+
+        // DEBUG SUMMARY
+        TRACE_MSG("MasterElement.setLGLOrder : Var %i, axis %i - x, w array stored", Var, axis)
+        #if RELEASE==0
+            std::stringstream printArr;
+            f64 SUM = 0.;
+            // print x array
+            printArr << std::fixed << std::setprecision( 4 );
+            printArr << "MasterElement.setLGLOrder : x = [ ";
+            for (u8 i=0; i<x.size(); i++) printArr << x[i] << " ";   
+            printArr << "]";
+            DEBUG_MSG("%s", printArr.str().c_str())
+            
+            printArr.str(std::string());
+            // print w array + sum
+            printArr << std::fixed << std::setprecision( 4 );
+            printArr << "MasterElement.setLGLOrder : w = [ ";
+            for (u8 i=0; i<w.size(); i++) {printArr << w[i] << " "; SUM += w[i];}  
+            printArr << "], SUM = " << SUM;
+            DEBUG_MSG("%s", printArr.str().c_str())
+
+            printArr.str(std::string());
+            // print D matrix
+            printArr << std::fixed << std::setprecision( 4 );
+            printArr << "MasterElement.setLGLOrder : D = \n[";
+            for (u8 i=0; i<n; i++) {
+                if (i != 0) printArr << " "; // Extra padding so that all [ line up
+                printArr << " [ ";
+                for (u8 j=0; j<n; j++) printArr << D(i,j) << " ";
+                printArr << "]";
+                if (i != n-1) printArr << "\n"; // Nicer formatting so that the next ] does not appear on next line
+            }
+            printArr << " ]";
+            DEBUG_MSG("%s", printArr.str().c_str())
+
+            // D applied to the nodes should return ones
+            printArr.str(std::string());
+            printArr << "MasterElement.setLGLOrder : max|D*x - 1| = " << std::scientific << ((D*x.matrix()).array() - 1.).abs().maxCoeff();
+            DEBUG_MSG("%s", printArr.str().c_str())
+        #endif
+
+        INFO_MSG("Variable %i - FEM space along axis %i set to piecewise LGL-Lagrange polynomials of order %i", Var, axis, polyOrder)
+    }
+}
+
+void MasterElement::computeLGL(u8 polyOrder, EigenDefs::Array1D<f64>& x, EigenDefs::Array1D<f64>& w,
+                               EigenDefs::Array1D<f64>& lambda, EigenDefs::Matrix<f64>& D) {
+
+    f64 epsilon = 1e-15;
+
+    // --------------------- //
+    // LGL Weights and Nodes //
+    // --------------------- // 
+
+    u8  n       = polyOrder + 1; // Number of gridpoints 
+    x = EigenDefs::Array1D<f64>::Zero(n);
+    x[0] = -1;              x[n-1] = 1;
+
+    u8 n_2 = n/2; // Floor division if n is odd
+    u16 kappa = 0;
+    EigenDefs::Array1D<f64> xi, dxi;
+    EigenDefs::Array1D<f64> y0, y1, y2, y3;
+    TRACE_MSG("MasterElement.computeLGL : Passed variable declaration / initialisation") 
+
+    // All positive interior nodes iterate together, i = 1, ..., n_2-1
+    if (n_2 > 1) {
+        xi = EigenDefs::Array1D<f64>::LinSpaced(n_2-1, 1, n_2-1);
+        xi = (1. - 3.*(n-2) / (8. * (n-1)*(n-1)*(n-1))) \
+             * ((4*xi+1)*EIGEN_PI/(4*(n-1)+1)).cos();
+
+        f64 error = 1.;
+        do{
+            Polynomials::fusedLegendre(n-1, xi, y0, y1, y2, y3);
+
+            dxi = 2*y1*y2 / (2*y2*y2-y1*y3);
+            xi -= dxi;
+            error = dxi.abs().maxCoeff();
+            kappa++;
+            CHECK_FATAL_ITERERROR(kappa, error)
+
+        } while (error > epsilon && kappa < 100);
+
+        x.segment(1, n_2-1)     = -xi;
+        x.segment(n-n_2, n_2-1) =  xi.reverse();
+    }
+    if (n%2 != 0) x[n_2] = 0;
+    TRACE_MSG("MasterElement.computeLGL : passed Halley iteration in %i steps", kappa)
+
+    // w_i = 2 / (n(n-1) P_{n-1}(x_i)^2)
+    Polynomials::fusedLegendre(n-1, x, y0, y1, y2, y3);
+    w = 2. / (n*(n-1)*y0.square());
+
+    // ----------------------------- //
+    // LGL-Lagranges and Derivatives //
+    // ----------------------------- // 
+
+    // Barycentric weights, lambda_j = 1/prod_{k!=j}(x_j-x_k)
+    lambda = EigenDefs::Array1D<f64>::Ones(n);
+    for (u8 j=0; j<n; j++) {
+        for (u8 k=0; k<n; k++) {
+            if (k != j) lambda[j] *= (x[j]-x[k]);
+        }
+    }
+    lambda = lambda.inverse();
+    TRACE_MSG("MasterElement.computeLGL : passed barycentric weights")
+
+    // D(i,j) = (lambda_j/lambda_i)/(x_i-x_j), diagonal through the negative row sum (derivative of a constant is 0)
+    D = EigenDefs::Matrix<f64>::Zero(n, n);
+    for (u8 i=0; i<n; i++) {
+        for (u8 j=0; j<n; j++) {
+            if (i != j) {
+                D(i,j)  = (lambda[j]/lambda[i]) / (x[i]-x[j]);
+                D(i,i) -= D(i,j);
+            }
+        }
+    }
+}
+
+u8 MasterElement::getPolyOrder(u8 Var, u8 axis) const {
 
+    CHECK_FATAL_ASSERT(nVars > Var,  "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(nDims > axis, "Axis number accessed too large")
+    return polyOrders[Var][axis];
+}
+
+const EigenDefs::Matrix<f64>& MasterElement::d1LagrangeMatrix(u8 Var, u8 axis) const {
+
+    CHECK_FATAL_ASSERT(nVars > Var,  "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(nDims > axis, "Axis number accessed too large")
+    CHECK_FATAL_ASSERT(polyOrders[Var][axis] > 0, "setLGLOrder must be called first before calling upon this function")
+    return d1lagrange[Var][axis];
+}
+
+const EigenDefs::Array1D<f64>& MasterElement::getWeights(u8 Var, u8 axis) const {
+
+    CHECK_FATAL_ASSERT(nVars > Var,  "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(nDims > axis, "Axis number accessed too large")
+    return weights[Var][axis];
+}
+
+const EigenDefs::Array1D<f64>& MasterElement::getNodes(u8 Var, u8 axis) const {
+
+    CHECK_FATAL_ASSERT(nVars > Var,  "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(nDims > axis, "Axis number accessed too large")
+    return nodes[Var][axis];
+}
+
+EigenDefs::Matrix<f64> MasterElement::lagrangeMatrix(u8 Var, u8 axis, const Eigen::Ref<const EigenDefs::Array1D<f64>>& xi) const {
+
+    CHECK_FATAL_ASSERT(nVars > Var,  "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(nDims > axis, "Axis number accessed too large")
+    CHECK_FATAL_ASSERT(polyOrders[Var][axis] > 0, "setLGLOrder must be called first before calling upon this function")
+
+    const EigenDefs::Array1D<f64>& x      = nodes[Var][axis];
+    const EigenDefs::Array1D<f64>& lambda = baryWeights[Var][axis];
+    EigenDefs::Matrix<f64> L = EigenDefs::Matrix<f64>::Zero(xi.rows(), x.rows());
+    ASSERT_NO_ALLOCATION("MasterElement.lagrangeMatrix")
+
+    for (i64 i=0; i<xi.rows(); i++) {
+        // Second barycentric formula, l_j(xi) = (lambda_j/(xi-x_j)) / sum_k (lambda_k/(xi-x_k)), built in place in row i
+        i64 jNode = -1;
+        f64 sum   = 0.;
+        for (i64 j=0; j<x.rows() && jNode < 0; j++) {
+            const f64 diff = xi[i] - x[j];
+            if (diff == 0.) jNode = j;
+            else            sum += (L(i,j) = lambda[j] / diff);
+        }
+        if (jNode >= 0) {
+            L.row(i).setZero();
+            L(i,jNode) = 1.;
+            continue;
+        }
+        L.row(i) /= sum;
+    }
+    TRACE_MSG("MasterElement.lagrangeMatrix : Var %i, axis %i - passed matrix construction", Var, axis)
+    return L;
 }
 
 Geometry::Geometry(EigenDefs::Array1D<f64> x1) : nDims(1) {
 
     MasterElement = Mesh::MasterElement(nDims);
+    xe.reserve(nDims);
+    xe.push_back(std::move(x1));
+    setTensorGrid();
     
     INFO_MSG("%iD cartesian grid established", nDims)
 
@@ -180,7 +254,12 @@ Geometry::Geometry(EigenDefs::Array1D<f64> x1) : nDims(1) {
 
 Geometry::Geometry(EigenDefs::Array1D<f64> x1, EigenDefs::Array1D<f64> x2) : nDims(2) {
 
+    // An initializer list would copy, the endpoints are moved in one by one
     MasterElement = Mesh::MasterElement(nDims);
+    xe.reserve(nDims);
+    xe.push_back(std::move(x1));
+    xe.push_back(std::move(x2));
+    setTensorGrid();
     
     INFO_MSG("%iD cartesian grid established", nDims)
 }
@@ -188,8 +267,251 @@ Geometry::Geometry(EigenDefs::Array1D<f64> x1, EigenDefs::Array1D<f64> x2) : nDi
 Geometry::Geometry(EigenDefs::Array1D<f64> x1, EigenDefs::Array1D<f64> x2, EigenDefs::Array1D<f64> x3) : nDims(3) {
 
     MasterElement = Mesh::MasterElement(nDims);
+    xe.reserve(nDims);
+    xe.push_back(std::move(x1));
+    xe.push_back(std::move(x2));
+    xe.push_back(std::move(x3));
+    setTensorGrid();
     
     INFO_MSG("%iD cartesian grid established", nDims)
 }
 
+u64 Geometry::nElemsTotal() const {
+
+    u64 total = 1;
+    for (u8 axis=0; axis<nDims; axis++) total *= nElems[axis];
+    return total;
+}
+
+void Geometry::elemIndex(u64 elem, u64 elemAxis[3]) const {
+
+    for (u8 axis=0; axis<3; axis++) {
+        if (axis < nDims) {
+            elemAxis[axis] = elem % nElems[axis];
+            elem          /= nElems[axis];
+        }
+        else elemAxis[axis] = 0;
+    }
+}
+
+void Geometry::setTensorGrid() {
+
+    nElems.clear();
+    for (u8 axis=0; axis<nDims; axis++) {
+        CHECK_FATAL_ASSERT(xe[axis].rows() > 1, "Each axis requires at least two endpoints")
+        CHECK_FATAL_ASSERT(((xe[axis].tail(xe[axis].rows()-1) - xe[axis].head(xe[axis].rows()-1)) > 0.).all(), 
+                           "Element endpoints must be strictly increasing")
+        nElems.push_back(xe[axis].rows()-1);
+    }
+    TRACE_MSG("Geometry.setTensorGrid : passed element count")
+
+    // Axis-aligned elements -> diagonal Jacobian, only the per-axis element half-widths are needed
+    halfWidths.resize(nDims);
+    for (u8 axis=0; axis<nDims; axis++) {
+        const i64 nx = xe[axis].rows();
+        halfWidths[axis] = 0.5*(xe[axis].tail(nx-1) - xe[axis].head(nx-1));
+    }
+    metrics.resize(0, 0);
+    nQuad       = 0;
+    isCartesian = TRUE;
+    revision    = 0;
+    TRACE_MSG("Geometry.setTensorGrid : passed Jacobian construction")
+
+    // Single block until decompose is called
+    comm = MPI_COMM_SELF;
+    for (u8 axis=0; axis<3; axis++) { procDims[axis] = 1; procCoords[axis] = 0; }
+    procRanks = {0};
+    setPartition();
+}
+
+Geometry::~Geometry() {
+
+    i32 isFinalized;
+    MPI_Finalized(&isFinalized);
+    if (comm != MPI_COMM_SELF && !isFinalized) MPI_Comm_free(&comm);
+}
+
+void Geometry::decompose(MPI_Comm comm_) {
+
+    PROFILE_SCOPE("Geometry.decompose")
+
+    CHECK_FATAL_ASSERT(isCartesian, "decompose must be called before setMetrics")
+    if (comm != MPI_COMM_SELF) MPI_Comm_free(&comm);
+
+    i32 nprocs, rankid;
+    i32 dims[3] = {0, 0, 0}, periods[3] = {0, 0, 0};
+    MPI_Comm_size(comm_, &nprocs);
+    MPI_Dims_create(nprocs, nDims, dims);
+    MPI_Cart_create(comm_, nDims, dims, periods, 1, &comm);
+    MPI_Comm_rank(comm, &rankid);
+
+    i32 coords[3] = {0, 0, 0};
+    MPI_Cart_coords(comm, rankid, nDims, coords);
+    for (u8 axis=0; axis<3; axis++) {
+        procDims[axis]   = (axis < nDims) ? dims[axis]   : 1;
+        procCoords[axis] = (axis < nDims) ? coords[axis] : 0;
+        if (axis < nDims) CHECK_FATAL_ASSERT(static_cast<u64>(procDims[axis]) <= nElems[axis], "More blocks than elements along an axis")
+    }
+    TRACE_MSG("Geometry.decompose : passed Cartesian communicator construction")
+
+    procRanks.assign(procDims[0]*procDims[1]*procDims[2], 0);
+    for (i32 r=0; r<nprocs; r++) {
+        i32 c[3] = {0, 0, 0};
+        MPI_Cart_coords(comm, r, nDims, c);
+        procRanks[c[0] + procDims[0]*(c[1] + procDims[1]*c[2])] = r;
+    }
+    setPartition();
+
+    INFO_MSG("Geometry decomposed into %i x %i x %i blocks, rank %i holds %llu elements with %llu neighbours", 
+             procDims[0], procDims[1], procDims[2], rankid, nElemsLocal(), (u64) neighbourRanks.size())
+}
+
+void Geometry::setPartition() {
+
+    elemBegin.assign(3, 0);
+    elemEnd.assign(3, 1);
+    for (u8 axis=0; axis<nDims; axis++) {
+        elemBegin[axis] = partitionBegin(axis, procCoords[axis]);
+        elemEnd[axis]   = partitionBegin(axis, procCoords[axis]+1);
+    }
+
+    // Face, edge and corner neighbours, offsets of unused axes stay 0
+    neighbourRanks.clear();
+    neighbourOffsets.clear();
+    const i32 range[3] = {1, nDims > 1 ? 1 : 0, nDims > 2 ? 1 : 0};
+    for (i32 o2=-range[2]; o2<=range[2]; o2++) {
+        for (i32 o1=-range[1]; o1<=range[1]; o1++) {
+            for (i32 o0=-range[0]; o0<=range[0]; o0++) {
+                const std::array<i32,3> offset = {o0, o1, o2};
+                if (o0 == 0 && o1 == 0 && o2 == 0) continue;
+
+                i32 coords[3];
+                b8  isInside = TRUE;
+                for (u8 axis=0; axis<3; axis++) {
+                    coords[axis] = procCoords[axis] + offset[axis];
+                    isInside    &= (coords[axis] >= 0 && coords[axis] < procDims[axis]);
+                }
+                if (!isInside) continue;
+                neighbourRanks.push_back(procRank(coords));
+                neighbourOffsets.push_back(offset);
+            }
+        }
+    }
+    TRACE_MSG("Geometry.setPartition : passed neighbour construction")
+
+    // Elements sharing a node differ by one along some axis, so the parity per axis gives a conflict-free coloring
+    interfaceColors.assign(1 << nDims, std::vector<u64>());
+    interiorColors.assign(1 << nDims, std::vector<u64>());
+    u64 elemAxis[3], nInterface = 0;
+    for (u64 elem=0; elem<nElemsLocal(); elem++) {
+        localElemIndex(elem, elemAxis);
+        b8 isInterface = FALSE;
+        u8 color = 0;
+        for (u8 axis=0; axis<nDims; axis++) {
+            isInterface |= (elemAxis[axis] == elemBegin[axis]   && procCoords[axis] > 0);
+            isInterface |= (elemAxis[axis] == elemEnd[axis]-1   && procCoords[axis] < procDims[axis]-1);
+            color       |= (elemAxis[axis] % 2) << axis;
+        }
+        if (isInterface) { interfaceColors[color].push_back(elem); nInterface++; }
+        else               interiorColors[color].push_back(elem);
+    }
+    TRACE_MSG("Geometry.setPartition : passed element coloring, %llu interface and %llu interior elements", 
+              nInterface, nElemsLocal()-nInterface)
+}
+
+u64 Geometry::nElemsLocal() const {
+
+    u64 total = 1;
+    for (u8 axis=0; axis<nDims; axis++) total *= elemEnd[axis] - elemBegin[axis];
+    return total;
+}
+
+void Geometry::localElemIndex(u64 elem, u64 elemAxis[3]) const {
+
+    for (u8 axis=0; axis<3; axis++) {
+        if (axis < nDims) {
+            const u64 nLocal = elemEnd[axis] - elemBegin[axis];
+            elemAxis[axis] = elemBegin[axis] + elem % nLocal;
+            elem          /= nLocal;
+        }
+        else elemAxis[axis] = 0;
+    }
+}
+
+u64 Geometry::partitionBegin(u8 axis, i32 coord) const {
+
+    // Balanced split, block sizes differ by at most one element
+    return (coord*nElems[axis]) / procDims[axis];
+}
+
+i32 Geometry::partitionOwner(u8 axis, u64 elemAxis) const {
+
+    if (axis >= nDims) return 0;
+    i32 coord = (elemAxis*procDims[axis]) / nElems[axis];
+    while (coord > 0 && partitionBegin(axis, coord) > elemAxis) coord--;
+    while (coord < procDims[axis]-1 && partitionBegin(axis, coord+1) <= elemAxis) coord++;
+    return coord;
+}
+
+i32 Geometry::procRank(const i32 coords[3]) const {
+
+    return procRanks[coords[0] + procDims[0]*(coords[1] + procDims[1]*coords[2])];
+}
+
+void Geometry::setMetrics(u64 nQuad_, const Eigen::Ref<const EigenDefs::Array2D<f64>>& jac) {
+
+    PROFILE_SCOPE("Geometry.setMetrics")
+
+    CHECK_FATAL_ASSERT(nQuad_ > 0, "Number of quadrature points must be bigger than 0")
+    CHECK_FATAL_ASSERT(static_cast<u64>(jac.rows()) == nElemsLocal()*nQuad_, "Jacobian rows must match nElemsLocal*nQuad")
+    CHECK_FATAL_ASSERT(jac.cols() == nDims*nDims, "Jacobian columns must match nDims*nDims")
+
+    // Dimension loops are unrolled in the fixed-size instantiations, access is setters[nDims-1]
+    using Setter = void (Geometry::*)(const Eigen::Ref<const EigenDefs::Array2D<f64>>&);
+    static constexpr std::array<Setter, 3> setters = {&Geometry::setMetricsFixed<1>, &Geometry::setMetricsFixed<2>, 
+                                                      &Geometry::setMetricsFixed<3>};
+    nQuad = nQuad_;
+    (this->*setters[nDims-1])(jac);
+    isCartesian = FALSE;
+    revision++;
+    INFO_MSG("General element metrics set, %llu quadrature points per element", nQuad)
+}
+
+template<u8 Dim>
+void Geometry::setMetricsFixed(const Eigen::Ref<const EigenDefs::Array2D<f64>>& jac) {
+
+    using MatrixD = Eigen::Matrix<f64, Dim, Dim>; // EigenDefs::Matrix22/Matrix33 for 2D/3D
+
+    metrics.resize(jac.rows(), 1 + Dim*(Dim+1)/2); // uninitialised, pages are placed by the first write below
+    b8 isValid = TRUE;
+
+    #pragma omp parallel reduction(&&:isValid)
+    {
+        MatrixD J, Jinv, G;
+        for (const std::vector<std::vector<u64>>* colors : {&interfaceColors, &interiorColors}) {
+            for (const std::vector<u64>& elems : *colors) {
+                #pragma omp for schedule(static)
+                for (u64 n=0; n<elems.size(); n++) {
+                    for (u64 row=elems[n]*nQuad; row<(elems[n]+1)*nQuad; row++) {
+                        for (u8 b=0; b<Dim; b++) {
+                            for (u8 a=0; a<Dim; a++) J(a,b) = jac(row, a + Dim*b);
+                        }
+                        // Closed-form determinant and inverse of the fixed-size matrix
+                        const f64 detJ = J.determinant();
+                        isValid = isValid && (detJ > 0.);
+                        Jinv = J.inverse();
+                        G    = detJ * Jinv * Jinv.transpose();
+
+                        metrics(row, 0) = detJ;
+                        for (u8 a=0; a<Dim; a++) {
+                            for (u8 b=a; b<Dim; b++) metrics(row, metricIndex(Dim, a, b)) = G(a,b);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    CHECK_FATAL_ASSERT(isValid, "Element Jacobian must have a positive determinant")
+}
+
 } // end Mesh
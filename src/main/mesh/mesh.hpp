@@ -3,6 +3,13 @@
 #include "CoreIncludes.hpp"
 #include "polynomials.hpp"
 
+#include <mpi.h>
+#include <array>
+#include <span>
+#include <type_traits>
+
+namespace IO { class RestartReader; class RestartWriter; }
+
 /************************************************************************************************************************ 
  *  @brief Any mesh-related functions/classes are represented in this namespace.
  * 
@@ -44,29 +51,76 @@ class MasterElement{
          *  @brief Sets the corresponding variable's FEM space to LGL-Lagrange polynomials
          * 
          *  @details
-         *  Uses Halley's method to calculate LGL nodes and weights.
+         *  Orders up to LGL_TABLE_MAX_ORDER are copied from compile-time tables (lglTables.hpp), higher orders fall back to
+         *  Halley's method to calculate LGL nodes and weights.
          *  Adopted from <a href="https://colab.research.google.com/github/caiociardelli/sphglltools/blob/main/doc/L3_Gauss_Lobatto_Legendre_quadrature.ipynb#scrollTo=Yi60qASPO7tg">here</a>.
          * 
          *  @param Var        Variable who's space is to be set.
-         *  @param ...        Variadic argument of the LGL-Lagrange polynomial orders used in the tensorgrid.
-	 *                    The total number of variadic arguments must must match nDims. Order is x,y,z, ... 
-         *                    Should be a u8, but variadic argument promotes it to i32. So make sure it is u8 as input. 
+         *  @param orders     LGL-Lagrange polynomial orders used in the tensorgrid, order is x,y,z. At least nDims orders
+         *                    must be given, only the first nDims are read.
          *  @return None
          ************************************************************************************************************************/ 
-	void setLGLOrder(u8 Var, ...);
+        void setLGLOrders(u8 Var, std::span<const u8> orders);
+
+        /**< Sets the LGL-Lagrange polynomial orders of variable Var from a list of integral orders, e.g. setLGLOrder(0, 7, 7, 7) */
+        template<typename... Orders>
+        void setLGLOrder(u8 Var, Orders... orders) {
+            static_assert(sizeof...(Orders) > 0 && sizeof...(Orders) <= 3, "Between one and three polynomial orders are expected");
+            static_assert((std::is_integral_v<Orders> && ...), "Polynomial orders must be integral");
+            CHECK_FATAL_ASSERT(((orders > 0 && orders < 255) && ...), "Polynomial order must be between 0 and 255")
+            const std::array<u8, sizeof...(Orders)> list = {static_cast<u8>(orders)...};
+            setLGLOrders(Var, list);
+        }
 	
         /**< Sets the Gauss-Lagrange polynomial order TODO: implement, used for pressure in a ((P_n^u)^3 U (P_{n-2}^p)) space scheme for NS*/
         void setGaussOrder(u8 Var, ...);
 
-        // TMP //
+        /************************************************************************************************************************ 
+         *  @brief Returns the LGL polynomial order of variable \p Var along axis \p axis.
+         ************************************************************************************************************************/ 
+        u8 getPolyOrder(u8 Var, u8 axis) const;
+
+        /**< Returns the number of dimensions of the master element */
+        u8 getnDims() const { return nDims; }
 
-        EigenDefs::Array1D<f64> TMP1(u8 Var) {
-            return weights[Var];
-        }
+        /**< Returns the number of variables handled by the master element */
+        u8 getnVars() const { return nVars; }
 
-        EigenDefs::Array1D<f64> TMP2(u8 Var) {
-            return nodes[Var];
-        }
+        /************************************************************************************************************************ 
+         *  @brief Returns the nodal first-derivative matrix of variable \p Var along axis \p axis.
+         * 
+         *  @details
+         *  Entry (i,j) holds the derivative of the j-th Lagrange polynomial evaluated at the i-th LGL node, i.e. 
+         *  D(i,j) = l'_j(xi_i). Applying D to a vector of nodal values returns the derivative at the nodes. Cached once
+         *  per variable and axis in setLGLOrder.
+         * 
+         *  @param Var        Variable who's derivative matrix is requested.
+         *  @param axis       Axis (x,y,z -> 0,1,2) of the tensor-grid.
+         * 
+         *  @return Dense (n x n) matrix, where n = polyOrder+1.
+         ************************************************************************************************************************/ 
+        const EigenDefs::Matrix<f64>& d1LagrangeMatrix(u8 Var, u8 axis) const;
+
+        /************************************************************************************************************************ 
+         *  @brief Returns the matrix that interpolates nodal values of variable \p Var along axis \p axis to the points \p xi.
+         * 
+         *  @details
+         *  Entry (i,j) holds the j-th Lagrange polynomial evaluated at xi_i, computed with the (second) barycentric formula
+         *  and the cached barycentric weights. Points coinciding with a node return the corresponding unit row.
+         * 
+         *  @param Var        Variable who's interpolation matrix is requested.
+         *  @param axis       Axis (x,y,z -> 0,1,2) of the tensor-grid.
+         *  @param xi         Reference coordinates in [-1,1] to interpolate to.
+         * 
+         *  @return Dense (m x n) matrix, where m = xi.size() and n = polyOrder+1.
+         ************************************************************************************************************************/ 
+        EigenDefs::Matrix<f64> lagrangeMatrix(u8 Var, u8 axis, const Eigen::Ref<const EigenDefs::Array1D<f64>>& xi) const;
+
+        /**< Returns the LGL quadrature weights of variable Var along axis, a view of the stored array */
+        const EigenDefs::Array1D<f64>& getWeights(u8 Var, u8 axis = 0) const;
+
+        /**< Returns the LGL nodes of variable Var along axis, a view of the stored array */
+        const EigenDefs::Array1D<f64>& getNodes(u8 Var, u8 axis = 0) const;
 
         // ---------------- //
         // member variables //
@@ -74,15 +128,40 @@ class MasterElement{
 
     private:
 
+        friend class IO::RestartReader;
+        friend class IO::RestartWriter;
+
+        // ---------------- //
+        // member functions //
+        // ---------------- // 
+
+        /************************************************************************************************************************ 
+         *  @brief Runtime fallback for orders without a compile-time table (see lglTables.hpp).
+         * 
+         *  @details
+         *  Uses Halley's method to calculate the LGL nodes and weights, then builds the barycentric weights and the nodal
+         *  derivative matrix D(i,j) = l'_j(xi_i).
+         * 
+         *  @param polyOrder  LGL polynomial order.
+         *  @param x          Output, nodes.
+         *  @param w          Output, weights.
+         *  @param lambda     Output, barycentric weights.
+         *  @param D          Output, nodal derivative matrix.
+         * 
+         *  @return None
+         ************************************************************************************************************************/ 
+        static void computeLGL(u8 polyOrder, EigenDefs::Array1D<f64>& x, EigenDefs::Array1D<f64>& w,
+                               EigenDefs::Array1D<f64>& lambda, EigenDefs::Matrix<f64>& D);
+
         // ---------------- //
         // member variables //
         // ---------------- // 
         u8 nVars, nDims;
-	std::vector<EigenDefs::Array1D<f64>> weights;                    /**< Master element weights for reference quadrature */
-        std::vector<EigenDefs::Array1D<f64>> nodes;                      /**< Master element nodes for reference quadrature */
-        std::vector<std::vector<Polynomials::PolyInterp1D>>   lagrange;  /**< Lagrange functions that fit through master element nodes, access is lagrange[Var][nPoly] */
-        std::vector<std::vector<Polynomials::PolyInterp1D>> d1lagrange;  /**< Lagrange functions that fit through master element nodes, access is d1lagrange[Var][nPoly] */
-	std::vector<std::vector<u8>> polyOrders;
+        std::vector<std::vector<EigenDefs::Array1D<f64>>> weights;                  /**< Master element weights for reference quadrature, access is weights[Var][axis] */
+        std::vector<std::vector<EigenDefs::Array1D<f64>>> nodes;                    /**< Master element nodes for reference quadrature, access is nodes[Var][axis] */
+        std::vector<std::vector<EigenDefs::Array1D<f64>>> baryWeights;              /**< Barycentric weights of the Lagrange functions through the nodes, access is baryWeights[Var][axis] */
+        std::vector<std::vector<EigenDefs::Matrix<f64>>>  d1lagrange;               /**< Nodal derivative matrices of the Lagrange functions, access is d1lagrange[Var][axis] */
+        std::vector<std::vector<u8>> polyOrders;                                    /**< Polynomial orders, access is polyOrders[Var][axis] */
 };
 
 
@@ -94,17 +173,16 @@ class Geometry{
         // member functions //
         // ---------------- // 
 
-        /**< 1D grid */
+        /**< 1D grid, the element endpoints are moved into xe (pass an rvalue to avoid the copy) */
         Geometry(EigenDefs::Array1D<f64> x1);
 		
-        /**< 2D tensor-grid TODO*/
+        /**< 2D tensor-grid, the element endpoints are moved into xe */
         Geometry(EigenDefs::Array1D<f64> x1, EigenDefs::Array1D<f64> x2);
 
-        /**< 3D tensor-grid TODO*/
+        /**< 3D tensor-grid, the element endpoints are moved into xe */
         Geometry(EigenDefs::Array1D<f64> x1, EigenDefs::Array1D<f64> x2, EigenDefs::Array1D<f64> x3);
         
-        /**< TODO */
-        // Geometry(FILE)
+        /**< Geometries of a restart file are restored by IO::RestartReader::geometry */
 
         /**< Disabled construction using another Geometry */
         Geometry(const Geometry&) = delete;
@@ -112,18 +190,131 @@ class Geometry{
         /**< Disabled construction by equating to another Geometry */
         Geometry& operator =(const Geometry&) = delete;
 
+        /**< Releases the Cartesian communicator, if any */
+        ~Geometry();
+
+        /************************************************************************************************************************ 
+         *  @brief Partitions the tensor grid into a Cartesian block decomposition over the ranks of \p comm_.
+         * 
+         *  @details
+         *  The process grid is chosen by MPI_Dims_create and every axis' element list is split into contiguous, balanced
+         *  ranges. Each rank keeps the element endpoints of the whole grid (1D lists only), but works on its own block of
+         *  elements. Neighbouring blocks, including edge and corner neighbours, are listed so that nodes on the block
+         *  interfaces can be summed with a single halo exchange. The local elements are split into interface elements, which
+         *  touch a neighbouring block, and interior elements, which do not. Both sets are further split into 2^nDims colors
+         *  (by the parity of the element index along each axis) such that no two elements of one color share a node.
+         *  Must be called before @ref setMetrics, as general metrics are stored per local element.
+         * 
+         *  @param comm_      Communicator to distribute the grid over.
+         * 
+         *  @return None
+         ************************************************************************************************************************/ 
+        void decompose(MPI_Comm comm_);
+
+        /************************************************************************************************************************ 
+         *  @brief Returns the total number of elements in the geometry.
+         ************************************************************************************************************************/ 
+        u64 nElemsTotal() const;
+
+        /************************************************************************************************************************ 
+         *  @brief Splits a lexicographic element index into its per-axis element indices.
+         * 
+         *  @details
+         *  Elements are numbered with x1 running fastest, then x2, then x3. Unused axes are set to 0.
+         * 
+         *  @param elem       Lexicographic element index.
+         *  @param elemAxis   Output, per-axis element indices (size 3).
+         * 
+         *  @return None
+         ************************************************************************************************************************/ 
+        void elemIndex(u64 elem, u64 elemAxis[3]) const;
+
+        /**< Returns the number of elements in the block of this rank */
+        u64 nElemsLocal() const;
+
+        /**< Splits a lexicographic local element index (x1 running fastest within the block) into global per-axis element indices */
+        void localElemIndex(u64 elem, u64 elemAxis[3]) const;
+
+        /**< Returns the first element along axis of the block at process coordinate coord */
+        u64 partitionBegin(u8 axis, i32 coord) const;
+
+        /**< Returns the process coordinate along axis of the block holding element elemAxis */
+        i32 partitionOwner(u8 axis, u64 elemAxis) const;
+
+        /**< Returns the rank in comm of the block at process coordinates coords (size 3, unused axes are 0) */
+        i32 procRank(const i32 coords[3]) const;
+
+        /************************************************************************************************************************ 
+         *  @brief Replaces the tensor-grid metrics by general (e.g. curved) element metrics given per quadrature point.
+         * 
+         *  @details
+         *  The Jacobians dx/dxi are reduced to det(J) and the symmetric metric G = det(J) J^{-1} J^{-T} and stored in one
+         *  contiguous structure-of-arrays buffer, see @ref metrics. The geometry is no longer treated as Cartesian and its
+         *  @ref revision is incremented, which invalidates the operators cached by the integrators on it.
+         *  The buffer is first written by the threads that later work on each element (same colors and static schedule as
+         *  the element loops), so that its pages are placed on their NUMA node.
+         * 
+         *  @param nQuad_     Number of quadrature points per element.
+         *  @param jac        Jacobians, (nElemsLocal()*nQuad_ x nDims*nDims) array, row elem*nQuad_+q holds the column-major 
+         *                    entries of dx/dxi at quadrature point q of local element elem.
+         * 
+         *  @return None
+         ************************************************************************************************************************/ 
+        void setMetrics(u64 nQuad_, const Eigen::Ref<const EigenDefs::Array2D<f64>>& jac);
+
+        /**< Column of the metric term G(a,b) in @ref metrics, column 0 holds det(J) */
+        u8 metricIndex(u8 a, u8 b) const { return metricIndex(nDims, a, b); }
+
+        /**< Column of the metric term G(a,b) of an nDims_-dimensional geometry, usable in constant expressions */
+        static constexpr u8 metricIndex(u8 nDims_, u8 a, u8 b) {
+            if (a > b) { const u8 c = a; a = b; b = c; }
+            // Upper triangle, row by row, after det(J)
+            return 1 + a*nDims_ - a*(a-1)/2 + (b-a);
+        }
+
+        /**< Number of metric terms per quadrature point, det(J) and the upper triangle of G */
+        u8 nMetricTerms() const { return 1 + nDims*(nDims+1)/2; }
+
         // ---------------- //
         // member variables //
         // ---------------- // 
 
-        std::vector<EigenDefs::Matrix<f64>> dx_dxi;
-        std::vector<u64> nElems;
+        std::vector<EigenDefs::Array1D<f64>> xe;          /**< Element endpoints per axis, access is xe[axis][nElem] */
+        std::vector<EigenDefs::Array1D<f64>> halfWidths;  /**< Tensor-grid Jacobians dx/dxi = h/2 per axis, access is halfWidths[axis][nElem] */
+        EigenDefs::Array2D<f64> metrics;                  /**< General metrics (SoA), access is metrics(localElem*nQuad+q, term), empty for tensor grids */
+        u64 nQuad;                                        /**< Quadrature points per element of the general metrics */
+        b8  isCartesian;                                  /**< TRUE if the metrics are fully described by halfWidths */
+        u64 revision;                                     /**< Incremented by every change of the metrics, lets dependent caches detect it */
+        std::vector<u64> nElems;                          /**< Number of elements per axis */
         u8  nVars;
         u8  nDims;
         Mesh::MasterElement MasterElement;
 
+        // domain decomposition
+        MPI_Comm comm;                                    /**< Cartesian communicator of the decomposition, MPI_COMM_SELF if not decomposed */
+        i32 procDims[3];                                  /**< Number of blocks per axis */
+        i32 procCoords[3];                                /**< Block coordinates of this rank */
+        std::vector<u64> elemBegin;                       /**< First element of this rank's block per axis (size 3) */
+        std::vector<u64> elemEnd;                         /**< One past the last element of this rank's block per axis (size 3) */
+        std::vector<i32> neighbourRanks;                  /**< Ranks of all face, edge and corner neighbouring blocks */
+        std::vector<std::array<i32,3>> neighbourOffsets;  /**< Block coordinate offset (-1, 0 or 1 per axis) of each neighbour */
+        std::vector<std::vector<u64>> interfaceColors;    /**< Local elements touching a neighbouring block, access is interfaceColors[color][n] */
+        std::vector<std::vector<u64>> interiorColors;     /**< Local elements not touching a neighbouring block, access is interiorColors[color][n] */
+
     private:
 
+        /**< Fills in the block ranges, neighbours and interface/interior element lists from procDims and procCoords */
+        void setPartition();
+
+        std::vector<i32> procRanks;                       /**< Rank per block, access is procRanks[c0 + procDims[0]*(c1 + procDims[1]*c2)] */
+
+        /**< Fills in the element list and per-axis Jacobians from the endpoints stored in xe */
+        void setTensorGrid();
+
+        /**< setMetrics with compile-time dimension, J and G are fixed-size (Dim x Dim) matrices */
+        template<u8 Dim>
+        void setMetricsFixed(const Eigen::Ref<const EigenDefs::Array2D<f64>>& jac);
+
 };
 
 } // end Mesh
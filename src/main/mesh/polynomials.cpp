@@ -47,9 +47,44 @@ f64 d3Legendre(u8 n, f64 xi) {
     return tmp;
 }
 
-PolyInterp1D::PolyInterp1D(EigenDefs::Array1D<f64> X, EigenDefs::Array1D<f64> Y) {
+void fusedLegendre(u8 n, const Eigen::Ref<const EigenDefs::Array1D<f64>>& xi, EigenDefs::Array1D<f64>& P, EigenDefs::Array1D<f64>& d1P,
+                   EigenDefs::Array1D<f64>& d2P, EigenDefs::Array1D<f64>& d3P) {
+
+    const i64 m = xi.rows();
+    if (n == 0) {
+        P   = EigenDefs::Array1D<f64>::Ones(m);
+        d1P = EigenDefs::Array1D<f64>::Zero(m);
+        d2P = EigenDefs::Array1D<f64>::Zero(m);
+        d3P = EigenDefs::Array1D<f64>::Zero(m);
+        return;
+    }
+
+    // Current (k) and previous (k-1) terms, starting from k = 1
+    P   = xi;
+    d1P = EigenDefs::Array1D<f64>::Ones(m);
+    d2P = EigenDefs::Array1D<f64>::Zero(m);
+    d3P = EigenDefs::Array1D<f64>::Zero(m);
+    EigenDefs::Array1D<f64> fP   = EigenDefs::Array1D<f64>::Ones(m);
+    EigenDefs::Array1D<f64> fd1P = EigenDefs::Array1D<f64>::Zero(m);
+    EigenDefs::Array1D<f64> fd2P = EigenDefs::Array1D<f64>::Zero(m);
+    EigenDefs::Array1D<f64> fd3P = EigenDefs::Array1D<f64>::Zero(m);
+
+    for (u8 k=1; k<n; k++) {
+        // Highest derivative first, each update reads the (still current) lower derivative. swap() only swaps pointers.
+        fd3P += (2*k+1)*d2P;                     d3P.swap(fd3P);
+        fd2P += (2*k+1)*d1P;                     d2P.swap(fd2P);
+        fd1P += (2*k+1)*P;                       d1P.swap(fd1P);
+        fP    = ((2*k+1)*xi*P - k*fP) / (k+1);   P.swap(fP);
+    }
+    TRACE_MSG("fusedLegendre : passed recurrence, n = %i, %lli points", n, m)
+}
+
+PolyInterp1D::PolyInterp1D(const Eigen::Ref<const EigenDefs::Array1D<f64>>& X, const Eigen::Ref<const EigenDefs::Array1D<f64>>& Y) {
+
+    PROFILE_SCOPE("PolyInterp1D.fit")
 
     CHECK_FATAL_ASSERT(X.rows() == Y.rows(), "inputs should have matching dimensions.")
+    CHECK_FATAL_ASSERT(X.rows() > 0, "At least one interpolating value is required")
     CHECK_FATAL_ASSERT(X.rows() < 256, "Number of interpolating values too high")
     if (X.rows() > 8) WARN_MSG("PolyInterp1D(X,Y) : Unknown whether Vandermonde matrix will have issues due to repeated exponentiation with X.size() = %i elements.", X.rows())
 
@@ -95,7 +130,9 @@ PolyInterp1D::PolyInterp1D(EigenDefs::Array1D<f64> X, EigenDefs::Array1D<f64> Y)
     #endif
 }
 
-PolyInterp1D::PolyInterp1D(EigenDefs::Array1D<f64> coeffs_) : coeffs(coeffs_) {
+PolyInterp1D::PolyInterp1D(EigenDefs::Array1D<f64> coeffs_) : coeffs(std::move(coeffs_)) {
+
+    CHECK_FATAL_ASSERT(coeffs.rows() > 0, "A polynomial requires at least one coefficient")
     #if RELEASE == 0
     std::stringstream printArr;
     printArr << std::fixed << std::setprecision( 4 );
@@ -106,31 +143,59 @@ PolyInterp1D::PolyInterp1D(EigenDefs::Array1D<f64> coeffs_) : coeffs(coeffs_) {
     #endif
 }
 
-// TODO: Add assertions, debug + trace messages
-EigenDefs::Array1D<f64> PolyInterp1D::operator()(EigenDefs::Array1D<f64> X) {
+EigenDefs::Array1D<f64> PolyInterp1D::operator()(const Eigen::Ref<const EigenDefs::Array1D<f64>>& X) const {
     
-    EigenDefs::Array1D<f64> out = EigenDefs::Array1D<f64>::Zero(X.rows());
-    
-    for (u8 i=0; i<coeffs.rows(); i++){
-        out += coeffs[i]*X.pow(i);
-    }
-
+    EigenDefs::Array1D<f64> out(X.rows());
+    evaluate(X, out);
     return out;
 }
 
-// TODO: Add assertions, debug + trace messages
-f64 PolyInterp1D::operator()(f64 X) {
-    
-    f64 out = 0;
+f64 PolyInterp1D::operator()(f64 X) const {
     
-    for (u8 i=0; i<coeffs.rows(); i++){
-        out += coeffs[i]*std::pow(X,i);
+    f64 out = coeffs[coeffs.rows()-1];
+    for (i64 i=coeffs.rows()-2; i>=0; i--){
+        out = out*X + coeffs[i];
     }
-    
     return out;
 }
 
-PolyInterp1D PolyInterp1D::derivative() {
+void PolyInterp1D::evaluate(const Eigen::Ref<const EigenDefs::Array1D<f64>>& X, Eigen::Ref<EigenDefs::Array1D<f64>> out) const {
+
+    CHECK_FATAL_ASSERT(X.rows() == out.rows(), "inputs should have matching dimensions.")
+    ASSERT_NO_ALLOCATION("PolyInterp1D.evaluate")
+
+    out.setConstant(coeffs[coeffs.rows()-1]);
+    for (i64 i=coeffs.rows()-2; i>=0; i--){
+        out = out*X + coeffs[i];
+    }
+}
+
+void PolyInterp1D::evaluateBatch(const std::vector<PolyInterp1D>& polys, const Eigen::Ref<const EigenDefs::Array1D<f64>>& X,
+                                 Eigen::Ref<EigenDefs::Array2D<f64>> out) {
+
+    PROFILE_SCOPE("PolyInterp1D.evaluateBatch")
+
+    CHECK_FATAL_ASSERT(out.rows() == X.rows(),     "output rows should match the number of positions.")
+    CHECK_FATAL_ASSERT(static_cast<u64>(out.cols()) == polys.size(), "output columns should match the number of polynomials.")
+
+    i64 nCoeffs = 0;
+    for (const PolyInterp1D& poly : polys) nCoeffs = std::max<i64>(nCoeffs, poly.coeffs.rows());
+
+    // Horner over the highest degree present, missing coefficients are zero
+    {
+        ASSERT_NO_ALLOCATION("PolyInterp1D.evaluateBatch")
+        out.setZero();
+        for (i64 i=nCoeffs-1; i>=0; i--){
+            out.colwise() *= X;
+            for (u64 k=0; k<polys.size(); k++) {
+                if (i < polys[k].coeffs.rows()) out.col(k) += polys[k].coeffs[i];
+            }
+        }
+    }
+    TRACE_MSG("PolyInterp1D.evaluateBatch : passed Horner scheme, %lli positions, %llu polynomials", X.rows(), polys.size())
+}
+
+PolyInterp1D PolyInterp1D::derivative() const {
 
     if (coeffs.rows() == 1) {
 	TRACE_MSG("PolyInterp1D.derivative : return 0")
@@ -146,7 +211,7 @@ PolyInterp1D PolyInterp1D::derivative() {
             derivCoeffs[i-1] = coeffs[i]*i;
         };
         TRACE_MSG("PolyInterp1D.derivative : passed coefficient determination") 
-        return PolyInterp1D(derivCoeffs);
+        return PolyInterp1D(std::move(derivCoeffs));
     }
 }
 
@@ -62,7 +62,27 @@ f64  d2Legendre(u8 n, f64 xi);
  ************************************************************************************************************************/ 
 f64  d3Legendre(u8 n, f64 xi);
 
-/************************************************************************************************************************ 
+/************************************************************************************************************************
+ *  @brief Evaluates the n-th Legendre polynomial and its first three derivatives at an array of locations in one pass.
+ *
+ *  @details
+ *  A single Bonnet recurrence carries P_k and its derivatives along, using P'_{k+1} = P'_{k-1} + (2k+1) P_k (and the same
+ *  relation for the higher derivatives). This avoids the repeated recurrences of d1/d2/d3Legendre, has no 1/(1-xi^2)
+ *  singularity at the endpoints, and every step is an array operation over all locations at once.
+ *
+ *  @param n       legendre polynomial order.
+ *  @param xi      positions to evaluate at.
+ *  @param P       Output, P_n(xi), resized to xi.size().
+ *  @param d1P     Output, first derivative at xi, resized to xi.size().
+ *  @param d2P     Output, second derivative at xi, resized to xi.size().
+ *  @param d3P     Output, third derivative at xi, resized to xi.size().
+ *
+ *  @return None
+ ************************************************************************************************************************/
+void fusedLegendre(u8 n, const Eigen::Ref<const EigenDefs::Array1D<f64>>& xi, EigenDefs::Array1D<f64>& P, EigenDefs::Array1D<f64>& d1P,
+                   EigenDefs::Array1D<f64>& d2P, EigenDefs::Array1D<f64>& d3P);
+
+/************************************************************************************************************************
  *  @brief An interpolating polynomial that goes through a set of given points.
  * 
  *  @details
@@ -76,18 +96,49 @@ class PolyInterp1D{
         // member functions //
         // ---------------- // 
 
-        /**< Default construction that takes in an X and Y array and fits a polynomial through it */
-        PolyInterp1D(EigenDefs::Array1D<f64> X, EigenDefs::Array1D<f64> Y);
+        /**< Default construction that takes in views of an X and Y array and fits a polynomial through it */
+        PolyInterp1D(const Eigen::Ref<const EigenDefs::Array1D<f64>>& X, const Eigen::Ref<const EigenDefs::Array1D<f64>>& Y);
 	    
         /**< Default construction that takes in an array of coefficients C. First element of C is attached to x^0, and 
-          *  last element is attached to x^{n-1}, where n is the size of the array. */
-        PolyInterp1D(EigenDefs::Array1D<f64> coeffs_);
+          *  last element is attached to x^{n-1}, where n is the size of the array. The coefficients are moved in. */
+        explicit PolyInterp1D(EigenDefs::Array1D<f64> coeffs_);
 
-        /**< Overloading call operator -> Array of X positions, returns interpolated polynomial values at those X locations */
-        EigenDefs::Array1D<f64> operator()(EigenDefs::Array1D<f64> X);
+        /**< Overloading call operator -> Array of X positions, returns interpolated polynomial values at those X locations.
+          *  Allocates the result, use @ref evaluate to write into an existing array */
+        EigenDefs::Array1D<f64> operator()(const Eigen::Ref<const EigenDefs::Array1D<f64>>& X) const;
 
         /**< Overloading call operator -> X position, returns interpolated polynomial value at X */
-        f64 operator()(f64 X);
+        f64 operator()(f64 X) const;
+
+        /************************************************************************************************************************ 
+         *  @brief Evaluates the polynomial at the positions \p X into a caller-provided array.
+         * 
+         *  @details
+         *  Uses Horner's scheme, out = (...(c_{n-1} X + c_{n-2}) X + ...) X + c_0, as whole-array operations so that the
+         *  points are vectorized. Performs no heap allocation.
+         * 
+         *  @param X          Positions to evaluate at.
+         *  @param out        Output, polynomial values at X. Must have the same size as X.
+         * 
+         *  @return None
+         ************************************************************************************************************************/ 
+        void evaluate(const Eigen::Ref<const EigenDefs::Array1D<f64>>& X, Eigen::Ref<EigenDefs::Array1D<f64>> out) const;
+
+        /************************************************************************************************************************ 
+         *  @brief Evaluates a set of polynomials at the same positions \p X in a single Horner pass.
+         * 
+         *  @details
+         *  Column k of \p out holds polys[k](X). Shorter polynomials are treated as zero-padded, so each Horner step sweeps
+         *  all points and all polynomials once. Performs no heap allocation.
+         * 
+         *  @param polys      Polynomials to evaluate.
+         *  @param X          Positions to evaluate at.
+         *  @param out        Output, (X.size() x polys.size()) array of polynomial values.
+         * 
+         *  @return None
+         ************************************************************************************************************************/ 
+        static void evaluateBatch(const std::vector<PolyInterp1D>& polys, const Eigen::Ref<const EigenDefs::Array1D<f64>>& X,
+                                  Eigen::Ref<EigenDefs::Array2D<f64>> out);
 
         /************************************************************************************************************************ 
          *  @brief Returns the derivative of the polynomial as another PolyInterp1D object.
@@ -97,7 +148,7 @@ class PolyInterp1D{
          * 
          *  @return PolyInterp1D using the derivative's coefficients.
          ************************************************************************************************************************/ 
-        PolyInterp1D derivative();
+        PolyInterp1D derivative() const;
 
         // ---------------- //
         // member variables //
@@ -1,21 +1,739 @@
+#pragma once
 
 #include "CoreIncludes.hpp"
 #include "mesh.hpp"
 
+#include <mpi.h>
+#include <functional>
+#include "HYPRE.h"
+#include "HYPRE_parcsr_ls.h"
+
+namespace IO { class SolutionWriter; class SnapshotArchive; class RestartReader; class RestartWriter; }
+
+/************************************************************************************************************************
+ *  @brief Any physics-related functions/classes are represented in this namespace.
+ *
+ *  @details
+ *  This namespace serves to identify any-and-all operations related to the governing equations. In the FEM-sense, this
+ *  includes the element integrals over the interior (Omega) and boundary (dOmega) and their global assembly.
+ ************************************************************************************************************************/
 namespace Physics {
 
+/** Pointwise function of the physical coordinates, f(x,y,z). Unused coordinates are passed as 0. */
+using PointFunction = f64 (*)(f64 x, f64 y, f64 z);
+
+/**< Exact solution and its gradient, compared against in Integrator::errorOmega */
+struct ExactSolution{
+    PointFunction u;                    /**< u(x,y,z) */
+    PointFunction du[3];                /**< du/dx1, du/dx2, du/dx3, unused axes may be nullptr */
+};
+
+/**< Norms of the difference between a discrete and an exact solution */
+struct ErrorNorms{
+    f64 L2;                             /**< ||u_h - u||_L2 */
+    f64 H1semi;                         /**< |u_h - u|_H1 = ||grad(u_h - u)||_L2 */
+    f64 H1;                             /**< ||u_h - u||_H1 = sqrt(L2^2 + H1semi^2) */
+};
+
+/* list of Krylov solvers available for the assembled system */
+typedef enum krylovType{
+    KRYLOV_PCG   = 0, /**< preconditioned conjugate gradient, symmetric positive definite systems */
+    KRYLOV_GMRES = 1, /**< restarted GMRES, general systems */
+} krylovType;
+
+/************************************************************************************************************************
+ *  @brief Parameters of the hypre Krylov solver and its BoomerAMG preconditioner.
+ *
+ *  @details
+ *  The defaults are a reasonable starting point for 2D/3D diffusion: PMIS coarsening with extended+i interpolation and
+ *  l1-scaled symmetric Gauss-Seidel smoothing, so that the preconditioner stays symmetric for PCG. See the BoomerAMG
+ *  reference manual for the meaning of the integer codes.
+ ************************************************************************************************************************/
+struct SolverParameters{
+    krylovType krylov     = KRYLOV_PCG; /**< Krylov method */
+    f64  tol              = 1e-10;      /**< relative residual tolerance */
+    i32  maxIter          = 1000;       /**< maximum number of Krylov iterations */
+    i32  kDim             = 50;         /**< GMRES restart length */
+    i32  printLevel       = 0;          /**< hypre Krylov print level */
+
+    i32  amgCoarsenType   = 8;          /**< BoomerAMG coarsening, 8 = PMIS */
+    i32  amgInterpType    = 6;          /**< BoomerAMG interpolation, 6 = extended+i */
+    i32  amgRelaxType     = 8;          /**< BoomerAMG smoother, 8 = l1-scaled symmetric Gauss-Seidel */
+    i32  amgNumSweeps     = 1;          /**< BoomerAMG smoother sweeps per level */
+    i32  amgAggNumLevels  = 0;          /**< BoomerAMG levels of aggressive coarsening */
+    i32  amgMaxLevels     = 25;         /**< BoomerAMG maximum number of levels */
+    f64  amgStrongThresh  = 0.5;        /**< BoomerAMG strength threshold, 0.25 in 2D and 0.5 in 3D are typical */
+    i32  amgPrintLevel    = 0;          /**< BoomerAMG print level */
+
+    b8   staticCondensation = FALSE;    /**< eliminate the element-interior nodes before the global solve, see Integrator::assemble */
+
+    i32  chebyshevDegree  = 3;          /**< p-multigrid Chebyshev-Jacobi smoother degree, per pre- and post-smoothing */
+    f64  chebyshevRange   = 20.;        /**< p-multigrid smoothed eigenvalue range of D^{-1}A, [lambdaMax/range, lambdaMax] */
+    i32  lanczosIterations = 12;        /**< p-multigrid Lanczos steps estimating lambdaMax of D^{-1}A per level */
+
+    /**< Member-wise comparison, a change of parameters discards the cached solvers */
+    bool operator ==(const SolverParameters&) const = default;
+};
+
+class PMultigrid;
+class Transient;
+
 class Integrator {
-    
+
     public:
 
-        Integrator();
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /************************************************************************************************************************
+         *  @brief Sets up the integrator on an existing geometry.
+         *
+         *  @details
+         *  The geometry's MasterElement must have its variables and polynomial orders set before construction, as the 1D
+         *  operators (nodal derivative matrices and quadrature weights) are cached here per variable and axis.
+         *  The geometry is held by reference and must outlive the integrator. If the geometry is decomposed (see
+         *  Mesh::Geometry::decompose), it must be decomposed before construction: every rank then works on the nodes of its
+         *  own block of elements and the halo maps of the shared interface nodes are built here.
+         *
+         *  @param geometry_  Geometry on which the element integrals are evaluated.
+         ************************************************************************************************************************/
+        Integrator(Mesh::Geometry& geometry_);
+
+        /************************************************************************************************************************
+         *  @brief Sets up the integrator on an existing geometry, with the variables and orders of another master element.
+         *
+         *  @details
+         *  Same as above, but the 1D operators are taken from \p master_ rather than from the geometry's MasterElement, e.g.
+         *  the lower-order levels of PMultigrid. Both must have the same number of dimensions, general element metrics
+         *  (non-Cartesian geometries) must be given at the nodes of master_. The master element is held by reference.
+         *
+         *  @param geometry_  Geometry on which the element integrals are evaluated.
+         *  @param master_    Master element providing the variables and LGL orders.
+         ************************************************************************************************************************/
+        Integrator(Mesh::Geometry& geometry_, Mesh::MasterElement& master_);
+
+        /**< Releases the hypre objects */
+        ~Integrator();
+
+        /**< Disabled construction using another Integrator */
+        Integrator(const Integrator&) = delete;
+
+        /**< Disabled construction by equating to another Integrator */
+        Integrator& operator =(const Integrator&) = delete;
+
+        /************************************************************************************************************************
+         *  @brief Sets the coefficients of the heat operator, y = massCoeff*M*u + diffCoeff*K*u.
+         *
+         *  @details
+         *  M is the (LGL-lumped) mass matrix and K the stiffness matrix of -div(grad(u)). The defaults (0,1) give the
+         *  Laplacian, while (1,dt) gives the implicit Euler heat operator.
+         *
+         *  @param massCoeff  Coefficient in front of the mass matrix.
+         *  @param diffCoeff  Coefficient in front of the stiffness matrix.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void setHeatCoefficients(f64 massCoeff_, f64 diffCoeff_);
+
+        /************************************************************************************************************************
+         *  @brief Sets the number of threads working on the element loops of this integrator.
+         *
+         *  @details
+         *  Element loops are split into colors of elements sharing no nodes (see Mesh::Geometry::interfaceColors), so that
+         *  the threads scatter into the block vectors without atomics or locks. Each thread allocates and first-touches
+         *  its own element workspace. Defaults to threadCount() at construction.
+         *
+         *  @param nThreads_  Number of threads, must be bigger than 0.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void setnThreads(i32 nThreads_);
+
+        /**< Returns the number of (C0-continuous) degrees of freedom of variable Var in the block of this rank, interface nodes included */
+        u64 nDOFs(u8 Var) const;
+
+        /**< Returns the number of (C0-continuous) degrees of freedom of variable Var over the whole geometry */
+        u64 nGlobalDOFs(u8 Var) const;
+
+        /************************************************************************************************************************
+         *  @brief Applies the heat operator of variable \p Var to \p u without assembling a matrix.
+         *
+         *  @details
+         *  Loops over all local elements, gathers the element nodal values, applies the element operator through tensor-product
+         *  sum factorization and scatter-adds the result. Per element, the derivative along each axis costs
+         *  O(p^{d+1}) instead of the O(p^{2d}) of a dense element matrix.
+         *  On a decomposed geometry, the interface elements are computed first, the halo exchange of the interface nodes is
+         *  posted (MPI_Isend/MPI_Irecv), the interior elements are computed while the messages are in flight and the
+         *  received contributions are added after the wait.
+         *  Variables with the same order along every axis, up to Mesh::LGL_TABLE_MAX_ORDER, are dispatched to a kernel
+         *  templated on (order, nDims) using fixed-size Eigen types, others use the dynamically-sized kernel. General
+         *  (non-Cartesian) elements use a stiffness kernel templated on nDims, with fixed-size metric tensors.
+         *
+         *  @param Var        Variable who's operator is applied.
+         *  @param u          Block vector of nodal values (size nDOFs(Var)), consistent across ranks on interface nodes.
+         *  @param y          Output, block vector holding the operator applied to u (size nDOFs(Var)).
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void applyOmega(u8 Var, const EigenDefs::Vector<f64>& u, EigenDefs::Vector<f64>& y);
+
+        /************************************************************************************************************************
+         *  @brief Applies the heat operator of variable \p Var to k block vectors at once, Y = A U.
+         *
+         *  @details
+         *  Per element, the k nodal tensors are gathered side by side and the sum factorization runs as one matrix product
+         *  per axis over all of them, so that the element geometry and indexing are read once per sweep for all k vectors
+         *  and the 1D operators are applied as matrix-matrix products. The halo exchange sends the k values of every
+         *  interface node in one message per neighbour. Used by the multi-right-hand-side solves.
+         *
+         *  @param Var        Variable who's operator is applied.
+         *  @param U          Block vectors as columns (size nDOFs(Var) x k), consistent across ranks on interface nodes.
+         *  @param Y          Output, operator applied to every column of U (size nDOFs(Var) x k).
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void applyOmega(u8 Var, const EigenDefs::Matrix<f64>& U, EigenDefs::Matrix<f64>& Y);
 
-        Integrator(Mesh::Geometry geometry_);
+        /************************************************************************************************************************
+         *  @brief Adds the (LGL-lumped) source integral int(f phi_i) of variable \p Var to \p b.
+         *
+         *  @param Var        Variable who's source is integrated.
+         *  @param f          Source term f(x,y,z), called concurrently from all threads.
+         *  @param b          Output, block vector the source integral is added to (size nDOFs(Var)).
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void sourceOmega(u8 Var, PointFunction f, EigenDefs::Vector<f64>& b);
+
+        /************************************************************************************************************************
+         *  @brief Computes the diagonal of the heat operator of variable \p Var.
+         *
+         *  @details
+         *  On Cartesian grids the element diagonal factorizes over the axes, diag = c_m det(J) W + c_d det(J) sum_a
+         *  (2/h_a)^2 (D_a^T W D_a)_ii, and costs O(p^d) per element. General elements fall back to the dense element matrix.
+         *
+         *  @param Var        Variable who's operator diagonal is computed.
+         *  @param d          Output, block vector of the diagonal (size nDOFs(Var)), consistent across ranks.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void diagonalOmega(u8 Var, EigenDefs::Vector<f64>& d);
+
+        /************************************************************************************************************************
+         *  @brief Computes the L2 and H1 norms of the error of \p u against an exact solution, collective.
+         *
+         *  @details
+         *  The nodal solution and its derivatives are interpolated per element, by sum factorization, to an LGL rule of
+         *  order p+3 along each axis, so that the error integrals are not polluted by the collocation quadrature of the
+         *  nodes. Requires a Cartesian geometry.
+         *
+         *  @param Var        Variable who's error is computed.
+         *  @param u          Block vector of nodal values (size nDOFs(Var)).
+         *  @param exact      Exact solution and its gradient, called concurrently from all threads.
+         *
+         *  @return Error norms over the whole geometry, on every rank.
+         ************************************************************************************************************************/
+        ErrorNorms errorOmega(u8 Var, const EigenDefs::Vector<f64>& u, const ExactSolution& exact);
+
+        /**< Returns TRUE if block node idx of variable Var lies on the domain boundary */
+        b8 isBoundaryDOF(u8 Var, u64 idx) const;
+
+        /**< Returns the block indices of all nodes of variable Var on the domain boundary, in ascending order */
+        std::vector<u64> boundaryDOFs(u8 Var) const;
+
+        /**< Returns the physical coordinates of block node idx of variable Var (unused axes are 0) */
+        void nodeCoordinates(u8 Var, u64 idx, f64 x[3]) const;
+
+        /************************************************************************************************************************
+         *  @brief Sums the per-rank contributions on the interface nodes of a block vector.
+         *
+         *  @details
+         *  Each rank sends its own values on the nodes it shares with every face, edge and corner neighbour and adds the
+         *  values it receives, so that after the call all ranks holding a node agree on the summed value. Blocking wrapper
+         *  around the halo exchange used by @ref applyOmega.
+         *
+         *  @param Var        Variable who's halo is exchanged.
+         *  @param y          Block vector (size nDOFs(Var)), updated in place.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void sumShared(u8 Var, EigenDefs::Vector<f64>& y);
+
+        /**< Sums the per-rank contributions on the interface nodes of every column of Y (size nDOFs(Var) x k) */
+        void sumShared(u8 Var, EigenDefs::Matrix<f64>& Y);
+
+        /************************************************************************************************************************
+         *  @brief Sets the parameters of the Krylov solver and BoomerAMG preconditioner used by @ref solve.
+         *
+         *  @param params     Solver parameters.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void setSolverParameters(const SolverParameters& params_);
+
+        /************************************************************************************************************************
+         *  @brief Assembles the heat operator and right-hand side of variable \p Var into a distributed hypre IJ system.
+         *
+         *  @details
+         *  Every rank owns the rows of the nodes in its block, minus the upper interface nodes owned by the next block, and
+         *  assembles its own elements, adding into the neighbouring rank's rows on the interfaces. The element matrices are
+         *  built by all threads in batches of one element per thread, each into its own buffer, and the batch is then added
+         *  to hypre by the calling thread.
+         *
+         *  With SolverParameters::staticCondensation, the element-interior nodes (which only couple within their element)
+         *  are eliminated per element and only the skeleton Schur complement, S = A_BB - A_BI A_II^{-1} A_IB, is assembled.
+         *  The Cholesky factors of A_II and A_II^{-1} A_IB are cached per element. @ref solve recovers the interior nodes
+         *  by element-wise back-substitution. The row sizes are preallocated exactly from
+         *  the tensor-grid connectivity. Dirichlet nodes (the whole domain boundary) are eliminated symmetrically, keeping
+         *  the system symmetric positive definite.
+         *
+         *  The operator is cached: later calls for the same variable, heat coefficients, condensation and geometry
+         *  revision only rebuild the right-hand side (the Dirichlet lift is applied matrix-free) and keep the hypre matrix
+         *  together with the Krylov solver and BoomerAMG hierarchy of @ref solve, e.g. over time steps with a fixed dt or
+         *  between forward and adjoint solves. New heat coefficients refill the existing sparsity pattern and row numbering.
+         *
+         *  @param Var        Variable who's system is assembled.
+         *  @param f          Source term f(x,y,z), called concurrently from all threads.
+         *  @param g          Dirichlet boundary value g(x,y,z), called concurrently from all threads.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void assemble(u8 Var, PointFunction f, PointFunction g);
+
+        /************************************************************************************************************************
+         *  @brief Solves the last assembled system with the chosen Krylov method and BoomerAMG.
+         *
+         *  @details
+         *  The Krylov solver and BoomerAMG hierarchy are set up by the first solve of an assembled operator and reused until
+         *  the operator or the solver parameters change.
+         *
+         *  @param u          Output, block solution vector (size nDOFs(Var)), consistent across ranks on interface nodes.
+         *
+         *  @return Number of Krylov iterations.
+         ************************************************************************************************************************/
+        i32 solve(EigenDefs::Vector<f64>& u);
+
+        /************************************************************************************************************************
+         *  @brief Builds the fast diagonalization of the heat operator of variable \p Var on the block of this rank.
+         *
+         *  @details
+         *  On axis-aligned tensor grids the operator is separable, A = c_m (Mz x My x Mx) + c_d (Mz x My x Kx + Mz x Ky x Mx
+         *  + Kz x My x Mx), with the 1D SEM stiffness K_a and (diagonal, LGL-lumped) mass M_a assembled per axis over the
+         *  block. Solving the 1D generalized eigenproblems K_a V_a = M_a V_a Lambda_a once, with V_a^T M_a V_a = I, gives
+         *  A^{-1} = (Vz x Vy x Vx) (c_m + c_d (Lambda_x + Lambda_y + Lambda_z))^{-1} (Vz x Vy x Vx)^T on the nodes strictly
+         *  inside the block. Called by @ref solveFastDiagonalization whenever the heat coefficients or the geometry changed.
+         *
+         *  @param Var        Variable who's operator is diagonalized.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void setupFastDiagonalization(u8 Var);
+
+        /************************************************************************************************************************
+         *  @brief Applies the fast diagonalization inverse of variable \p Var to a residual, z = P r.
+         *
+         *  @details
+         *  The nodes strictly inside the block are solved exactly (homogeneous Dirichlet on the block boundary) through three
+         *  tensor-product transforms per direction, O(N^{(d+1)/d}) work for N block nodes. The block interface nodes shared
+         *  with other ranks are scaled by the inverse operator diagonal, and the domain boundary nodes are set to zero. On a
+         *  single Cartesian block P is the exact inverse, otherwise P is a symmetric block preconditioner.
+         *
+         *  @param Var        Variable who's operator is inverted.
+         *  @param r          Block residual vector (size nDOFs(Var)), consistent across ranks on interface nodes.
+         *  @param z          Output, block vector P r (size nDOFs(Var)), consistent across ranks on interface nodes.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void applyFastDiagonalization(u8 Var, const EigenDefs::Vector<f64>& r, EigenDefs::Vector<f64>& z);
+
+        /**< Applies the fast diagonalization inverse to every column of R (size nDOFs(Var) x k), transforming all at once */
+        void applyFastDiagonalization(u8 Var, const EigenDefs::Matrix<f64>& R, EigenDefs::Matrix<f64>& Z);
+
+        /************************************************************************************************************************
+         *  @brief Solves the heat problem of variable \p Var with the fast diagonalization method, without assembling a matrix.
+         *
+         *  @details
+         *  On a single Cartesian block the fast diagonalization is the exact inverse and the solution is obtained directly,
+         *  without iterations. Otherwise (decomposed geometry, general element metrics) it preconditions a matrix-free
+         *  conjugate gradient on @ref applyOmega, stopped by SolverParameters::tol and SolverParameters::maxIter.
+         *
+         *  @param Var        Variable who's problem is solved.
+         *  @param f          Source term f(x,y,z), called concurrently from all threads.
+         *  @param g          Dirichlet boundary value g(x,y,z).
+         *  @param u          Output, block solution vector (size nDOFs(Var)), consistent across ranks on interface nodes.
+         *
+         *  @return Number of conjugate gradient iterations, 0 for the direct solve.
+         ************************************************************************************************************************/
+        i32 solveFastDiagonalization(u8 Var, PointFunction f, PointFunction g, EigenDefs::Vector<f64>& u);
+
+        /************************************************************************************************************************
+         *  @brief Solves the heat problem of variable \p Var for several sources sharing the boundary values, e.g. a
+         *         parameter sweep over the source term.
+         *
+         *  @details
+         *  Same method as the single source variant, with all k right-hand sides iterated together by a multi-vector
+         *  conjugate gradient: every iteration applies the operator and the preconditioner once to all unconverged
+         *  columns (see the batched @ref applyOmega) and reduces their dot products in one message. Each column keeps its
+         *  own step lengths and converges exactly as it would alone; converged columns leave the block.
+         *
+         *  @param Var        Variable who's problem is solved.
+         *  @param f          Source terms f(x,y,z), one per column of U, called concurrently from all threads.
+         *  @param g          Dirichlet boundary value g(x,y,z), shared by all columns.
+         *  @param U          Output, block solution vectors (size nDOFs(Var) x f.size()), consistent across ranks.
+         *
+         *  @return Number of conjugate gradient iterations of the slowest column, 0 for the direct solve.
+         ************************************************************************************************************************/
+        i32 solveFastDiagonalization(u8 Var, const std::vector<PointFunction>& f, PointFunction g, EigenDefs::Matrix<f64>& U);
 
     private:
 
+        friend class PMultigrid;
+        friend class Transient;
+        friend class IO::SolutionWriter;
+        friend class IO::SnapshotArchive;
+        friend class IO::RestartReader;
+        friend class IO::RestartWriter;
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /************************************************************************************************************************
+         *  @brief Applies a 1D operator along one axis of an element-local tensor (x1 running fastest).
+         *
+         *  @param A          1D operator of size (m x n[axis]), the output has m entries along axis (e.g. interpolation).
+         *  @param axis       Axis along which A is applied.
+         *  @param n          Number of nodes per axis of the local tensor (size 3, unused axes are 1).
+         *  @param in         Pointer to the local input tensor.
+         *  @param out        Pointer to the local output tensor, must not alias in.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        static void tensorApply(const EigenDefs::Matrix<f64>& A, u8 axis, const u64 n[3], const f64* in, f64* out);
+
+        /**< Fixed-size variant of tensorApply, element-local tensor of N^Dim nodes */
+        template<u8 N, u8 Dim, u8 Axis>
+        static void tensorApplyFixed(const Eigen::Matrix<f64, N, N>& A, const f64* in, f64* out);
+
+        /**< Fixed-size variant of tensorApply on nBatch local tensors of N^Dim nodes stored one after the other */
+        template<u8 N, u8 Dim, u8 Axis>
+        static void tensorApplyFixedBatch(const Eigen::Matrix<f64, N, N>& A, u64 nBatch, const f64* in, f64* out);
+
+        /**< Applies tensorApply to nBatch local tensors stored one after the other */
+        static void tensorApplyBatch(const EigenDefs::Matrix<f64>& A, u8 axis, const u64 n[3], u64 nBatch, const f64* in, f64* out);
+
+        /************************************************************************************************************************
+         *  @brief Per-thread arena of the element kernels, handed out as Eigen::Map views.
+         *
+         *  @details
+         *  Views are taken from the front of a single buffer and released by the innermost open Frame, so an element loop
+         *  opens a Frame per element and never touches the heap. The buffer is only grown by reserve, outside of the
+         *  element loops, by the thread that later works on it.
+         ************************************************************************************************************************/
+        class ElementWorkspace{
+
+            public:
+
+                /**< Grows the arena to at least nValues entries, no view may be taken */
+                void reserve(u64 nValues);
+
+                /**< Returns the number of entries of the arena */
+                u64 capacity() const { return storage.size(); }
+
+                /**< Views of the next free entries, valid until the enclosing Frame closes */
+                Eigen::Map<EigenDefs::Array1D<f64>> array(u64 n) { return Eigen::Map<EigenDefs::Array1D<f64>>(take(n), n); }
+                Eigen::Map<EigenDefs::Array2D<f64>> array(u64 rows, u64 cols) {
+                    return Eigen::Map<EigenDefs::Array2D<f64>>(take(rows*cols), rows, cols);
+                }
+                Eigen::Map<EigenDefs::Matrix<f64>> matrix(u64 rows, u64 cols) {
+                    return Eigen::Map<EigenDefs::Matrix<f64>>(take(rows*cols), rows, cols);
+                }
+
+                /**< Releases every view taken during its lifetime */
+                class Frame{
+                    public:
+                        explicit Frame(ElementWorkspace& ws_) : ws(ws_), mark(ws_.used) {}
+                        ~Frame() { ws.used = mark; }
+                        Frame(const Frame&) = delete;
+                        Frame& operator =(const Frame&) = delete;
+                    private:
+                        ElementWorkspace& ws;
+                        u64 mark;
+                };
+
+            private:
+
+                /**< Returns the next n free entries, rounded up to whole cache lines */
+                f64* take(u64 n) {
+                    const u64 nTaken = (n + 7) & ~7ull;
+                    CHECK_FATAL_ASSERT(used + nTaken <= static_cast<u64>(storage.size()), "Element workspace exhausted, reserve more entries")
+                    f64* out = storage.data() + used;
+                    used += nTaken;
+                    return out;
+                }
+
+                EigenDefs::Array1D<f64> storage;
+                u64 used = 0;
+        };
+
+        /**< Arena entries of eight local tensors of nLocal nodes, enough for every kernel but the dense element matrices */
+        static u64 elementWorkspaceSize(u64 nLocal) { return 8*(nLocal+8); }
+
+        /**< Dynamically-sized, threaded element loop of applyOmega over colored local elements, runtime fallback for any order */
+        void applyOmegaDynamic(u8 Var, const std::vector<std::vector<u64>>& colors, const EigenDefs::Vector<f64>& u, 
+                               EigenDefs::Vector<f64>& y);
+
+        /**< Threaded element loop of applyOmega over colored local elements with compile-time order and dimension, see Mesh::LGLTable */
+        template<u8 Order, u8 Dim>
+        void applyOmegaFixed(u8 Var, const std::vector<std::vector<u64>>& colors, const EigenDefs::Vector<f64>& u, 
+                             EigenDefs::Vector<f64>& y);
+
+        /**< Batched applyOmegaFixed, all columns of U per element */
+        template<u8 Order, u8 Dim>
+        void applyOmegaBatchFixed(u8 Var, const std::vector<std::vector<u64>>& colors, const EigenDefs::Matrix<f64>& U, 
+                                  EigenDefs::Matrix<f64>& Y);
+
+        /**< Threaded element loop of the batched applyOmega over colored local elements, runtime fallback for any order */
+        void applyOmegaBatch(u8 Var, const std::vector<std::vector<u64>>& colors, const EigenDefs::Matrix<f64>& U, 
+                             EigenDefs::Matrix<f64>& Y);
+
+        /**< Applies the heat operator of element elem to the local tensor ueIn, writes the local tensor yeOut */
+        void applyElement(u8 Var, u64 elem, const u64 elemAxis[3], const f64* ueIn, f64* yeOut, ElementWorkspace& ws) const;
+
+        /**< Adds the stiffness term of general element elem to yeOut, with compile-time dimension and a fixed-size (Dim x Dim)
+          *  metric tensor per quadrature point */
+        template<u8 Dim>
+        void elementStiffnessGeneral(u8 Var, u64 elem, const f64* ueIn, f64* yeOut, ElementWorkspace& ws) const;
+
+        /**< Writes det(J)*W, the (LGL-lumped) mass matrix diagonal of element elem, to the local tensor out */
+        void elementMassDiagonal(u8 Var, u64 elem, const u64 elemAxis[3], f64* out) const;
+
+        /**< Fills the (nLocal x nLocal) Ae with the dense heat operator of element elem, built column by column from applyElement */
+        void elementMatrix(u8 Var, u64 elem, const u64 elemAxis[3], Eigen::Ref<EigenDefs::Matrix<f64>> Ae, ElementWorkspace& ws) const;
+
+        /**< Resizes y to nDOFs(Var) and zeroes it with a static thread schedule (first touch) */
+        void zeroBlockVector(u8 Var, EigenDefs::Vector<f64>& y) const;
+
+        /**< Returns the block index of local node (i,j,k) of the element at elemAxis */
+        u64 localIndex(u8 Var, const u64 elemAxis[3], u64 i, u64 j, u64 k) const;
+
+        /**< Splits block node idx into global per-axis node indices g (size 3, unused axes are 0) */
+        void globalNode(u8 Var, u64 idx, u64 g[3]) const;
+
+        /**< Returns TRUE if the node at global per-axis indices g lies on the domain boundary */
+        b8 isBoundaryNode(u8 Var, const u64 g[3]) const;
+
+        /**< First global node and number of nodes per axis owned by the block at process coordinates coords */
+        void ownedBox(u8 Var, const i32 coords[3], u64 start[3], u64 count[3]) const;
+
+        /**< Returns the block indices of the nodes owned by this rank, in lexicographic order */
+        std::vector<u64> ownedBlockNodes(u8 Var) const;
+
+        /**< Returns TRUE if the node at global per-axis indices g lies on an element boundary */
+        b8 isSkeletonNode(u8 Var, const u64 g[3]) const;
+
+        /**< Splits the element-local nodes into interior and skeleton lists and invalidates the cached factors if stale */
+        void prepareCondensation(u8 Var);
+
+        /************************************************************************************************************************
+         *  @brief Condenses the interior nodes out of an element matrix, factorizing A_II unless cached.
+         *
+         *  @details
+         *  Requires interior nodes. Only the factorization of an uncached element allocates, the Schur complement is built
+         *  from views of the element workspace.
+         *
+         *  @param elem       Local element index.
+         *  @param Ae         (nLocal x nLocal) element matrix.
+         *  @param S          Output, (nSkeleton x nSkeleton) Schur complement, rows and columns ordered as skeletonLocal.
+         *  @param ws         Element workspace of the calling thread.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void condenseElement(u64 elem, const Eigen::Ref<const EigenDefs::Matrix<f64>>& Ae, Eigen::Ref<EigenDefs::Matrix<f64>> S,
+                             ElementWorkspace& ws);
+
+        /**< Marks the cached element factors valid for the current variable, heat coefficients and geometry revision */
+        void finishCondensation();
+
+        /**< Back-substitutes the interior nodes of every element, u_I = A_II^{-1} (b_I - A_IB u_B) */
+        void recoverInterior(EigenDefs::Vector<f64>& u);
+
+        /**< Sets u to g on the domain boundary and 0 elsewhere, and r to the residual b - A u with zero boundary entries */
+        void liftDirichlet(u8 Var, PointFunction f, PointFunction g, const std::vector<u64>& boundary, 
+                           EigenDefs::Vector<f64>& u, EigenDefs::Vector<f64>& r);
+
+        /************************************************************************************************************************
+         *  @brief Matrix-free preconditioned conjugate gradient on applyOmega with homogeneous Dirichlet conditions.
+         *
+         *  @param Var        Variable who's operator is inverted.
+         *  @param boundary   Block indices of the domain boundary nodes, see boundaryDOFs.
+         *  @param precond    Symmetric preconditioner, precond(r, z) writes z = P r.
+         *  @param u          Initial guess on input, solution on output.
+         *  @param r          Initial residual (zero on the boundary) on input, overwritten.
+         *  @param caller     Name used in the convergence messages.
+         *
+         *  @return Number of iterations.
+         ************************************************************************************************************************/
+        i32 conjugateGradient(u8 Var, const std::vector<u64>& boundary, 
+                              const std::function<void(const EigenDefs::Vector<f64>&, EigenDefs::Vector<f64>&)>& precond,
+                              EigenDefs::Vector<f64>& u, EigenDefs::Vector<f64>& r, const char* caller);
+
+        /**< Returns the dot product of two block vectors over the whole geometry, counting every shared node once */
+        f64 ownedDot(const std::vector<u64>& owned, const EigenDefs::Vector<f64>& a, const EigenDefs::Vector<f64>& b) const;
+
+        /************************************************************************************************************************
+         *  @brief Multi-vector preconditioned conjugate gradient, k independent solves sharing their operator applications.
+         *
+         *  @param Var        Variable who's operator is inverted.
+         *  @param boundary   Block indices of the domain boundary nodes, see boundaryDOFs.
+         *  @param precond    Symmetric preconditioner applied column by column, precond(R, Z) writes Z = P R.
+         *  @param U          Initial guesses as columns on input, solutions on output.
+         *  @param R          Initial residuals (zero on the boundary) as columns on input, overwritten and shrunk.
+         *  @param caller     Name used in the convergence messages.
+         *
+         *  @return Number of iterations of the slowest column.
+         ************************************************************************************************************************/
+        i32 blockConjugateGradient(u8 Var, const std::vector<u64>& boundary, 
+                                   const std::function<void(const EigenDefs::Matrix<f64>&, EigenDefs::Matrix<f64>&)>& precond,
+                                   EigenDefs::Matrix<f64>& U, EigenDefs::Matrix<f64>& R, const char* caller);
+
+        /**< Returns the ownedDot of every pair of columns of A and B, reduced in one message */
+        EigenDefs::Vector<f64> ownedDots(const std::vector<u64>& owned, const EigenDefs::Matrix<f64>& A, 
+                                         const EigenDefs::Matrix<f64>& B) const;
+
+        /**< Packs the interface nodes of y and posts the nonblocking halo sends and receives */
+        void startHaloExchange(u8 Var, const EigenDefs::Vector<f64>& y);
+
+        /**< Waits for the halo exchange posted by startHaloExchange and adds the received contributions to y */
+        void finishHaloExchange(u8 Var, EigenDefs::Vector<f64>& y);
+
+        /**< Batched startHaloExchange, the values of all columns of Y are sent in one message per neighbour */
+        void startHaloExchange(u8 Var, const EigenDefs::Matrix<f64>& Y);
+
+        /**< Batched finishHaloExchange */
+        void finishHaloExchange(u8 Var, EigenDefs::Matrix<f64>& Y);
+
+        /**< Releases the hypre matrix, vectors and solvers, if any */
+        void destroySystem();
+
+        /**< Releases the Krylov solver and BoomerAMG hierarchies set up on the assembled operator, if any */
+        void destroySolvers();
+
+        /**< Numbers the system rows of variable Var, preallocates and creates the hypre matrix and vectors */
+        void assembleStructure(u8 Var);
+
+        /**< Fills the hypre matrix with the element operators for the current heat coefficients */
+        void assembleOperator();
+
+        /**< Sets the hypre right-hand side, the source lifted by the Dirichlet values, and a zero initial guess */
+        void assembleRHS(PointFunction f, PointFunction g);
+
+        /**< Creates a BoomerAMG with the parameters of params, one V-cycle per application */
+        void createAMG(HYPRE_Solver& amg_) const;
+
+        /**< Copies the owned rows of the hypre solution vector into block vector u and completes the interface nodes */
+        void extractSolution(EigenDefs::Vector<f64>& u);
+
+        /**< Sets up a standalone BoomerAMG on the assembled (uncondensed) matrix, kept until the operator changes */
+        void setupAMG();
+
+        /**< Applies the BoomerAMG of setupAMG to block residual r (zero on the boundary), z ~ A^{-1} r */
+        void applyAMG(const EigenDefs::Vector<f64>& r, EigenDefs::Vector<f64>& z);
+
+        /**< Copies the element nodal values of global vector u into the local tensor ue */
+        void gather(u8 Var, const u64 elemAxis[3], const EigenDefs::Vector<f64>& u, f64* ue) const;
+
+        /**< Adds the local tensor ye to the element nodal values of global vector y */
+        void scatterAdd(u8 Var, const u64 elemAxis[3], const f64* ye, EigenDefs::Vector<f64>& y) const;
+
+        /**< Copies the element nodal values of every column of U into consecutive local tensors ue */
+        void gatherBatch(u8 Var, const u64 elemAxis[3], const EigenDefs::Matrix<f64>& U, f64* ue) const;
+
+        /**< Adds consecutive local tensors ye to the element nodal values of every column of Y */
+        void scatterAddBatch(u8 Var, const u64 elemAxis[3], const f64* ye, EigenDefs::Matrix<f64>& Y) const;
+
+        // ---------------- //
+        // member variables //
+        // ---------------- //
+
+        Mesh::Geometry& geometry;
+        Mesh::MasterElement& master;
+        MPI_Comm comm;
+        i32 rankid, nprocs;
+        u8  nDims, nVars;
+        f64 massCoeff, diffCoeff;
+        std::vector<std::vector<EigenDefs::Matrix<f64>>> D;   /**< Nodal derivative matrices, access is D[Var][axis] */
+        std::vector<std::vector<EigenDefs::Matrix<f64>>> Dt;  /**< Transposed nodal derivative matrices, access is Dt[Var][axis] */
+        std::vector<EigenDefs::Array1D<f64>> W;               /**< Tensor-product quadrature weights, access is W[Var][localNode] */
+        std::vector<std::vector<u64>> nNodes;                 /**< Nodes per element per axis, access is nNodes[Var][axis] (size 3) */
+        std::vector<std::vector<u64>> nGlobal;                /**< Global nodes per axis, access is nGlobal[Var][axis] (size 3) */
+        std::vector<std::vector<u64>> nBlock;                 /**< Nodes per axis in the block of this rank, access is nBlock[Var][axis] (size 3) */
+        std::vector<std::vector<u64>> blockStart;             /**< First global node per axis of the block, access is blockStart[Var][axis] (size 3) */
+
+        std::vector<std::vector<EigenDefs::Array1D<f64>>> xNodes; /**< Global node coordinates per axis, access is xNodes[Var][axis][idx] */
+
+        // assembled system
+        SolverParameters params;
+        u8  assembledVar;
+        b8  isAssembled;                                      /**< TRUE if the row numbering and hypre objects exist */
+        b8  operatorValid;                                    /**< TRUE if the matrix holds the operator of assembledMass/Diff */
+        b8  matrixFilled;                                     /**< TRUE if the matrix was assembled before, its values must be reset */
+        f64 assembledMass, assembledDiff;                     /**< Heat coefficients of the assembled operator */
+        u64 assembledRevision;                                /**< Geometry revision of the assembled operator */
+        HYPRE_BigInt   ilower, iupper;                        /**< Global rows owned by this rank */
+        std::vector<HYPRE_BigInt> systemRows;                 /**< hypre row per block node, -1 for nodes not in the system */
+        std::vector<u64> rowNodes;                            /**< Block node per owned row, access is rowNodes[row-ilower] */
+        std::vector<Eigen::Index> allLocalNodes;              /**< 0, 1, ..., nLocal-1 */
+
+        // static condensation
+        /**< Cached elimination of the interior nodes of one element */
+        struct CondensedElement{
+            Eigen::LLT<EigenDefs::Matrix<f64>> AII;           /**< Cholesky factors of the interior block */
+            EigenDefs::Matrix<f64> X;                         /**< A_II^{-1} A_IB */
+            EigenDefs::Vector<f64> bI;                        /**< Interior right-hand side of the last assembly */
+        };
+        b8  condensedSystem;                                  /**< TRUE if the assembled system is condensed */
+        b8  condensedValid;                                   /**< TRUE if the cached factors match condensedVar/Mass/Diff/Revision */
+        u8  condensedVar;
+        f64 condensedMass, condensedDiff;
+        u64 condensedRevision;
+        std::vector<Eigen::Index> interiorLocal, skeletonLocal; /**< Element-local interior and skeleton nodes of condensedVar */
+        std::vector<CondensedElement> condensed;              /**< Cached elimination per local element */
+        HYPRE_IJMatrix A;
+        HYPRE_IJVector b, x;
+        HYPRE_Solver   amg;                                   /**< Standalone BoomerAMG of setupAMG */
+        b8  hasAMG;
+        HYPRE_Solver   solver, solverAMG;                     /**< Krylov solver of solve and its BoomerAMG preconditioner */
+        krylovType     solverKrylov;                          /**< Krylov method of solver */
+        b8  hasSolver;
+
+        // fast diagonalization
+        /**< Tensor-product eigendecomposition of the heat operator on the block of this rank */
+        struct FastDiagonalization{
+            b8  isSet = FALSE;
+            f64 massCoeff, diffCoeff;                         /**< Heat coefficients of invLambda */
+            u64 revision;                                     /**< Geometry revision of the 1D operators */
+            u64 n[3];                                         /**< Nodes strictly inside the block per axis (unused axes are 1) */
+            std::vector<EigenDefs::Matrix<f64>> V, Vt;        /**< M-orthonormal 1D eigenvectors per axis, access is V[axis] */
+            EigenDefs::Array1D<f64> invLambda;                /**< Inverse eigenvalues of the block-interior operator, x1 fastest */
+            std::vector<u64>        interfaceNodes;           /**< Block nodes shared with other ranks, off the domain boundary */
+            EigenDefs::Array1D<f64> interfaceInvDiag;         /**< Inverse operator diagonal on interfaceNodes */
+            EigenDefs::Array1D<f64> bufA, bufB;               /**< Transform scratch space */
+        };
+        std::vector<FastDiagonalization> fdm;                 /**< Access is fdm[Var] */
+
+        // halo exchange
+        std::vector<std::vector<std::vector<u64>>> haloNodes; /**< Block nodes shared with each neighbour, access is haloNodes[Var][neighbour][n] */
+        std::vector<std::vector<f64>> sendBuf, recvBuf;       /**< Halo buffers per neighbour, grown by the batched exchange */
+        std::vector<MPI_Request> haloRequests;                /**< Pending receives, then sends */
+
+        // threading
+        i32 nThreads;
+        u64 nLocalMax;                                        /**< Largest number of nodes per element over all variables */
+        std::vector<ElementWorkspace> work;                   /**< Element workspace per thread, access is work[threadId()] */
 
 };
 
 
-} // end Physics
\ No newline at end of file
+} // end Physics
@@ -0,0 +1,658 @@
+#include "CoreIncludes.hpp"
+#include "integrator.hpp"
+#include "lglTables.hpp"
+#include <array>
+#include <utility>
+
+namespace Physics {
+
+void Integrator::tensorApply(const EigenDefs::Matrix<f64>& A, u8 axis, const u64 n[3], const f64* in, f64* out) {
+
+    using MapC = Eigen::Map<const EigenDefs::Matrix<f64>>;
+    using Map  = Eigen::Map<EigenDefs::Matrix<f64>>;
+
+    const u64 m = A.rows();
+    if (axis == 0) {
+        // (n0 x n1*n2) columns are contiguous lines along x1
+        Map(out, m, n[1]*n[2]).noalias() = A * MapC(in, n[0], n[1]*n[2]);
+    }
+    else if (axis == 1) {
+        // one (n0 x n1) slab per x3 plane
+        for (u64 k=0; k<n[2]; k++) {
+            Map(out + k*n[0]*m, n[0], m).noalias() = MapC(in + k*n[0]*n[1], n[0], n[1]) * A.transpose();
+        }
+    }
+    else {
+        // (n0*n1 x n2) rows are lines along x3
+        Map(out, n[0]*n[1], m).noalias() = MapC(in, n[0]*n[1], n[2]) * A.transpose();
+    }
+}
+
+template<u8 N, u8 Dim, u8 Axis>
+void Integrator::tensorApplyFixed(const Eigen::Matrix<f64, N, N>& A, const f64* in, f64* out) {
+
+    constexpr int nLocal = (Dim == 1) ? N : (Dim == 2) ? N*N : N*N*N;
+
+    if constexpr (Axis == 0) {
+        Eigen::Map<Eigen::Matrix<f64, N, nLocal/N>>(out).noalias() = A * Eigen::Map<const Eigen::Matrix<f64, N, nLocal/N>>(in);
+    }
+    else if constexpr (Axis == 1) {
+        for (int k=0; k<nLocal/(N*N); k++) {
+            Eigen::Map<Eigen::Matrix<f64, N, N>>(out + k*N*N).noalias() = 
+                Eigen::Map<const Eigen::Matrix<f64, N, N>>(in + k*N*N) * A.transpose();
+        }
+    }
+    else {
+        Eigen::Map<Eigen::Matrix<f64, N*N, N>>(out).noalias() = Eigen::Map<const Eigen::Matrix<f64, N*N, N>>(in) * A.transpose();
+    }
+}
+
+template<u8 N, u8 Dim, u8 Axis>
+void Integrator::tensorApplyFixedBatch(const Eigen::Matrix<f64, N, N>& A, u64 nBatch, const f64* in, f64* out) {
+
+    constexpr int nLocal = (Dim == 1) ? N : (Dim == 2) ? N*N : N*N*N;
+    using MatrixND = Eigen::Matrix<f64, N, Eigen::Dynamic>;
+
+    if constexpr (Axis == 0) {
+        Eigen::Map<MatrixND>(out, N, nBatch*nLocal/N).noalias() = A * Eigen::Map<const MatrixND>(in, N, nBatch*nLocal/N);
+    }
+    else if constexpr (Axis == 1) {
+        for (u64 k=0; k<nBatch*nLocal/(N*N); k++) {
+            Eigen::Map<Eigen::Matrix<f64, N, N>>(out + k*N*N).noalias() = 
+                Eigen::Map<const Eigen::Matrix<f64, N, N>>(in + k*N*N) * A.transpose();
+        }
+    }
+    else {
+        for (u64 c=0; c<nBatch; c++) tensorApplyFixed<N, Dim, Axis>(A, in + c*nLocal, out + c*nLocal);
+    }
+}
+
+void Integrator::tensorApplyBatch(const EigenDefs::Matrix<f64>& A, u8 axis, const u64 n[3], u64 nBatch, const f64* in, f64* out) {
+
+    // The batch index runs slowest, along x1 and x2 it merges with the x3 index into a single product
+    if (axis < 2) {
+        const u64 nMerged[3] = {n[0], n[1], n[2]*nBatch};
+        tensorApply(A, axis, nMerged, in, out);
+        return;
+    }
+    const u64 nLocal = n[0]*n[1]*n[2];
+    for (u64 c=0; c<nBatch; c++) tensorApply(A, axis, n, in + c*nLocal, out + c*nLocal);
+}
+
+template<u8 Order, u8 Dim>
+void Integrator::applyOmegaFixed(u8 Var, const std::vector<std::vector<u64>>& colors, const EigenDefs::Vector<f64>& u, 
+                                 EigenDefs::Vector<f64>& y) {
+
+    constexpr u8  N      = Order+1;
+    constexpr int nLocal = (Dim == 1) ? N : (Dim == 2) ? N*N : N*N*N;
+    using Local   = Eigen::Array<f64, nLocal, 1>;
+    using MatrixN = Eigen::Matrix<f64, N, N>;
+
+    const MatrixN  Dx = Mesh::LGLTable<Order>::d1Matrix();
+    const MatrixN  DxT = Dx.transpose();
+    Eigen::Map<const Local> Wl(W[Var].data());
+
+    #pragma omp parallel num_threads(nThreads)
+    {
+        ElementWorkspace& ws = work[threadId()];
+        ElementWorkspace::Frame frame(ws);
+        Eigen::Map<Local> ueL(ws.array(nLocal).data()), yeL(ws.array(nLocal).data()), gradL(ws.array(nLocal).data()), 
+                          fluxL(ws.array(nLocal).data());
+        u64 elemAxis[3];
+        ASSERT_NO_ALLOCATION("Integrator.applyOmegaFixed")
+
+        // Elements of one color share no nodes, the barrier after each color keeps the scatter conflict-free
+        for (const std::vector<u64>& elems : colors) {
+            #pragma omp for schedule(static)
+            for (u64 n=0; n<elems.size(); n++) {
+                geometry.localElemIndex(elems[n], elemAxis);
+                gather(Var, elemAxis, u, ueL.data());
+
+                f64 hw[3] = {1., 1., 1.};
+                f64 detJ  = 1.;
+                for (u8 axis=0; axis<Dim; axis++) {
+                    hw[axis] = geometry.halfWidths[axis][elemAxis[axis]];
+                    detJ    *= hw[axis];
+                }
+
+                yeL = massCoeff*detJ * Wl * ueL;
+
+                if (diffCoeff != 0.) {
+                    // Unrolled over the axes at compile-time
+                    [&]<u8... Axis>(std::integer_sequence<u8, Axis...>) {
+                        ((tensorApplyFixed<N, Dim, Axis>(Dx, ueL.data(), gradL.data()),
+                          gradL *= (diffCoeff*detJ / (hw[Axis]*hw[Axis])) * Wl,
+                          tensorApplyFixed<N, Dim, Axis>(DxT, gradL.data(), fluxL.data()),
+                          yeL += fluxL), ...);
+                    }(std::make_integer_sequence<u8, Dim>{});
+                }
+
+                scatterAdd(Var, elemAxis, yeL.data(), y);
+            }
+        }
+    }
+    TRACE_MSG("Integrator.applyOmegaFixed<%i,%i> : Var %i - passed element loop", Order, Dim, Var)
+}
+
+void Integrator::applyOmega(u8 Var, const EigenDefs::Vector<f64>& u, EigenDefs::Vector<f64>& y) {
+
+    PROFILE_SCOPE("Integrator.applyOmega")
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(static_cast<u64>(u.rows()) == nDOFs(Var), "Input vector does not match the number of DOFs")
+
+    zeroBlockVector(Var, y);
+
+    // Compile-time kernel table, access is kernels[(Order-1)*3 + (Dim-1)]
+    using Kernel = void (Integrator::*)(u8, const std::vector<std::vector<u64>>&, const EigenDefs::Vector<f64>&, EigenDefs::Vector<f64>&);
+    static constexpr auto kernels = []<std::size_t... I>(std::index_sequence<I...>) {
+        return std::array<Kernel, sizeof...(I)>{ &Integrator::applyOmegaFixed<I/3+1, I%3+1>... };
+    }(std::make_index_sequence<3*Mesh::LGL_TABLE_MAX_ORDER>{});
+
+    b8 isUniform = TRUE;
+    for (u8 axis=1; axis<nDims; axis++) isUniform &= (nNodes[Var][axis] == nNodes[Var][0]);
+    const u64 polyOrder = nNodes[Var][0]-1;
+
+    const Kernel kernel = (geometry.isCartesian && isUniform && polyOrder <= Mesh::LGL_TABLE_MAX_ORDER) 
+                        ? kernels[(polyOrder-1)*3 + (nDims-1)] : &Integrator::applyOmegaDynamic;
+
+    // Interface elements first, their halo is in flight while the interior elements are computed
+    (this->*kernel)(Var, geometry.interfaceColors, u, y);
+    startHaloExchange(Var, y);
+    (this->*kernel)(Var, geometry.interiorColors, u, y);
+    finishHaloExchange(Var, y);
+}
+
+template<u8 Order, u8 Dim>
+void Integrator::applyOmegaBatchFixed(u8 Var, const std::vector<std::vector<u64>>& colors, const EigenDefs::Matrix<f64>& U, 
+                                      EigenDefs::Matrix<f64>& Y) {
+
+    constexpr u8  N      = Order+1;
+    constexpr int nLocal = (Dim == 1) ? N : (Dim == 2) ? N*N : N*N*N;
+    using Local   = Eigen::Array<f64, nLocal, 1>;
+    using Batch   = Eigen::Array<f64, nLocal, Eigen::Dynamic>;
+    using MatrixN = Eigen::Matrix<f64, N, N>;
+
+    const MatrixN  Dx = Mesh::LGLTable<Order>::d1Matrix();
+    const MatrixN  DxT = Dx.transpose();
+    Eigen::Map<const Local> Wl(W[Var].data());
+    const u64 nBatch = U.cols();
+
+    #pragma omp parallel num_threads(nThreads)
+    {
+        // Grown once for the widest batch, before any view is taken
+        ElementWorkspace& ws = work[threadId()];
+        ws.reserve(4*(nLocal*nBatch + 8));
+        ElementWorkspace::Frame frame(ws);
+        Eigen::Map<Batch> ueB(ws.array(nLocal*nBatch).data(), nLocal, nBatch), yeB(ws.array(nLocal*nBatch).data(), nLocal, nBatch), 
+                          gradB(ws.array(nLocal*nBatch).data(), nLocal, nBatch), fluxB(ws.array(nLocal*nBatch).data(), nLocal, nBatch);
+        u64 elemAxis[3];
+        ASSERT_NO_ALLOCATION("Integrator.applyOmegaBatchFixed")
+
+        for (const std::vector<u64>& elems : colors) {
+            #pragma omp for schedule(static)
+            for (u64 n=0; n<elems.size(); n++) {
+                geometry.localElemIndex(elems[n], elemAxis);
+                gatherBatch(Var, elemAxis, U, ueB.data());
+
+                f64 hw[3] = {1., 1., 1.};
+                f64 detJ  = 1.;
+                for (u8 axis=0; axis<Dim; axis++) {
+                    hw[axis] = geometry.halfWidths[axis][elemAxis[axis]];
+                    detJ    *= hw[axis];
+                }
+
+                yeB = ueB.colwise() * (massCoeff*detJ * Wl);
+
+                if (diffCoeff != 0.) {
+                    [&]<u8... Axis>(std::integer_sequence<u8, Axis...>) {
+                        ((tensorApplyFixedBatch<N, Dim, Axis>(Dx, nBatch, ueB.data(), gradB.data()),
+                          gradB.colwise() *= (diffCoeff*detJ / (hw[Axis]*hw[Axis])) * Wl,
+                          tensorApplyFixedBatch<N, Dim, Axis>(DxT, nBatch, gradB.data(), fluxB.data()),
+                          yeB += fluxB), ...);
+                    }(std::make_integer_sequence<u8, Dim>{});
+                }
+
+                scatterAddBatch(Var, elemAxis, yeB.data(), Y);
+            }
+        }
+    }
+    TRACE_MSG("Integrator.applyOmegaBatchFixed<%i,%i> : Var %i - passed element loop over %llu columns", Order, Dim, Var, nBatch)
+}
+
+void Integrator::applyOmega(u8 Var, const EigenDefs::Matrix<f64>& U, EigenDefs::Matrix<f64>& Y) {
+
+    PROFILE_SCOPE("Integrator.applyOmegaBatch")
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(static_cast<u64>(U.rows()) == nDOFs(Var), "Input block vectors do not match the number of DOFs")
+
+    const i64 nValues = U.size();
+    Y.resize(U.rows(), U.cols());
+    #pragma omp parallel for schedule(static) num_threads(nThreads)
+    for (i64 i=0; i<nValues; i++) Y.data()[i] = 0.;
+    if (nValues == 0) return;
+
+    // Same dispatch as the single vector kernels
+    using Kernel = void (Integrator::*)(u8, const std::vector<std::vector<u64>>&, const EigenDefs::Matrix<f64>&, EigenDefs::Matrix<f64>&);
+    static constexpr auto kernels = []<std::size_t... I>(std::index_sequence<I...>) {
+        return std::array<Kernel, sizeof...(I)>{ &Integrator::applyOmegaBatchFixed<I/3+1, I%3+1>... };
+    }(std::make_index_sequence<3*Mesh::LGL_TABLE_MAX_ORDER>{});
+
+    b8 isUniform = TRUE;
+    for (u8 axis=1; axis<nDims; axis++) isUniform &= (nNodes[Var][axis] == nNodes[Var][0]);
+    const u64 polyOrder = nNodes[Var][0]-1;
+
+    const Kernel kernel = (geometry.isCartesian && isUniform && polyOrder <= Mesh::LGL_TABLE_MAX_ORDER) 
+                        ? kernels[(polyOrder-1)*3 + (nDims-1)] : &Integrator::applyOmegaBatch;
+
+    (this->*kernel)(Var, geometry.interfaceColors, U, Y);
+    startHaloExchange(Var, Y);
+    (this->*kernel)(Var, geometry.interiorColors, U, Y);
+    finishHaloExchange(Var, Y);
+}
+
+void Integrator::applyOmegaDynamic(u8 Var, const std::vector<std::vector<u64>>& colors, const EigenDefs::Vector<f64>& u, 
+                                   EigenDefs::Vector<f64>& y) {
+
+    #pragma omp parallel num_threads(nThreads)
+    {
+        ElementWorkspace& ws = work[threadId()];
+        const u64 nLocal = W[Var].rows();
+        u64 elemAxis[3];
+        ASSERT_NO_ALLOCATION("Integrator.applyOmegaDynamic")
+        for (const std::vector<u64>& elems : colors) {
+            #pragma omp for schedule(static)
+            for (u64 n=0; n<elems.size(); n++) {
+                ElementWorkspace::Frame frame(ws);
+                Eigen::Map<EigenDefs::Array1D<f64>> ue = ws.array(nLocal), ye = ws.array(nLocal);
+                geometry.localElemIndex(elems[n], elemAxis);
+                gather(Var, elemAxis, u, ue.data());
+                applyElement(Var, elems[n], elemAxis, ue.data(), ye.data(), ws);
+                scatterAdd(Var, elemAxis, ye.data(), y);
+            }
+        }
+    }
+    TRACE_MSG("Integrator.applyOmegaDynamic : Var %i - passed element loop", Var)
+}
+
+void Integrator::applyOmegaBatch(u8 Var, const std::vector<std::vector<u64>>& colors, const EigenDefs::Matrix<f64>& U, 
+                                 EigenDefs::Matrix<f64>& Y) {
+
+    const u64 n[3]   = {nNodes[Var][0], nNodes[Var][1], nNodes[Var][2]};
+    const u64 nLocal = n[0]*n[1]*n[2];
+    const u64 nBatch = U.cols();
+
+    #pragma omp parallel num_threads(nThreads)
+    {
+        // Grown once for the widest batch, the rest of the arena is left to applyElement
+        ElementWorkspace& ws = work[threadId()];
+        ws.reserve(elementWorkspaceSize(nLocal) + 4*(nLocal*nBatch + 8));
+        ElementWorkspace::Frame frame(ws);
+        Eigen::Map<EigenDefs::Matrix<f64>> ueB = ws.matrix(nLocal, nBatch), yeB = ws.matrix(nLocal, nBatch), 
+                                           gradB = ws.matrix(nLocal, nBatch), fluxB = ws.matrix(nLocal, nBatch);
+        Eigen::Map<EigenDefs::Array1D<f64>> weights = ws.array(nLocal); /**< Column scaling, broadcast expressions would be evaluated on the heap */
+        u64 elemAxis[3];
+        ASSERT_NO_ALLOCATION("Integrator.applyOmegaBatch")
+
+        for (const std::vector<u64>& elems : colors) {
+            #pragma omp for schedule(static)
+            for (u64 e=0; e<elems.size(); e++) {
+                const u64 elem = elems[e];
+                geometry.localElemIndex(elem, elemAxis);
+                gatherBatch(Var, elemAxis, U, ueB.data());
+
+                if (geometry.isCartesian) {
+                    f64 hw[3] = {1., 1., 1.};
+                    f64 detJ  = 1.;
+                    for (u8 axis=0; axis<nDims; axis++) {
+                        hw[axis] = geometry.halfWidths[axis][elemAxis[axis]];
+                        detJ    *= hw[axis];
+                    }
+
+                    elementMassDiagonal(Var, elem, elemAxis, weights.data());
+                    weights *= massCoeff;
+                    yeB.array() = ueB.array().colwise() * weights;
+                    if (diffCoeff != 0.) {
+                        for (u8 axis=0; axis<nDims; axis++) {
+                            const f64 G = diffCoeff*detJ / (hw[axis]*hw[axis]);
+                            tensorApplyBatch(D[Var][axis], axis, n, nBatch, ueB.data(), gradB.data());
+                            weights = G * W[Var];
+                            gradB.array().colwise() *= weights;
+                            tensorApplyBatch(Dt[Var][axis], axis, n, nBatch, gradB.data(), fluxB.data());
+                            yeB += fluxB;
+                        }
+                    }
+                }
+                else {
+                    // The metric terms are read per column, they stay in cache across the batch
+                    for (u64 c=0; c<nBatch; c++) {
+                        applyElement(Var, elem, elemAxis, ueB.col(c).data(), yeB.col(c).data(), ws);
+                    }
+                }
+
+                scatterAddBatch(Var, elemAxis, yeB.data(), Y);
+            }
+        }
+    }
+    TRACE_MSG("Integrator.applyOmegaBatch : Var %i - passed element loop over %llu columns", Var, nBatch)
+}
+
+void Integrator::applyElement(u8 Var, u64 elem, const u64 elemAxis[3], const f64* ueIn, f64* yeOut, ElementWorkspace& ws) const {
+
+    const u64  n[3]   = {nNodes[Var][0], nNodes[Var][1], nNodes[Var][2]};
+    const u64  nLocal = n[0]*n[1]*n[2];
+    Eigen::Map<const EigenDefs::Array1D<f64>> ueL(ueIn, nLocal);
+    Eigen::Map<EigenDefs::Array1D<f64>>       yeL(yeOut, nLocal);
+
+    // Mass term, diagonal under LGL quadrature
+    elementMassDiagonal(Var, elem, elemAxis, yeOut);
+    yeL *= massCoeff * ueL;
+    if (diffCoeff == 0.) return;
+
+    if (!geometry.isCartesian) {
+        // General elements: dimension loops and metric tensors are fixed-size, access is kernels[nDims-1]
+        using Kernel = void (Integrator::*)(u8, u64, const f64*, f64*, ElementWorkspace&) const;
+        static constexpr std::array<Kernel, 3> kernels = {&Integrator::elementStiffnessGeneral<1>, 
+                                                          &Integrator::elementStiffnessGeneral<2>, 
+                                                          &Integrator::elementStiffnessGeneral<3>};
+        (this->*kernels[nDims-1])(Var, elem, ueIn, yeOut, ws);
+        return;
+    }
+
+    // Axis-aligned elements: J = prod(h_a/2) and dxi_a/dx_a = 2/h_a
+    ElementWorkspace::Frame frame(ws);
+    Eigen::Map<EigenDefs::Array1D<f64>> grad = ws.array(nLocal), flux = ws.array(nLocal);
+    f64 hw[3] = {1., 1., 1.};
+    f64 detJ  = 1.;
+    for (u8 axis=0; axis<nDims; axis++) {
+        hw[axis] = geometry.halfWidths[axis][elemAxis[axis]];
+        detJ    *= hw[axis];
+    }
+
+    // Stiffness term, sum_a D_a^T (W G_aa) D_a u
+    for (u8 axis=0; axis<nDims; axis++) {
+        const f64 G = diffCoeff*detJ / (hw[axis]*hw[axis]);
+        tensorApply(D[Var][axis], axis, n, ueIn, grad.data());
+        grad *= G * W[Var];
+        tensorApply(Dt[Var][axis], axis, n, grad.data(), flux.data());
+        yeL += flux;
+    }
+}
+
+template<u8 Dim>
+void Integrator::elementStiffnessGeneral(u8 Var, u64 elem, const f64* ueIn, f64* yeOut, ElementWorkspace& ws) const {
+
+    using MatrixD = Eigen::Matrix<f64, Dim, Dim>;                      // EigenDefs::Matrix22/Matrix33 for 2D/3D
+    using VectorD = Eigen::Matrix<f64, Dim, 1>;                        // EigenDefs::Vector2/Vector3 for 2D/3D
+    using Points  = Eigen::Matrix<f64, Eigen::Dynamic, Dim>;
+
+    const u64 n[3]   = {nNodes[Var][0], nNodes[Var][1], nNodes[Var][2]};
+    const u64 nLocal = n[0]*n[1]*n[2];
+    const u64 row0   = elem*nLocal;
+    Eigen::Map<EigenDefs::Array1D<f64>> yeL(yeOut, nLocal);
+
+    ElementWorkspace::Frame frame(ws);
+    Eigen::Map<Points> gradAxis(ws.array(nLocal, Dim).data(), nLocal, Dim); /**< Reference gradient, access is gradAxis(localNode, axis) */
+    Eigen::Map<EigenDefs::Array1D<f64>> flux = ws.array(nLocal);
+
+    // Reference gradient, unrolled over the axes at compile-time
+    [&]<u8... Axis>(std::integer_sequence<u8, Axis...>) {
+        (tensorApply(D[Var][Axis], Axis, n, ueIn, gradAxis.col(Axis).data()), ...);
+    }(std::make_integer_sequence<u8, Dim>{});
+
+    // Flux W G grad(u) per quadrature point, written over the gradient
+    MatrixD G;
+    VectorD g;
+    for (u64 q=0; q<nLocal; q++) {
+        for (u8 a=0; a<Dim; a++) {
+            for (u8 b=a; b<Dim; b++) G(a,b) = G(b,a) = geometry.metrics(row0+q, Mesh::Geometry::metricIndex(Dim, a, b));
+        }
+        g = gradAxis.row(q).transpose();
+        gradAxis.row(q) = ((diffCoeff*W[Var][q]) * (G*g)).transpose();
+    }
+
+    // Stiffness term, sum_a D_a^T (W sum_b G_ab D_b u)
+    [&]<u8... Axis>(std::integer_sequence<u8, Axis...>) {
+        ((tensorApply(Dt[Var][Axis], Axis, n, gradAxis.col(Axis).data(), flux.data()), yeL += flux), ...);
+    }(std::make_integer_sequence<u8, Dim>{});
+}
+
+void Integrator::elementMassDiagonal(u8 Var, u64 elem, const u64 elemAxis[3], f64* out) const {
+
+    const u64 nLocal = W[Var].rows();
+    Eigen::Map<EigenDefs::Array1D<f64>> outL(out, nLocal);
+
+    if (geometry.isCartesian) {
+        f64 detJ = 1.;
+        for (u8 axis=0; axis<nDims; axis++) detJ *= geometry.halfWidths[axis][elemAxis[axis]];
+        outL = detJ * W[Var];
+    }
+    else {
+        outL = geometry.metrics.col(0).segment(elem*nLocal, nLocal) * W[Var];
+    }
+}
+
+void Integrator::sourceOmega(u8 Var, PointFunction f, EigenDefs::Vector<f64>& b) {
+
+    PROFILE_SCOPE("Integrator.sourceOmega")
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(static_cast<u64>(b.rows()) == nDOFs(Var), "Output vector does not match the number of DOFs")
+
+    // Accumulated separately so that only this rank's contributions are summed over the interfaces
+    EigenDefs::Vector<f64> bLocal;
+    zeroBlockVector(Var, bLocal);
+
+    #pragma omp parallel num_threads(nThreads)
+    {
+        ElementWorkspace& ws = work[threadId()];
+        ElementWorkspace::Frame frame(ws);
+        Eigen::Map<EigenDefs::Array1D<f64>> ye = ws.array(W[Var].rows());
+        u64 elemAxis[3];
+        f64 xPoint[3];
+        ASSERT_NO_ALLOCATION("Integrator.sourceOmega")
+        for (const std::vector<std::vector<u64>>* colors : {&geometry.interfaceColors, &geometry.interiorColors}) {
+            for (const std::vector<u64>& elems : *colors) {
+                #pragma omp for schedule(static)
+                for (u64 n=0; n<elems.size(); n++) {
+                    geometry.localElemIndex(elems[n], elemAxis);
+                    elementMassDiagonal(Var, elems[n], elemAxis, ye.data());
+
+                    u64 local = 0;
+                    for (u64 k=0; k<nNodes[Var][2]; k++) {
+                        for (u64 j=0; j<nNodes[Var][1]; j++) {
+                            for (u64 i=0; i<nNodes[Var][0]; i++, local++) {
+                                nodeCoordinates(Var, localIndex(Var, elemAxis, i, j, k), xPoint);
+                                ye[local] *= f(xPoint[0], xPoint[1], xPoint[2]);
+                            }
+                        }
+                    }
+                    scatterAdd(Var, elemAxis, ye.data(), bLocal);
+                }
+            }
+        }
+    }
+    sumShared(Var, bLocal);
+    b += bLocal;
+    TRACE_MSG("Integrator.sourceOmega : Var %i - passed element loop", Var)
+}
+
+
+void Integrator::diagonalOmega(u8 Var, EigenDefs::Vector<f64>& d) {
+
+    PROFILE_SCOPE("Integrator.diagonalOmega")
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+
+    // 1D stiffness diagonals on the reference element, (D^T W D)_ii = sum_q w_q D(q,i)^2
+    std::vector<EigenDefs::Array1D<f64>> kRef(3, EigenDefs::Array1D<f64>::Zero(1)), wRef(3, EigenDefs::Array1D<f64>::Ones(1));
+    for (u8 axis=0; axis<nDims; axis++) {
+        wRef[axis] = master.getWeights(Var, axis);
+        kRef[axis] = (wRef[axis].matrix().asDiagonal() * D[Var][axis].cwiseAbs2()).colwise().sum().transpose().array();
+    }
+
+    zeroBlockVector(Var, d);
+    #pragma omp parallel num_threads(nThreads)
+    {
+        // General elements need the dense element matrix, the arena grows once to hold it
+        ElementWorkspace& ws = work[threadId()];
+        const u64 nLocal = W[Var].rows();
+        const u64 nDense = geometry.isCartesian ? 0 : nLocal;
+        ws.reserve(elementWorkspaceSize(nLocal) + nDense*nDense + 8);
+        ElementWorkspace::Frame frame(ws);
+        Eigen::Map<EigenDefs::Array1D<f64>> ye = ws.array(nLocal);
+        Eigen::Map<EigenDefs::Matrix<f64>>  Ae = ws.matrix(nDense, nDense);
+        u64 elemAxis[3];
+        ASSERT_NO_ALLOCATION("Integrator.diagonalOmega")
+        for (const std::vector<std::vector<u64>>* colors : {&geometry.interfaceColors, &geometry.interiorColors}) {
+            for (const std::vector<u64>& elems : *colors) {
+                #pragma omp for schedule(static)
+                for (u64 n=0; n<elems.size(); n++) {
+                    geometry.localElemIndex(elems[n], elemAxis);
+                    if (geometry.isCartesian) {
+                        f64 hw[3] = {1., 1., 1.};
+                        f64 detJ  = 1.;
+                        for (u8 axis=0; axis<nDims; axis++) {
+                            hw[axis] = geometry.halfWidths[axis][elemAxis[axis]];
+                            detJ    *= hw[axis];
+                        }
+                        u64 local = 0;
+                        for (u64 k=0; k<nNodes[Var][2]; k++) {
+                            for (u64 j=0; j<nNodes[Var][1]; j++) {
+                                for (u64 i=0; i<nNodes[Var][0]; i++, local++) {
+                                    const u64 ijk[3] = {i, j, k};
+                                    f64 stiff = 0.;
+                                    for (u8 a=0; a<nDims; a++) {
+                                        f64 term = kRef[a][ijk[a]] / (hw[a]*hw[a]);
+                                        for (u8 b=0; b<nDims; b++) if (b != a) term *= wRef[b][ijk[b]];
+                                        stiff += term;
+                                    }
+                                    ye[local] = detJ*(massCoeff*W[Var][local] + diffCoeff*stiff);
+                                }
+                            }
+                        }
+                    }
+                    else {
+                        elementMatrix(Var, elems[n], elemAxis, Ae, ws);
+                        ye = Ae.diagonal().array();
+                    }
+                    scatterAdd(Var, elemAxis, ye.data(), d);
+                }
+            }
+        }
+    }
+    sumShared(Var, d);
+    TRACE_MSG("Integrator.diagonalOmega : Var %i - passed element loop", Var)
+}
+
+ErrorNorms Integrator::errorOmega(u8 Var, const EigenDefs::Vector<f64>& u, const ExactSolution& exact) {
+
+    PROFILE_SCOPE("Integrator.errorOmega")
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(static_cast<u64>(u.rows()) == nDOFs(Var), "Input vector does not match the number of DOFs")
+    CHECK_FATAL_ASSERT(geometry.isCartesian, "errorOmega requires a Cartesian geometry")
+    CHECK_FATAL_ASSERT(exact.u != nullptr, "errorOmega requires the exact solution")
+    for (u8 axis=0; axis<nDims; axis++) CHECK_FATAL_ASSERT(exact.du[axis] != nullptr, "errorOmega requires every used gradient component")
+
+    // ------------------------ //
+    // Overintegration rule     //
+    // ------------------------ //
+    // LGL rule of order p+3, interpolation (I) and derivative (I*D) matrices from the nodes to its points
+    Mesh::MasterElement rule(nDims);
+    rule.setnVars(1);
+    u8 ruleOrder[3] = {1, 1, 1};
+    for (u8 axis=0; axis<nDims; axis++) ruleOrder[axis] = master.getPolyOrder(Var, axis) + 3;
+    rule.setLGLOrder(0, ruleOrder[0], ruleOrder[1], ruleOrder[2]); // only the first nDims orders are read
+
+    std::vector<EigenDefs::Matrix<f64>> I(3, EigenDefs::Matrix<f64>::Ones(1,1)), ID(3, EigenDefs::Matrix<f64>::Zero(1,1));
+    std::vector<EigenDefs::Array1D<f64>> xiQ(3, EigenDefs::Array1D<f64>::Constant(1, -1.)), wQ(3, EigenDefs::Array1D<f64>::Ones(1));
+    u64 nQ[3] = {1, 1, 1};
+    for (u8 axis=0; axis<nDims; axis++) {
+        xiQ[axis] = rule.getNodes(0, axis);
+        wQ[axis]  = rule.getWeights(0, axis);
+        I[axis]   = master.lagrangeMatrix(Var, axis, xiQ[axis]);
+        ID[axis]  = I[axis] * D[Var][axis];
+        nQ[axis]  = xiQ[axis].size();
+    }
+    const u64 nLocal = nNodes[Var][0]*nNodes[Var][1]*nNodes[Var][2];
+    const u64 nPoints = nQ[0]*nQ[1]*nQ[2];
+
+    f64 sumL2 = 0., sumH1 = 0.;
+    #pragma omp parallel num_threads(nThreads) reduction(+:sumL2,sumH1)
+    {
+        // The rule has more points than nodes along every axis, so nPoints bounds every intermediate tensor
+        ElementWorkspace& ws = work[threadId()];
+        ws.reserve(elementWorkspaceSize(nLocal) + (3+nDims)*(nPoints+8));
+        ElementWorkspace::Frame frame(ws);
+        Eigen::Map<EigenDefs::Array1D<f64>> ue = ws.array(nLocal), bufA = ws.array(nPoints), bufB = ws.array(nPoints), 
+                                            value = ws.array(nPoints);
+        Eigen::Map<EigenDefs::Array2D<f64>> grad = ws.array(nPoints, nDims);
+        u64 elemAxis[3];
+        ASSERT_NO_ALLOCATION("Integrator.errorOmega")
+
+        // Applies ops[axis] along every used axis, from nodes to rule points
+        auto interpolate = [&](const EigenDefs::Matrix<f64>* ops[3], f64* out) {
+            u64 n[3] = {nNodes[Var][0], nNodes[Var][1], nNodes[Var][2]};
+            const f64* in = ue.data();
+            for (u8 axis=0; axis<nDims; axis++) {
+                f64* target = (axis+1 == nDims) ? out : (in == bufA.data() ? bufB.data() : bufA.data());
+                tensorApply(*ops[axis], axis, n, in, target);
+                n[axis] = nQ[axis];
+                in = target;
+            }
+        };
+
+        #pragma omp for schedule(static)
+        for (u64 elem=0; elem<geometry.nElemsLocal(); elem++) {
+            geometry.localElemIndex(elem, elemAxis);
+            gather(Var, elemAxis, u, ue.data());
+
+            f64 hw[3] = {1., 1., 1.}, x0[3] = {0., 0., 0.};
+            f64 detJ = 1.;
+            for (u8 axis=0; axis<nDims; axis++) {
+                hw[axis] = geometry.halfWidths[axis][elemAxis[axis]];
+                x0[axis] = xNodes[Var][axis][elemAxis[axis]*(nNodes[Var][axis]-1)];
+                detJ    *= hw[axis];
+            }
+
+            const EigenDefs::Matrix<f64>* ops[3] = {&I[0], &I[1], &I[2]};
+            interpolate(ops, value.data());
+            for (u8 a=0; a<nDims; a++) {
+                ops[a] = &ID[a];
+                interpolate(ops, grad.col(a).data());
+                grad.col(a) /= hw[a];
+                ops[a] = &I[a];
+            }
+
+            u64 q = 0;
+            for (u64 k=0; k<nQ[2]; k++) {
+                for (u64 j=0; j<nQ[1]; j++) {
+                    for (u64 i=0; i<nQ[0]; i++, q++) {
+                        const u64 ijk[3] = {i, j, k};
+                        f64 x[3] = {0., 0., 0.};
+                        f64 w = detJ;
+                        for (u8 axis=0; axis<nDims; axis++) {
+                            x[axis] = x0[axis] + hw[axis]*(xiQ[axis][ijk[axis]] + 1.);
+                            w      *= wQ[axis][ijk[axis]];
+                        }
+                        const f64 e = value[q] - exact.u(x[0], x[1], x[2]);
+                        sumL2 += w*e*e;
+                        for (u8 axis=0; axis<nDims; axis++) {
+                            const f64 de = grad(q, axis) - exact.du[axis](x[0], x[1], x[2]);
+                            sumH1 += w*de*de;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    f64 sums[2] = {sumL2, sumH1};
+    MPI_Allreduce(MPI_IN_PLACE, sums, 2, MPI_DOUBLE, MPI_SUM, comm);
+    TRACE_MSG("Integrator.errorOmega : Var %i - passed element loop with %llu points per element", Var, nPoints)
+    return {std::sqrt(sums[0]), std::sqrt(sums[1]), std::sqrt(sums[0] + sums[1])};
+}
+
+} // end Physics
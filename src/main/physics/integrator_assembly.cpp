@@ -0,0 +1,813 @@
+#include "CoreIncludes.hpp"
+#include "integrator.hpp"
+
+namespace Physics {
+
+Integrator::Integrator(Mesh::Geometry& geometry_) : Integrator(geometry_, geometry_.MasterElement) {}
+
+Integrator::Integrator(Mesh::Geometry& geometry_, Mesh::MasterElement& master_) : geometry(geometry_), master(master_), 
+                                                    comm(geometry_.comm), massCoeff(0.), diffCoeff(1.), 
+                                                    assembledVar(0), isAssembled(FALSE), operatorValid(FALSE), 
+                                                    matrixFilled(FALSE), assembledMass(0.), assembledDiff(0.), assembledRevision(0),
+                                                    condensedSystem(FALSE), condensedValid(FALSE), condensedVar(0), 
+                                                    condensedMass(0.), condensedDiff(0.), condensedRevision(0), hasAMG(FALSE),
+                                                    solverKrylov(KRYLOV_PCG), hasSolver(FALSE) {
+
+    PROFILE_SCOPE("Integrator.setup")
+
+    MPI_Comm_rank(comm, &rankid);
+    MPI_Comm_size(comm, &nprocs);
+
+    nDims = master.getnDims();
+    nVars = master.getnVars();
+    CHECK_FATAL_ASSERT(nDims == geometry.nDims, "MasterElement and Geometry dimensions do not match")
+    CHECK_FATAL_ASSERT(nVars > 0, "nVars must be set first before constructing the integrator")
+    CHECK_FATAL_ASSERT(nDims <= 3, "Integrator supports up to 3 dimensions")
+
+    D.resize(nVars);
+    Dt.resize(nVars);
+    W.resize(nVars);
+    nNodes.assign(nVars, std::vector<u64>(3, 1));
+    nGlobal.assign(nVars, std::vector<u64>(3, 1));
+    nBlock.assign(nVars, std::vector<u64>(3, 1));
+    blockStart.assign(nVars, std::vector<u64>(3, 0));
+    xNodes.assign(nVars, std::vector<EigenDefs::Array1D<f64>>(3, EigenDefs::Array1D<f64>::Zero(1)));
+    fdm.resize(nVars);
+    nLocalMax = 1;
+
+    for (u8 Var=0; Var<nVars; Var++) {
+        u64 nLocal = 1;
+        for (u8 axis=0; axis<nDims; axis++) {
+            u8 polyOrder = master.getPolyOrder(Var, axis);
+            CHECK_FATAL_ASSERT(polyOrder > 0, "setLGLOrder must be called for all variables before constructing the integrator")
+            nNodes[Var][axis]  = polyOrder + 1;
+            nGlobal[Var][axis] = geometry.nElems[axis]*polyOrder + 1;
+            nBlock[Var][axis]     = (geometry.elemEnd[axis]-geometry.elemBegin[axis])*polyOrder + 1;
+            blockStart[Var][axis] = geometry.elemBegin[axis]*polyOrder;
+            nLocal            *= nNodes[Var][axis];
+
+            D[Var].push_back(master.d1LagrangeMatrix(Var, axis));
+            Dt[Var].push_back(D[Var][axis].transpose());
+
+            // Global node coordinates, shared element end nodes are written twice with the same value
+            const EigenDefs::Array1D<f64>& xi = master.getNodes(Var, axis);
+            xNodes[Var][axis].resize(nGlobal[Var][axis]);
+            for (u64 elem=0; elem<geometry.nElems[axis]; elem++) {
+                xNodes[Var][axis].segment(elem*polyOrder, polyOrder+1) = geometry.xe[axis][elem] 
+                                                                       + (xi+1.)*geometry.halfWidths[axis][elem];
+            }
+        }
+
+        // Tensor-product weights, x1 running fastest
+        W[Var] = EigenDefs::Array1D<f64>::Ones(nLocal);
+        for (u64 k=0; k<nNodes[Var][2]; k++) {
+            for (u64 j=0; j<nNodes[Var][1]; j++) {
+                for (u64 i=0; i<nNodes[Var][0]; i++) {
+                    f64& w = W[Var][i + nNodes[Var][0]*(j + nNodes[Var][1]*k)];
+                    const u64 idx[3] = {i, j, k};
+                    for (u8 axis=0; axis<nDims; axis++) w *= master.getWeights(Var, axis)[idx[axis]];
+                }
+            }
+        }
+        CHECK_FATAL_ASSERT(geometry.isCartesian || geometry.nQuad == nLocal, 
+                           "General element metrics must be given at the nodes of every variable")
+        nLocalMax = std::max(nLocalMax, nLocal);
+        TRACE_MSG("Integrator : Var %i - passed 1D operator construction, %llu local nodes", Var, nLocal)
+    }
+
+    // ------------------------ //
+    // Halo maps                //
+    // ------------------------ //
+    // Nodes shared with a neighbour at offset o: the first (o=-1) or last (o=+1) node layer along each axis with o != 0.
+    // Both sides list the same global nodes in lexicographic order, so the buffers line up without sending indices.
+    const u64 nNeighbours = geometry.neighbourRanks.size();
+    haloNodes.assign(nVars, std::vector<std::vector<u64>>(nNeighbours));
+    u64 nHaloMax = 0;
+    for (u8 Var=0; Var<nVars; Var++) {
+        const std::vector<u64>& N = nBlock[Var];
+        for (u64 n=0; n<nNeighbours; n++) {
+            u64 lo[3], hi[3];
+            for (u8 axis=0; axis<3; axis++) {
+                const i32 o = geometry.neighbourOffsets[n][axis];
+                lo[axis] = (o ==  1) ? N[axis]-1 : 0;
+                hi[axis] = (o == -1) ? 1         : N[axis];
+            }
+            for (u64 k=lo[2]; k<hi[2]; k++) {
+                for (u64 j=lo[1]; j<hi[1]; j++) {
+                    for (u64 i=lo[0]; i<hi[0]; i++) haloNodes[Var][n].push_back(i + N[0]*(j + N[1]*k));
+                }
+            }
+            nHaloMax = std::max<u64>(nHaloMax, haloNodes[Var][n].size());
+        }
+    }
+    sendBuf.assign(nNeighbours, std::vector<f64>(nHaloMax));
+    recvBuf.assign(nNeighbours, std::vector<f64>(nHaloMax));
+    haloRequests.resize(2*nNeighbours);
+    TRACE_MSG("Integrator : passed halo map construction, %llu neighbours", nNeighbours)
+
+    setnThreads(threadCount());
+
+    INFO_MSG("Matrix-free integrator established on %llu local elements", geometry.nElemsLocal())
+}
+
+Integrator::~Integrator() {
+
+    destroySystem();
+}
+
+void Integrator::setnThreads(i32 nThreads_) {
+
+    CHECK_FATAL_ASSERT(nThreads_ > 0, "Number of threads must be bigger than 0")
+    nThreads = nThreads_;
+    work.clear();
+    work.resize(nThreads);
+
+    // Allocated by the owning thread, so that the workspace lives on its NUMA node. nLocalMax is the largest element
+    // over all variables, so the arena fits every kernel of every variable
+    #pragma omp parallel num_threads(nThreads)
+    {
+        work[threadId()].reserve(elementWorkspaceSize(nLocalMax));
+    }
+    TRACE_MSG("Integrator.setnThreads : passed workspace allocation, %i threads of %llu entries", nThreads, work[0].capacity())
+}
+
+void Integrator::ElementWorkspace::reserve(u64 nValues) {
+
+    CHECK_FATAL_ASSERT(used == 0, "The element workspace can only grow while no view is taken")
+    if (nValues <= capacity()) return;
+    storage = EigenDefs::Array1D<f64>::Zero(nValues);
+}
+
+void Integrator::setHeatCoefficients(f64 massCoeff_, f64 diffCoeff_) {
+
+    massCoeff = massCoeff_;
+    diffCoeff = diffCoeff_;
+}
+
+u64 Integrator::nDOFs(u8 Var) const {
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    return nBlock[Var][0]*nBlock[Var][1]*nBlock[Var][2];
+}
+
+u64 Integrator::nGlobalDOFs(u8 Var) const {
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    return nGlobal[Var][0]*nGlobal[Var][1]*nGlobal[Var][2];
+}
+
+void Integrator::nodeCoordinates(u8 Var, u64 idx, f64 x[3]) const {
+
+    u64 g[3];
+    globalNode(Var, idx, g);
+    for (u8 axis=0; axis<3; axis++) x[axis] = (axis < nDims) ? xNodes[Var][axis][g[axis]] : 0.;
+}
+
+u64 Integrator::localIndex(u8 Var, const u64 elemAxis[3], u64 i, u64 j, u64 k) const {
+
+    const std::vector<u64>& n = nNodes[Var];
+    const std::vector<u64>& N = nBlock[Var];
+    const u64* e0 = geometry.elemBegin.data();
+    return ((elemAxis[0]-e0[0])*(n[0]-1)+i) + N[0]*(((elemAxis[1]-e0[1])*(n[1]-1)+j) + N[1]*((elemAxis[2]-e0[2])*(n[2]-1)+k));
+}
+
+void Integrator::globalNode(u8 Var, u64 idx, u64 g[3]) const {
+
+    for (u8 axis=0; axis<3; axis++) {
+        g[axis] = blockStart[Var][axis] + idx % nBlock[Var][axis];
+        idx    /= nBlock[Var][axis];
+    }
+}
+
+void Integrator::ownedBox(u8 Var, const i32 coords[3], u64 start[3], u64 count[3]) const {
+
+    // A block owns its nodes up to, but not including, the interface with the next block
+    for (u8 axis=0; axis<3; axis++) {
+        if (axis >= nDims) { start[axis] = 0; count[axis] = 1; continue; }
+        const u64 p = nNodes[Var][axis]-1;
+        start[axis] = geometry.partitionBegin(axis, coords[axis])*p;
+        count[axis] = geometry.partitionBegin(axis, coords[axis]+1)*p - start[axis] 
+                    + (coords[axis] == geometry.procDims[axis]-1 ? 1 : 0);
+    }
+}
+
+std::vector<u64> Integrator::ownedBlockNodes(u8 Var) const {
+
+    u64 ownStart[3], ownCount[3];
+    ownedBox(Var, geometry.procCoords, ownStart, ownCount);
+    std::vector<u64> out;
+    out.reserve(ownCount[0]*ownCount[1]*ownCount[2]);
+    for (u64 k=0; k<ownCount[2]; k++) {
+        for (u64 j=0; j<ownCount[1]; j++) {
+            for (u64 i=0; i<ownCount[0]; i++) {
+                const u64 l0 = ownStart[0]-blockStart[Var][0]+i, l1 = ownStart[1]-blockStart[Var][1]+j, l2 = ownStart[2]-blockStart[Var][2]+k;
+                out.push_back(l0 + nBlock[Var][0]*(l1 + nBlock[Var][1]*l2));
+            }
+        }
+    }
+    return out;
+}
+
+void Integrator::elementMatrix(u8 Var, u64 elem, const u64 elemAxis[3], Eigen::Ref<EigenDefs::Matrix<f64>> Ae, 
+                               ElementWorkspace& ws) const {
+
+    const u64 nLocal = nNodes[Var][0]*nNodes[Var][1]*nNodes[Var][2];
+    CHECK_FATAL_ASSERT(static_cast<u64>(Ae.rows()) == nLocal && static_cast<u64>(Ae.cols()) == nLocal, "Element matrix must be nLocal x nLocal")
+
+    ElementWorkspace::Frame frame(ws);
+    Eigen::Map<EigenDefs::Array1D<f64>> unit = ws.array(nLocal);
+    unit.setZero();
+    for (u64 j=0; j<nLocal; j++) {
+        unit[j] = 1.;
+        applyElement(Var, elem, elemAxis, unit.data(), Ae.col(j).data(), ws);
+        unit[j] = 0.;
+    }
+}
+
+void Integrator::setSolverParameters(const SolverParameters& params_) {
+
+    CHECK_FATAL_ASSERT(params_.tol > 0., "Solver tolerance must be bigger than 0")
+    CHECK_FATAL_ASSERT(params_.maxIter > 0, "Maximum number of iterations must be bigger than 0")
+    if (params_ == params) return;
+    params = params_;
+    destroySolvers();
+}
+
+void Integrator::destroySolvers() {
+
+    if (hasAMG) HYPRE_BoomerAMGDestroy(amg);
+    hasAMG = FALSE;
+    if (!hasSolver) return;
+    if (solverKrylov == KRYLOV_PCG) HYPRE_ParCSRPCGDestroy(solver);
+    else                            HYPRE_ParCSRGMRESDestroy(solver);
+    HYPRE_BoomerAMGDestroy(solverAMG);
+    hasSolver = FALSE;
+}
+
+void Integrator::destroySystem() {
+
+    destroySolvers();
+    if (!isAssembled) return;
+    HYPRE_IJMatrixDestroy(A);
+    HYPRE_IJVectorDestroy(b);
+    HYPRE_IJVectorDestroy(x);
+    isAssembled   = FALSE;
+    operatorValid = FALSE;
+    matrixFilled  = FALSE;
+}
+
+void Integrator::assemble(u8 Var, PointFunction f, PointFunction g) {
+
+    PROFILE_SCOPE("Integrator.assemble")
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+
+    // ------------------------ //
+    // Operator cache           //
+    // ------------------------ //
+    // The sparsity pattern depends on the variable, the condensation and the geometry, the values on the heat
+    // coefficients as well. Only the right-hand side depends on f and g.
+    if (!isAssembled || assembledVar != Var || condensedSystem != params.staticCondensation || 
+        assembledRevision != geometry.revision) {
+        destroySystem();
+        assembleStructure(Var);
+    }
+    if (!operatorValid || assembledMass != massCoeff || assembledDiff != diffCoeff) {
+        destroySolvers();
+        assembleOperator();
+    }
+    else {
+        TRACE_MSG("Integrator.assemble : Var %i - reusing the assembled operator", Var)
+    }
+    assembleRHS(f, g);
+}
+
+void Integrator::assembleStructure(u8 Var) {
+
+    const b8  condense = params.staticCondensation;
+    const u64 nLocal   = nNodes[Var][0]*nNodes[Var][1]*nNodes[Var][2];
+    allLocalNodes.resize(nLocal);
+    for (u64 i=0; i<nLocal; i++) allLocalNodes[i] = i;
+    if (condense) prepareCondensation(Var);
+
+    // ------------------------ //
+    // Block-wise row numbering //
+    // ------------------------ //
+    // Rows are numbered over the nodes each rank owns, the upper interface rows are fetched from their owner through
+    // the halo sum. Element-interior nodes are left out of a condensed system.
+    const std::vector<u64> owned = ownedBlockNodes(Var);
+    u64 gNode[3];
+    auto inSystem = [&](u64 idx) -> b8 {
+        if (!condense) return TRUE;
+        globalNode(Var, idx, gNode);
+        return isSkeletonNode(Var, gNode);
+    };
+    u64 nOwned = 0;
+    for (const u64 idx : owned) nOwned += inSystem(idx);
+    std::vector<u64> ownedPerRank(nprocs);
+    MPI_Allgather(&nOwned, 1, MPI_UINT64_T, ownedPerRank.data(), 1, MPI_UINT64_T, comm);
+    ilower = 0;
+    for (i32 r=0; r<rankid; r++) ilower += ownedPerRank[r];
+    iupper = ilower + nOwned - 1;
+
+    EigenDefs::Vector<f64> rowNumbers;
+    zeroBlockVector(Var, rowNumbers);
+    HYPRE_BigInt row = ilower;
+    rowNodes.clear();
+    rowNodes.reserve(nOwned);
+    for (const u64 idx : owned) {
+        if (!inSystem(idx)) continue;
+        rowNumbers[idx] = row++;
+        rowNodes.push_back(idx);
+    }
+    sumShared(Var, rowNumbers);
+    systemRows.assign(nDOFs(Var), -1);
+    for (u64 idx=0; idx<nDOFs(Var); idx++) {
+        if (inSystem(idx)) systemRows[idx] = std::llround(rowNumbers[idx]);
+    }
+
+    // ------------------------ //
+    // Row preallocation        //
+    // ------------------------ //
+    // Per axis, a node shared by two elements couples to 2p+1 nodes, any other node to p+1. Exact for the full system
+    // and an upper bound for the condensed one.
+    std::vector<HYPRE_Int> rowSizes;
+    rowSizes.reserve(nOwned);
+    for (const u64 idx : rowNodes) {
+        globalNode(Var, idx, gNode);
+        HYPRE_Int size = 1;
+        if (!isBoundaryNode(Var, gNode)) {
+            for (u8 axis=0; axis<nDims; axis++) {
+                const u64 p = nNodes[Var][axis]-1;
+                size *= (gNode[axis]%p == 0 && gNode[axis] > 0 && gNode[axis] < nGlobal[Var][axis]-1) ? 2*p+1 : p+1;
+            }
+        }
+        rowSizes.push_back(size);
+    }
+    TRACE_MSG("Integrator.assembleStructure : Var %i - passed row numbering, rows [%lli, %lli]", Var, (i64) ilower, (i64) iupper)
+
+    HYPRE_IJMatrixCreate(comm, ilower, iupper, ilower, iupper, &A);
+    HYPRE_IJMatrixSetObjectType(A, HYPRE_PARCSR);
+    HYPRE_IJMatrixSetRowSizes(A, rowSizes.data());
+    HYPRE_IJMatrixInitialize(A);
+    HYPRE_IJVectorCreate(comm, ilower, iupper, &b);
+    HYPRE_IJVectorSetObjectType(b, HYPRE_PARCSR);
+    HYPRE_IJVectorInitialize(b);
+    HYPRE_IJVectorCreate(comm, ilower, iupper, &x);
+    HYPRE_IJVectorSetObjectType(x, HYPRE_PARCSR);
+    HYPRE_IJVectorInitialize(x);
+    isAssembled       = TRUE;
+    operatorValid     = FALSE;
+    matrixFilled      = FALSE;
+    assembledVar      = Var;
+    assembledRevision = geometry.revision;
+    condensedSystem   = condense;
+}
+
+void Integrator::assembleOperator() {
+
+    const u8  Var      = assembledVar;
+    const b8  condense = condensedSystem;
+    const u64 nLocal   = nNodes[Var][0]*nNodes[Var][1]*nNodes[Var][2];
+    if (condense) prepareCondensation(Var);
+
+    // The sparsity pattern is kept, only the values are reset
+    if (matrixFilled) {
+        HYPRE_IJMatrixSetConstantValues(A, 0.);
+        HYPRE_IJMatrixInitialize(A);
+    }
+
+    // ------------------------ //
+    // Element contributions    //
+    // ------------------------ //
+    // Condensation assembles the skeleton Schur complement instead of Ae, its nodes are listed in sysNodes. Only interior
+    // rows and columns are inserted, the boundary columns are lifted into the right-hand side by assembleRHS.
+    const b8  condenseElem = condense && !interiorLocal.empty();
+    const std::vector<Eigen::Index>& sysNodes = condenseElem ? skeletonLocal : allLocalNodes;
+    const u64 nSys = sysNodes.size();
+    const u64 nI = nNodes[Var][0], nIJ = nNodes[Var][0]*nNodes[Var][1];
+    const auto elementNode = [&](const u64 elemAxis[3], u64 l) { return localIndex(Var, elemAxis, l%nI, (l/nI)%nNodes[Var][1], l/nIJ); };
+
+    // The elements of a color fill disjoint ranges of one color buffer, placed by a counting pass, which is inserted into
+    // hypre (not thread-safe) by a single call from the master thread
+    u64 nColorMax = 0;
+    for (const std::vector<std::vector<u64>>* colors : {&geometry.interfaceColors, &geometry.interiorColors}) {
+        for (const std::vector<u64>& elems : *colors) nColorMax = std::max<u64>(nColorMax, elems.size());
+    }
+    std::vector<u64>          rowOffset(nColorMax+1, 0), valOffset(nColorMax+1, 0);
+    std::vector<HYPRE_BigInt> rows, cols;
+    std::vector<HYPRE_Int>    nCols;
+    std::vector<f64>          vals;
+    #pragma omp parallel num_threads(nThreads)
+    {
+        // Element matrix, Schur complement and A_IB on top of what applyElement takes
+        ElementWorkspace& ws = work[threadId()];
+        ws.reserve(elementWorkspaceSize(nLocal) + 3*(nLocal*nLocal + 8));
+        ElementWorkspace::Frame frame(ws);
+        Eigen::Map<EigenDefs::Matrix<f64>> Ae = ws.matrix(nLocal, nLocal);
+        Eigen::Map<EigenDefs::Matrix<f64>> S  = ws.matrix(condenseElem ? nSys : 0, condenseElem ? nSys : 0);
+        const Eigen::Map<const EigenDefs::Matrix<f64>> Asys(condenseElem ? S.data() : Ae.data(), nSys, nSys);
+        std::vector<HYPRE_BigInt> gIdx(nLocal);
+        std::vector<u64> sysRows(nSys);                 // entries of sysNodes off the domain boundary
+        u64 elemAxis[3], gElem[3];
+        for (const std::vector<std::vector<u64>>* colors : {&geometry.interfaceColors, &geometry.interiorColors}) {
+            for (const std::vector<u64>& elems : *colors) {
+                #pragma omp for schedule(static)
+                for (u64 n=0; n<elems.size(); n++) {
+                    geometry.localElemIndex(elems[n], elemAxis);
+                    u64 nRows = 0;
+                    for (const Eigen::Index l : sysNodes) {
+                        globalNode(Var, elementNode(elemAxis, l), gElem);
+                        if (!isBoundaryNode(Var, gElem)) nRows++;
+                    }
+                    rowOffset[n+1] = nRows;
+                    valOffset[n+1] = nRows*nRows;
+                }
+                #pragma omp single
+                {
+                    for (u64 n=0; n<elems.size(); n++) {
+                        rowOffset[n+1] += rowOffset[n];
+                        valOffset[n+1] += valOffset[n];
+                    }
+                    rows.resize(rowOffset[elems.size()]);
+                    nCols.resize(rowOffset[elems.size()]);
+                    cols.resize(valOffset[elems.size()]);
+                    vals.resize(valOffset[elems.size()]);
+                }
+
+                #pragma omp for schedule(static)
+                for (u64 n=0; n<elems.size(); n++) {
+                    const u64 elem = elems[n];
+                    geometry.localElemIndex(elem, elemAxis);
+                    elementMatrix(Var, elem, elemAxis, Ae, ws);
+                    if (condenseElem) condenseElement(elem, Ae, S, ws);
+
+                    u64 nRows = 0;
+                    for (u64 i=0; i<nSys; i++) {
+                        const u64 idx = elementNode(elemAxis, sysNodes[i]);
+                        globalNode(Var, idx, gElem);
+                        gIdx[i] = systemRows[idx];
+                        if (!isBoundaryNode(Var, gElem)) sysRows[nRows++] = i;
+                    }
+
+                    u64 r = rowOffset[n], v = valOffset[n];
+                    for (u64 i=0; i<nRows; i++, r++) {
+                        rows[r]  = gIdx[sysRows[i]];
+                        nCols[r] = nRows;
+                        for (u64 j=0; j<nRows; j++, v++) {
+                            cols[v] = gIdx[sysRows[j]];
+                            vals[v] = Asys(sysRows[i], sysRows[j]);
+                        }
+                    }
+                }
+
+                #pragma omp master
+                if (!rows.empty()) HYPRE_IJMatrixAddToValues(A, rows.size(), nCols.data(), rows.data(), cols.data(), vals.data());
+                #pragma omp barrier
+            }
+        }
+    }
+    if (condense) finishCondensation();
+    TRACE_MSG("Integrator.assembleOperator : Var %i - passed element contributions", Var)
+
+    // ------------------------ //
+    // Owned Dirichlet rows     //
+    // ------------------------ //
+    rows.clear(); nCols.clear(); vals.clear();
+    u64 gNode[3];
+    for (const u64 idx : rowNodes) {
+        globalNode(Var, idx, gNode);
+        if (!isBoundaryNode(Var, gNode)) continue;
+        rows.push_back(systemRows[idx]);
+        nCols.push_back(1);
+        vals.push_back(1.);
+    }
+    if (!rows.empty()) HYPRE_IJMatrixAddToValues(A, rows.size(), nCols.data(), rows.data(), rows.data(), vals.data());
+
+    HYPRE_IJMatrixAssemble(A);
+    assembledMass = massCoeff;
+    assembledDiff = diffCoeff;
+    operatorValid = TRUE;
+    matrixFilled  = TRUE;
+    u64 nRows = iupper-ilower+1;
+    MPI_Allreduce(MPI_IN_PLACE, &nRows, 1, MPI_UINT64_T, MPI_SUM, comm);
+    INFO_MSG("Integrator.assemble : Var %i - hypre operator of %llu rows assembled (%llu nodes)", Var, nRows, nGlobalDOFs(Var))
+}
+
+void Integrator::assembleRHS(PointFunction f, PointFunction g) {
+
+    const u8  Var    = assembledVar;
+    const u64 nLocal = nNodes[Var][0]*nNodes[Var][1]*nNodes[Var][2];
+    const b8  condense = condensedSystem && !interiorLocal.empty();
+
+    // ------------------------ //
+    // Element right-hand sides //
+    // ------------------------ //
+    // c_e = b_e - A_e g_e with A_e applied matrix-free, condensed to c_B - X^T c_I, summed over the elements like sourceOmega
+    EigenDefs::Vector<f64> rhsBlock;
+    zeroBlockVector(Var, rhsBlock);
+    #pragma omp parallel num_threads(nThreads)
+    {
+        // Four local tensors and the interior/skeleton splits on top of what applyElement takes
+        ElementWorkspace& ws = work[threadId()];
+        ws.reserve(elementWorkspaceSize(nLocal) + 6*(nLocal+8));
+        ElementWorkspace::Frame frame(ws);
+        Eigen::Map<EigenDefs::Array1D<f64>> ue = ws.array(nLocal), ye = ws.array(nLocal);
+        Eigen::Map<EigenDefs::Vector<f64>>  be(ws.array(nLocal).data(), nLocal), ce(ws.array(nLocal).data(), nLocal),
+                                            cI(ws.array(interiorLocal.size()).data(), interiorLocal.size()),
+                                            cB(ws.array(skeletonLocal.size()).data(), skeletonLocal.size());
+        std::vector<b8> isBnd(nLocal);
+        u64 elemAxis[3], gElem[3];
+        f64 xElem[3];
+        ASSERT_NO_ALLOCATION("Integrator.assembleRHS")
+        for (const std::vector<std::vector<u64>>* colors : {&geometry.interfaceColors, &geometry.interiorColors}) {
+            for (const std::vector<u64>& elems : *colors) {
+                #pragma omp for schedule(static)
+                for (u64 n=0; n<elems.size(); n++) {
+                    const u64 elem = elems[n];
+                    geometry.localElemIndex(elem, elemAxis);
+                    elementMassDiagonal(Var, elem, elemAxis, be.data());
+
+                    u64 local = 0;
+                    for (u64 k=0; k<nNodes[Var][2]; k++) {
+                        for (u64 j=0; j<nNodes[Var][1]; j++) {
+                            for (u64 i=0; i<nNodes[Var][0]; i++, local++) {
+                                const u64 idx = localIndex(Var, elemAxis, i, j, k);
+                                globalNode(Var, idx, gElem);
+                                isBnd[local] = isBoundaryNode(Var, gElem);
+                                nodeCoordinates(Var, idx, xElem);
+                                ue[local] = isBnd[local] ? g(xElem[0], xElem[1], xElem[2]) : 0.;
+                                be[local]    = isBnd[local] ? 0. : be[local]*f(xElem[0], xElem[1], xElem[2]);
+                            }
+                        }
+                    }
+                    applyElement(Var, elem, elemAxis, ue.data(), ye.data(), ws);
+                    ce = be - ye.matrix();
+
+                    if (condense) {
+                        // Gathered into the workspace first, products on indexed views would be evaluated on the heap
+                        CondensedElement& cached = condensed[elem];
+                        cached.bI = be(interiorLocal);
+                        cI = ce(interiorLocal);
+                        cB = ce(skeletonLocal);
+                        cB.noalias() -= cached.X.transpose()*cI;
+                        ce(skeletonLocal) = cB;
+                    }
+                    for (u64 l=0; l<nLocal; l++) if (isBnd[l]) ce[l] = 0.;
+                    scatterAdd(Var, elemAxis, ce.data(), rhsBlock);
+                }
+            }
+        }
+    }
+    sumShared(Var, rhsBlock);
+
+    // ------------------------ //
+    // Owned rows               //
+    // ------------------------ //
+    // Set directly, every contribution was already summed into the owned rows by the halo sum
+    const i32 nOwned = iupper-ilower+1;
+    std::vector<HYPRE_BigInt> indices(nOwned);
+    std::vector<f64>          values(nOwned), zeros(nOwned, 0.);
+    u64 gNode[3];
+    f64 xPoint[3];
+    for (i32 i=0; i<nOwned; i++) {
+        const u64 idx = rowNodes[i];
+        indices[i] = ilower+i;
+        globalNode(Var, idx, gNode);
+        if (isBoundaryNode(Var, gNode)) {
+            nodeCoordinates(Var, idx, xPoint);
+            values[i] = g(xPoint[0], xPoint[1], xPoint[2]);
+        }
+        else values[i] = rhsBlock[idx];
+    }
+    HYPRE_IJVectorSetValues(b, nOwned, indices.data(), values.data());
+    HYPRE_IJVectorSetValues(x, nOwned, indices.data(), zeros.data());
+    HYPRE_IJVectorAssemble(b);
+    HYPRE_IJVectorAssemble(x);
+    TRACE_MSG("Integrator.assembleRHS : Var %i - passed right-hand side", Var)
+}
+
+void Integrator::createAMG(HYPRE_Solver& amg_) const {
+
+    HYPRE_BoomerAMGCreate(&amg_);
+    HYPRE_BoomerAMGSetPrintLevel(amg_, params.amgPrintLevel);
+    HYPRE_BoomerAMGSetCoarsenType(amg_, params.amgCoarsenType);
+    HYPRE_BoomerAMGSetInterpType(amg_, params.amgInterpType);
+    HYPRE_BoomerAMGSetRelaxType(amg_, params.amgRelaxType);
+    HYPRE_BoomerAMGSetNumSweeps(amg_, params.amgNumSweeps);
+    HYPRE_BoomerAMGSetAggNumLevels(amg_, params.amgAggNumLevels);
+    HYPRE_BoomerAMGSetMaxLevels(amg_, params.amgMaxLevels);
+    HYPRE_BoomerAMGSetStrongThreshold(amg_, params.amgStrongThresh);
+    HYPRE_BoomerAMGSetTol(amg_, 0.0);   // one V-cycle per application
+    HYPRE_BoomerAMGSetMaxIter(amg_, 1);
+}
+
+i32 Integrator::solve(EigenDefs::Vector<f64>& u) {
+
+    PROFILE_SCOPE("Integrator.solve")
+
+    CHECK_FATAL_ASSERT(isAssembled && operatorValid, "assemble must be called first before calling upon this function")
+
+    HYPRE_ParCSRMatrix parA;
+    HYPRE_ParVector    parb, parx;
+    HYPRE_IJMatrixGetObject(A, (void**) &parA);
+    HYPRE_IJVectorGetObject(b, (void**) &parb);
+    HYPRE_IJVectorGetObject(x, (void**) &parx);
+
+    // ------------------------ //
+    // Krylov solver setup      //
+    // ------------------------ //
+    // Built once per operator, the BoomerAMG hierarchy is computed by the Krylov setup
+    if (!hasSolver) {
+        createAMG(solverAMG);
+        solverKrylov = params.krylov;
+        if (solverKrylov == KRYLOV_PCG) {
+            HYPRE_ParCSRPCGCreate(comm, &solver);
+            HYPRE_PCGSetTol(solver, params.tol);
+            HYPRE_PCGSetMaxIter(solver, params.maxIter);
+            HYPRE_PCGSetTwoNorm(solver, 1);
+            HYPRE_PCGSetPrintLevel(solver, params.printLevel);
+            HYPRE_PCGSetPrecond(solver, (HYPRE_PtrToSolverFcn) HYPRE_BoomerAMGSolve, (HYPRE_PtrToSolverFcn) HYPRE_BoomerAMGSetup, solverAMG);
+            HYPRE_ParCSRPCGSetup(solver, parA, parb, parx);
+        }
+        else {
+            HYPRE_ParCSRGMRESCreate(comm, &solver);
+            HYPRE_GMRESSetKDim(solver, params.kDim);
+            HYPRE_GMRESSetTol(solver, params.tol);
+            HYPRE_GMRESSetMaxIter(solver, params.maxIter);
+            HYPRE_GMRESSetPrintLevel(solver, params.printLevel);
+            HYPRE_GMRESSetPrecond(solver, (HYPRE_PtrToSolverFcn) HYPRE_BoomerAMGSolve, (HYPRE_PtrToSolverFcn) HYPRE_BoomerAMGSetup, solverAMG);
+            HYPRE_ParCSRGMRESSetup(solver, parA, parb, parx);
+        }
+        hasSolver = TRUE;
+        TRACE_MSG("Integrator.solve : Var %i - passed Krylov and BoomerAMG setup", assembledVar)
+    }
+
+    // ------------------------ //
+    // Krylov solve             //
+    // ------------------------ //
+    HYPRE_Int nIter = 0;
+    HYPRE_Real residual = 0.;
+    if (solverKrylov == KRYLOV_PCG) {
+        HYPRE_ParCSRPCGSolve(solver, parA, parb, parx);
+        HYPRE_PCGGetNumIterations(solver, &nIter);
+        HYPRE_PCGGetFinalRelativeResidualNorm(solver, &residual);
+    }
+    else {
+        HYPRE_ParCSRGMRESSolve(solver, parA, parb, parx);
+        HYPRE_GMRESGetNumIterations(solver, &nIter);
+        HYPRE_GMRESGetFinalRelativeResidualNorm(solver, &residual);
+    }
+    if (residual > params.tol) WARN_MSG("Integrator.solve : not converged, relative residual %e after %i iterations", residual, nIter)
+    else                       INFO_MSG("Integrator.solve : converged, relative residual %e after %i iterations", residual, nIter)
+
+    extractSolution(u);
+    return nIter;
+}
+
+void Integrator::extractSolution(EigenDefs::Vector<f64>& u) {
+
+    const u8  Var    = assembledVar;
+    const i32 nOwned = iupper-ilower+1;
+    std::vector<HYPRE_BigInt> indices(nOwned);
+    std::vector<f64>          values(nOwned);
+    for (i32 i=0; i<nOwned; i++) indices[i] = ilower+i;
+    HYPRE_IJVectorGetValues(x, nOwned, indices.data(), values.data());
+
+    // Owned nodes are written, the upper interface nodes stay 0 and are filled in by their owner through the halo sum
+    zeroBlockVector(Var, u);
+    for (i32 i=0; i<nOwned; i++) u[rowNodes[i]] = values[i];
+    sumShared(Var, u);
+    if (condensedSystem) recoverInterior(u);
+}
+
+void Integrator::setupAMG() {
+
+    PROFILE_SCOPE("Integrator.setupAMG")
+
+    CHECK_FATAL_ASSERT(isAssembled && operatorValid && !condensedSystem, 
+                       "An uncondensed system must be assembled first before calling upon this function")
+    if (hasAMG) return;
+
+    HYPRE_ParCSRMatrix parA;
+    HYPRE_ParVector    parb, parx;
+    HYPRE_IJMatrixGetObject(A, (void**) &parA);
+    HYPRE_IJVectorGetObject(b, (void**) &parb);
+    HYPRE_IJVectorGetObject(x, (void**) &parx);
+
+    createAMG(amg);
+    HYPRE_BoomerAMGSetup(amg, parA, parb, parx);
+    hasAMG = TRUE;
+}
+
+void Integrator::applyAMG(const EigenDefs::Vector<f64>& r, EigenDefs::Vector<f64>& z) {
+
+    PROFILE_SCOPE("Integrator.applyAMG")
+
+    CHECK_FATAL_ASSERT(hasAMG, "setupAMG must be called first before calling upon this function")
+
+    // Owned rows of r and a zero initial guess
+    const i32 nOwned = iupper-ilower+1;
+    std::vector<HYPRE_BigInt> indices(nOwned);
+    std::vector<f64>          values(nOwned), zeros(nOwned, 0.);
+    for (i32 i=0; i<nOwned; i++) {
+        indices[i] = ilower+i;
+        values[i]  = r[rowNodes[i]];
+    }
+    HYPRE_IJVectorSetValues(b, nOwned, indices.data(), values.data());
+    HYPRE_IJVectorSetValues(x, nOwned, indices.data(), zeros.data());
+
+    HYPRE_ParCSRMatrix parA;
+    HYPRE_ParVector    parb, parx;
+    HYPRE_IJMatrixGetObject(A, (void**) &parA);
+    HYPRE_IJVectorGetObject(b, (void**) &parb);
+    HYPRE_IJVectorGetObject(x, (void**) &parx);
+    HYPRE_BoomerAMGSolve(amg, parA, parb, parx);
+
+    extractSolution(z);
+}
+
+void Integrator::zeroBlockVector(u8 Var, EigenDefs::Vector<f64>& y) const {
+
+    const i64 n = nDOFs(Var);
+    y.resize(n);
+    #pragma omp parallel for schedule(static) num_threads(nThreads)
+    for (i64 i=0; i<n; i++) y[i] = 0.;
+}
+
+void Integrator::gather(u8 Var, const u64 elemAxis[3], const EigenDefs::Vector<f64>& u, f64* ue_) const {
+
+    const std::vector<u64>& n = nNodes[Var];
+    const std::vector<u64>& N = nBlock[Var];
+    // First block node of the element per axis, neighbouring elements share their end nodes
+    const u64 s0 = (elemAxis[0]-geometry.elemBegin[0])*(n[0]-1), s1 = (elemAxis[1]-geometry.elemBegin[1])*(n[1]-1), 
+              s2 = (elemAxis[2]-geometry.elemBegin[2])*(n[2]-1);
+
+    for (u64 k=0; k<n[2]; k++) {
+        for (u64 j=0; j<n[1]; j++) {
+            const f64* uRow = u.data() + s0 + N[0]*((s1+j) + N[1]*(s2+k));
+            f64*      ueRow = ue_ + n[0]*(j + n[1]*k);
+            for (u64 i=0; i<n[0]; i++) ueRow[i] = uRow[i];
+        }
+    }
+}
+
+void Integrator::scatterAdd(u8 Var, const u64 elemAxis[3], const f64* ye_, EigenDefs::Vector<f64>& y) const {
+
+    const std::vector<u64>& n = nNodes[Var];
+    const std::vector<u64>& N = nBlock[Var];
+    const u64 s0 = (elemAxis[0]-geometry.elemBegin[0])*(n[0]-1), s1 = (elemAxis[1]-geometry.elemBegin[1])*(n[1]-1), 
+              s2 = (elemAxis[2]-geometry.elemBegin[2])*(n[2]-1);
+
+    for (u64 k=0; k<n[2]; k++) {
+        for (u64 j=0; j<n[1]; j++) {
+            f64*       yRow = y.data() + s0 + N[0]*((s1+j) + N[1]*(s2+k));
+            const f64* yeRow = ye_ + n[0]*(j + n[1]*k);
+            for (u64 i=0; i<n[0]; i++) yRow[i] += yeRow[i];
+        }
+    }
+}
+
+void Integrator::gatherBatch(u8 Var, const u64 elemAxis[3], const EigenDefs::Matrix<f64>& U, f64* ue_) const {
+
+    const std::vector<u64>& n = nNodes[Var];
+    const std::vector<u64>& N = nBlock[Var];
+    const u64 s0 = (elemAxis[0]-geometry.elemBegin[0])*(n[0]-1), s1 = (elemAxis[1]-geometry.elemBegin[1])*(n[1]-1), 
+              s2 = (elemAxis[2]-geometry.elemBegin[2])*(n[2]-1);
+    const u64 nLocal = n[0]*n[1]*n[2];
+
+    for (Eigen::Index c=0; c<U.cols(); c++) {
+        const f64* u = U.col(c).data();
+        f64*      ue = ue_ + c*nLocal;
+        for (u64 k=0; k<n[2]; k++) {
+            for (u64 j=0; j<n[1]; j++) {
+                const f64* uRow = u + s0 + N[0]*((s1+j) + N[1]*(s2+k));
+                f64*      ueRow = ue + n[0]*(j + n[1]*k);
+                for (u64 i=0; i<n[0]; i++) ueRow[i] = uRow[i];
+            }
+        }
+    }
+}
+
+void Integrator::scatterAddBatch(u8 Var, const u64 elemAxis[3], const f64* ye_, EigenDefs::Matrix<f64>& Y) const {
+
+    const std::vector<u64>& n = nNodes[Var];
+    const std::vector<u64>& N = nBlock[Var];
+    const u64 s0 = (elemAxis[0]-geometry.elemBegin[0])*(n[0]-1), s1 = (elemAxis[1]-geometry.elemBegin[1])*(n[1]-1), 
+              s2 = (elemAxis[2]-geometry.elemBegin[2])*(n[2]-1);
+    const u64 nLocal = n[0]*n[1]*n[2];
+
+    for (Eigen::Index c=0; c<Y.cols(); c++) {
+        f64*       y  = Y.col(c).data();
+        const f64* ye = ye_ + c*nLocal;
+        for (u64 k=0; k<n[2]; k++) {
+            for (u64 j=0; j<n[1]; j++) {
+                f64*       yRow = y + s0 + N[0]*((s1+j) + N[1]*(s2+k));
+                const f64* yeRow = ye + n[0]*(j + n[1]*k);
+                for (u64 i=0; i<n[0]; i++) yRow[i] += yeRow[i];
+            }
+        }
+    }
+}
+
+} // end Physics
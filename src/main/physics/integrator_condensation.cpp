@@ -0,0 +1,127 @@
+#include "CoreIncludes.hpp"
+#include "integrator.hpp"
+
+namespace Physics {
+
+b8 Integrator::isSkeletonNode(u8 Var, const u64 g[3]) const {
+
+    for (u8 axis=0; axis<nDims; axis++) {
+        if (g[axis]%(nNodes[Var][axis]-1) == 0) return TRUE;
+    }
+    return FALSE;
+}
+
+void Integrator::prepareCondensation(u8 Var) {
+
+    PROFILE_SCOPE("Integrator.prepareCondensation")
+
+    // ------------------------ //
+    // Element node split       //
+    // ------------------------ //
+    // Interior nodes have every axis index strictly inside (0,p), all others sit on the element boundary
+    interiorLocal.clear();
+    skeletonLocal.clear();
+    u64 local = 0;
+    for (u64 k=0; k<nNodes[Var][2]; k++) {
+        for (u64 j=0; j<nNodes[Var][1]; j++) {
+            for (u64 i=0; i<nNodes[Var][0]; i++, local++) {
+                const u64 g[3] = {i, j, k};
+                if (isSkeletonNode(Var, g)) skeletonLocal.push_back(local);
+                else                        interiorLocal.push_back(local);
+            }
+        }
+    }
+
+    // ------------------------ //
+    // Cache validity           //
+    // ------------------------ //
+    // The element factors depend on the variable (order), the heat coefficients and the metrics only, not on f or g
+    const u64 nElem = geometry.nElemsLocal();
+    if (!condensedValid || condensedVar != Var || condensedMass != massCoeff || condensedDiff != diffCoeff ||
+        condensedRevision != geometry.revision || condensed.size() != nElem) {
+        condensedValid = FALSE;
+        condensed.clear();
+        condensed.resize(nElem);
+    }
+
+    // Sized here, so that assembleRHS only overwrites the interior right-hand sides
+    for (CondensedElement& ce : condensed) ce.bI.resize(interiorLocal.size());
+    TRACE_MSG("Integrator.prepareCondensation : Var %i - %llu interior, %llu skeleton nodes per element, %s factors", Var,
+              (u64) interiorLocal.size(), (u64) skeletonLocal.size(), condensedValid ? "cached" : "new")
+}
+
+void Integrator::condenseElement(u64 elem, const Eigen::Ref<const EigenDefs::Matrix<f64>>& Ae, Eigen::Ref<EigenDefs::Matrix<f64>> S,
+                                 ElementWorkspace& ws) {
+
+    const u64 nInterior = interiorLocal.size(), nSkeleton = skeletonLocal.size();
+    CHECK_FATAL_ASSERT(nInterior > 0, "Element has no interior nodes to condense")
+    CHECK_FATAL_ASSERT(static_cast<u64>(S.rows()) == nSkeleton && static_cast<u64>(S.cols()) == nSkeleton, 
+                       "Schur complement must be nSkeleton x nSkeleton")
+
+    // Only condensed[elem] is written, so elements may be condensed concurrently
+    CondensedElement& ce = condensed[elem];
+    if (!condensedValid) {
+        ce.AII.compute(Ae(interiorLocal, interiorLocal));
+        CHECK_FATAL_ASSERT(ce.AII.info() == Eigen::Success, "element interior block is not positive definite")
+        ce.X = ce.AII.solve(Ae(interiorLocal, skeletonLocal));
+    }
+
+    // S = A_BB - A_IB^T X, A_IB is gathered first so that the product runs on plain storage
+    ElementWorkspace::Frame frame(ws);
+    Eigen::Map<EigenDefs::Matrix<f64>> AIB = ws.matrix(nInterior, nSkeleton);
+    AIB = Ae(interiorLocal, skeletonLocal);
+    S   = Ae(skeletonLocal, skeletonLocal);
+    S.noalias() -= AIB.transpose()*ce.X;
+}
+
+void Integrator::finishCondensation() {
+
+    condensedValid = TRUE;
+    condensedVar   = assembledVar;
+    condensedMass  = massCoeff;
+    condensedDiff  = diffCoeff;
+    condensedRevision = geometry.revision;
+}
+
+void Integrator::recoverInterior(EigenDefs::Vector<f64>& u) {
+
+    if (interiorLocal.empty()) return;
+
+    const u8  Var    = condensedVar;
+    const u64 nLocal = nNodes[Var][0]*nNodes[Var][1]*nNodes[Var][2];
+    const i64 nElem  = geometry.nElemsLocal();
+
+    // Interior nodes belong to a single element and are never shared between ranks, so no halo exchange follows
+    #pragma omp parallel num_threads(nThreads)
+    {
+        ElementWorkspace& ws = work[threadId()];
+        ElementWorkspace::Frame frame(ws);
+        Eigen::Map<EigenDefs::Vector<f64>> ue(ws.array(nLocal).data(), nLocal), 
+                                           uI(ws.array(interiorLocal.size()).data(), interiorLocal.size()),
+                                           uB(ws.array(skeletonLocal.size()).data(), skeletonLocal.size());
+        u64 elemAxis[3];
+        ASSERT_NO_ALLOCATION("Integrator.recoverInterior")
+
+        #pragma omp for schedule(static)
+        for (i64 elem=0; elem<nElem; elem++) {
+            const CondensedElement& ce = condensed[elem];
+            geometry.localElemIndex(elem, elemAxis);
+            gather(Var, elemAxis, u, ue.data());
+
+            uI = ce.bI;
+            ce.AII.solveInPlace(uI);
+            uB = ue(skeletonLocal);
+            uI.noalias() -= ce.X*uB;
+
+            for (u64 n=0; n<interiorLocal.size(); n++) {
+                const u64 local = interiorLocal[n];
+                const u64 i = local%nNodes[Var][0], j = (local/nNodes[Var][0])%nNodes[Var][1],
+                          k = local/(nNodes[Var][0]*nNodes[Var][1]);
+                u[localIndex(Var, elemAxis, i, j, k)] = uI[n];
+            }
+        }
+    }
+    TRACE_MSG("Integrator.recoverInterior : Var %i - passed interior back-substitution", Var)
+}
+
+} // end Physics
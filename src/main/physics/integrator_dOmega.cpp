@@ -0,0 +1,33 @@
+#include "CoreIncludes.hpp"
+#include "integrator.hpp"
+
+namespace Physics {
+
+b8 Integrator::isBoundaryNode(u8 Var, const u64 g[3]) const {
+
+    for (u8 axis=0; axis<nDims; axis++) {
+        if (g[axis] == 0 || g[axis] == nGlobal[Var][axis]-1) return TRUE;
+    }
+    return FALSE;
+}
+
+b8 Integrator::isBoundaryDOF(u8 Var, u64 idx) const {
+
+    u64 g[3];
+    globalNode(Var, idx, g);
+    return isBoundaryNode(Var, g);
+}
+
+std::vector<u64> Integrator::boundaryDOFs(u8 Var) const {
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+
+    std::vector<u64> out;
+    for (u64 idx=0; idx<nDOFs(Var); idx++) {
+        if (isBoundaryDOF(Var, idx)) out.push_back(idx);
+    }
+    TRACE_MSG("Integrator.boundaryDOFs : Var %i - %llu boundary nodes", Var, (u64) out.size())
+    return out;
+}
+
+} // end Physics
@@ -0,0 +1,430 @@
+#include "CoreIncludes.hpp"
+#include "integrator.hpp"
+
+namespace Physics {
+
+void Integrator::setupFastDiagonalization(u8 Var) {
+
+    PROFILE_SCOPE("Integrator.setupFastDiagonalization")
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(massCoeff >= 0. && diffCoeff >= 0. && massCoeff + diffCoeff > 0.,
+                       "Fast diagonalization requires non-negative heat coefficients, not both 0")
+
+    FastDiagonalization& F = fdm[Var];
+    const std::vector<u64>& N = nBlock[Var];
+    F.V.assign(3, EigenDefs::Matrix<f64>::Ones(1,1));
+    F.Vt.assign(3, EigenDefs::Matrix<f64>::Ones(1,1));
+    std::vector<EigenDefs::Array1D<f64>> lambda(3, EigenDefs::Array1D<f64>::Zero(1));
+    std::vector<EigenDefs::Array1D<f64>> Mdiag(3, EigenDefs::Array1D<f64>::Ones(1)), Kdiag(3, EigenDefs::Array1D<f64>::Zero(1));
+
+    // ------------------------ //
+    // 1D operators per axis    //
+    // ------------------------ //
+    // Block-local SEM stiffness K = sum_e (1/h_e) D^T W D and lumped mass M = sum_e h_e W, h_e the element half-width
+    for (u8 axis=0; axis<nDims; axis++) {
+        const u64 p = nNodes[Var][axis]-1;
+        const EigenDefs::Array1D<f64>& w = master.getWeights(Var, axis);
+        const EigenDefs::Matrix<f64> DtWD = Dt[Var][axis] * w.matrix().asDiagonal() * D[Var][axis];
+
+        EigenDefs::Matrix<f64>  K = EigenDefs::Matrix<f64>::Zero(N[axis], N[axis]);
+        EigenDefs::Array1D<f64> M = EigenDefs::Array1D<f64>::Zero(N[axis]);
+        for (u64 elem=geometry.elemBegin[axis]; elem<geometry.elemEnd[axis]; elem++) {
+            const u64 s  = (elem-geometry.elemBegin[axis])*p;
+            const f64 hw = geometry.halfWidths[axis][elem];
+            K.block(s, s, p+1, p+1) += DtWD / hw;
+            M.segment(s, p+1)       += hw * w;
+        }
+        Kdiag[axis] = K.diagonal().array();
+        Mdiag[axis] = M;
+
+        // Generalized eigenproblem on the block-interior nodes through the symmetric form M^{-1/2} K M^{-1/2}
+        const u64 nI = N[axis]-2;
+        F.n[axis] = nI;
+        if (nI == 0) continue;
+        const EigenDefs::Vector<f64> Mis = M.segment(1, nI).rsqrt().matrix();
+        const EigenDefs::Matrix<f64> S   = Mis.asDiagonal() * K.block(1, 1, nI, nI) * Mis.asDiagonal();
+        Eigen::SelfAdjointEigenSolver<EigenDefs::Matrix<f64>> eig(S);
+        CHECK_FATAL_ASSERT(eig.info() == Eigen::Success, "1D eigenproblem of the fast diagonalization failed")
+        F.V[axis]     = Mis.asDiagonal() * eig.eigenvectors();
+        F.Vt[axis]    = F.V[axis].transpose();
+        lambda[axis]  = eig.eigenvalues().array();
+    }
+    for (u8 axis=nDims; axis<3; axis++) F.n[axis] = 1;
+
+    // ------------------------ //
+    // Inverse eigenvalues      //
+    // ------------------------ //
+    const u64 nInner = F.n[0]*F.n[1]*F.n[2];
+    F.invLambda.resize(nInner);
+    for (u64 k=0; k<F.n[2]; k++) {
+        for (u64 j=0; j<F.n[1]; j++) {
+            for (u64 i=0; i<F.n[0]; i++) {
+                const u64 ijk[3] = {i, j, k};
+                f64 sum = 0.;
+                for (u8 axis=0; axis<nDims; axis++) sum += lambda[axis][ijk[axis]];
+                F.invLambda[i + F.n[0]*(j + F.n[1]*k)] = 1. / (massCoeff + diffCoeff*sum);
+            }
+        }
+    }
+    F.bufA.resize(nInner);
+    F.bufB.resize(nInner);
+
+    // ------------------------ //
+    // Interface diagonal       //
+    // ------------------------ //
+    // The block is a box of elements, so its share of the operator diagonal factorizes over the 1D block operators
+    EigenDefs::Vector<f64> diag;
+    zeroBlockVector(Var, diag);
+    F.interfaceNodes.clear();
+    u64 gNode[3];
+    for (u64 k=0; k<N[2]; k++) {
+        for (u64 j=0; j<N[1]; j++) {
+            for (u64 i=0; i<N[0]; i++) {
+                const u64 ijk[3] = {i, j, k};
+                b8 isInner = TRUE;
+                for (u8 axis=0; axis<nDims; axis++) isInner = isInner && ijk[axis] > 0 && ijk[axis] < N[axis]-1;
+                const u64 idx = i + N[0]*(j + N[1]*k);
+                globalNode(Var, idx, gNode);
+                if (isInner || isBoundaryNode(Var, gNode)) continue;
+
+                f64 mass = massCoeff, stiff = 0.;
+                for (u8 a=0; a<nDims; a++) {
+                    mass *= Mdiag[a][ijk[a]];
+                    f64 term = diffCoeff*Kdiag[a][ijk[a]];
+                    for (u8 b=0; b<nDims; b++) if (b != a) term *= Mdiag[b][ijk[b]];
+                    stiff += term;
+                }
+                diag[idx] = mass + stiff;
+                F.interfaceNodes.push_back(idx);
+            }
+        }
+    }
+    sumShared(Var, diag);
+    F.interfaceInvDiag.resize(F.interfaceNodes.size());
+    for (u64 n=0; n<F.interfaceNodes.size(); n++) F.interfaceInvDiag[n] = 1. / diag[F.interfaceNodes[n]];
+
+    F.massCoeff = massCoeff;
+    F.diffCoeff = diffCoeff;
+    F.revision  = geometry.revision;
+    F.isSet     = TRUE;
+    TRACE_MSG("Integrator.setupFastDiagonalization : Var %i - %llu x %llu x %llu block-interior nodes, %llu interface nodes",
+              Var, F.n[0], F.n[1], F.n[2], (u64) F.interfaceNodes.size())
+}
+
+void Integrator::applyFastDiagonalization(u8 Var, const EigenDefs::Vector<f64>& r, EigenDefs::Vector<f64>& z) {
+
+    PROFILE_SCOPE("Integrator.applyFastDiagonalization")
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(fdm[Var].isSet, "setupFastDiagonalization must be called first before calling upon this function")
+    CHECK_FATAL_ASSERT(static_cast<u64>(r.rows()) == nDOFs(Var), "Input vector does not match the number of DOFs")
+
+    FastDiagonalization& F = fdm[Var];
+    const std::vector<u64>& N = nBlock[Var];
+    const u64 lo[3]  = {nDims > 0 ? 1ull : 0ull, nDims > 1 ? 1ull : 0ull, nDims > 2 ? 1ull : 0ull};
+    const i64 nSlab  = F.n[2];
+    zeroBlockVector(Var, z);
+
+    if (F.invLambda.size() > 0) {
+        // Block-interior residual, x1 running fastest
+        #pragma omp parallel for schedule(static) num_threads(nThreads)
+        for (i64 k=0; k<nSlab; k++) {
+            for (u64 j=0; j<F.n[1]; j++) {
+                const f64* rRow = r.data() + lo[0] + N[0]*((j+lo[1]) + N[1]*(k+lo[2]));
+                f64*       aRow = F.bufA.data() + F.n[0]*(j + F.n[1]*k);
+                for (u64 i=0; i<F.n[0]; i++) aRow[i] = rRow[i];
+            }
+        }
+
+        // (V^T x V^T x V^T) r, scale by the inverse eigenvalues, then (V x V x V)
+        f64* in  = F.bufA.data();
+        f64* out = F.bufB.data();
+        for (u8 axis=0; axis<nDims; axis++) { tensorApply(F.Vt[axis], axis, F.n, in, out); std::swap(in, out); }
+        Eigen::Map<EigenDefs::Array1D<f64>>(in, F.invLambda.size()) *= F.invLambda;
+        for (u8 axis=0; axis<nDims; axis++) { tensorApply(F.V[axis], axis, F.n, in, out); std::swap(in, out); }
+
+        #pragma omp parallel for schedule(static) num_threads(nThreads)
+        for (i64 k=0; k<nSlab; k++) {
+            for (u64 j=0; j<F.n[1]; j++) {
+                f64*       zRow = z.data() + lo[0] + N[0]*((j+lo[1]) + N[1]*(k+lo[2]));
+                const f64* aRow = in + F.n[0]*(j + F.n[1]*k);
+                for (u64 i=0; i<F.n[0]; i++) zRow[i] = aRow[i];
+            }
+        }
+    }
+
+    // Jacobi on the interface nodes, their residual is consistent across ranks so z stays consistent too
+    for (u64 n=0; n<F.interfaceNodes.size(); n++) z[F.interfaceNodes[n]] = F.interfaceInvDiag[n] * r[F.interfaceNodes[n]];
+}
+
+void Integrator::applyFastDiagonalization(u8 Var, const EigenDefs::Matrix<f64>& R, EigenDefs::Matrix<f64>& Z) {
+
+    PROFILE_SCOPE("Integrator.applyFastDiagonalization")
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(fdm[Var].isSet, "setupFastDiagonalization must be called first before calling upon this function")
+    CHECK_FATAL_ASSERT(static_cast<u64>(R.rows()) == nDOFs(Var), "Input block vectors do not match the number of DOFs")
+
+    FastDiagonalization& F = fdm[Var];
+    const std::vector<u64>& N = nBlock[Var];
+    const u64 lo[3]     = {nDims > 0 ? 1ull : 0ull, nDims > 1 ? 1ull : 0ull, nDims > 2 ? 1ull : 0ull};
+    const u64 nInterior = F.invLambda.size();
+    const u64 nBatch    = R.cols();
+    const i64 nSlab     = F.n[2]*nBatch;
+    Z.setZero(R.rows(), nBatch);
+
+    if (nInterior > 0) {
+        if (static_cast<u64>(F.bufA.size()) < nInterior*nBatch) {
+            F.bufA.resize(nInterior*nBatch);
+            F.bufB.resize(nInterior*nBatch);
+        }
+
+        // Block-interior residuals one after the other, x1 running fastest
+        #pragma omp parallel for schedule(static) num_threads(nThreads)
+        for (i64 s=0; s<nSlab; s++) {
+            const u64 c = s / F.n[2], k = s % F.n[2];
+            for (u64 j=0; j<F.n[1]; j++) {
+                const f64* rRow = R.col(c).data() + lo[0] + N[0]*((j+lo[1]) + N[1]*(k+lo[2]));
+                f64*       aRow = F.bufA.data() + c*nInterior + F.n[0]*(j + F.n[1]*k);
+                for (u64 i=0; i<F.n[0]; i++) aRow[i] = rRow[i];
+            }
+        }
+
+        f64* in  = F.bufA.data();
+        f64* out = F.bufB.data();
+        for (u8 axis=0; axis<nDims; axis++) { tensorApplyBatch(F.Vt[axis], axis, F.n, nBatch, in, out); std::swap(in, out); }
+        Eigen::Map<EigenDefs::Array2D<f64>>(in, nInterior, nBatch).colwise() *= F.invLambda;
+        for (u8 axis=0; axis<nDims; axis++) { tensorApplyBatch(F.V[axis], axis, F.n, nBatch, in, out); std::swap(in, out); }
+
+        #pragma omp parallel for schedule(static) num_threads(nThreads)
+        for (i64 s=0; s<nSlab; s++) {
+            const u64 c = s / F.n[2], k = s % F.n[2];
+            for (u64 j=0; j<F.n[1]; j++) {
+                f64*       zRow = Z.col(c).data() + lo[0] + N[0]*((j+lo[1]) + N[1]*(k+lo[2]));
+                const f64* aRow = in + c*nInterior + F.n[0]*(j + F.n[1]*k);
+                for (u64 i=0; i<F.n[0]; i++) zRow[i] = aRow[i];
+            }
+        }
+    }
+
+    for (u64 n=0; n<F.interfaceNodes.size(); n++) {
+        Z.row(F.interfaceNodes[n]) = F.interfaceInvDiag[n] * R.row(F.interfaceNodes[n]);
+    }
+}
+
+i32 Integrator::solveFastDiagonalization(u8 Var, PointFunction f, PointFunction g, EigenDefs::Vector<f64>& u) {
+
+    PROFILE_SCOPE("Integrator.solveFastDiagonalization")
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+
+    FastDiagonalization& F = fdm[Var];
+    if (!F.isSet || F.massCoeff != massCoeff || F.diffCoeff != diffCoeff || F.revision != geometry.revision) {
+        setupFastDiagonalization(Var);
+    }
+
+    const std::vector<u64> boundary = boundaryDOFs(Var);
+    EigenDefs::Vector<f64> r, z;
+    liftDirichlet(Var, f, g, boundary, u, r);
+
+    // Single Cartesian block: the fast diagonalization is the exact inverse
+    if (nprocs == 1 && geometry.isCartesian) {
+        applyFastDiagonalization(Var, r, z);
+        u += z;
+        INFO_MSG("Integrator.solveFastDiagonalization : Var %i - direct solve of %llu nodes", Var, nGlobalDOFs(Var))
+        return 0;
+    }
+
+    return conjugateGradient(Var, boundary, 
+                             [&](const EigenDefs::Vector<f64>& rIn, EigenDefs::Vector<f64>& zOut) { applyFastDiagonalization(Var, rIn, zOut); },
+                             u, r, "Integrator.solveFastDiagonalization");
+}
+
+i32 Integrator::solveFastDiagonalization(u8 Var, const std::vector<PointFunction>& f, PointFunction g, EigenDefs::Matrix<f64>& U) {
+
+    PROFILE_SCOPE("Integrator.solveFastDiagonalization")
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(!f.empty(), "At least one source term is required")
+
+    FastDiagonalization& F = fdm[Var];
+    if (!F.isSet || F.massCoeff != massCoeff || F.diffCoeff != diffCoeff || F.revision != geometry.revision) {
+        setupFastDiagonalization(Var);
+    }
+
+    // The Dirichlet lift A u0 is shared, only the source integrals differ between the columns
+    const std::vector<u64> boundary = boundaryDOFs(Var);
+    const u64 nBatch = f.size();
+    f64 xPoint[3];
+    EigenDefs::Vector<f64> u0, Au0, b;
+    zeroBlockVector(Var, u0);
+    for (const u64 idx : boundary) {
+        nodeCoordinates(Var, idx, xPoint);
+        u0[idx] = g(xPoint[0], xPoint[1], xPoint[2]);
+    }
+    applyOmega(Var, u0, Au0);
+
+    EigenDefs::Matrix<f64> R(nDOFs(Var), nBatch);
+    for (u64 c=0; c<nBatch; c++) {
+        zeroBlockVector(Var, b);
+        sourceOmega(Var, f[c], b);
+        R.col(c) = b - Au0;
+    }
+    for (const u64 idx : boundary) R.row(idx).setZero();
+    U = u0.replicate(1, nBatch);
+
+    if (nprocs == 1 && geometry.isCartesian) {
+        EigenDefs::Matrix<f64> Z;
+        applyFastDiagonalization(Var, R, Z);
+        U += Z;
+        INFO_MSG("Integrator.solveFastDiagonalization : Var %i - direct solve of %llu nodes for %llu sources", Var,
+                 nGlobalDOFs(Var), nBatch)
+        return 0;
+    }
+
+    return blockConjugateGradient(Var, boundary, 
+                                  [&](const EigenDefs::Matrix<f64>& rIn, EigenDefs::Matrix<f64>& zOut) { applyFastDiagonalization(Var, rIn, zOut); },
+                                  U, R, "Integrator.solveFastDiagonalization");
+}
+
+void Integrator::liftDirichlet(u8 Var, PointFunction f, PointFunction g, const std::vector<u64>& boundary, 
+                               EigenDefs::Vector<f64>& u, EigenDefs::Vector<f64>& r) {
+
+    // u = g on the boundary, the correction solves A du = b - A u with homogeneous Dirichlet conditions
+    f64 xPoint[3];
+    zeroBlockVector(Var, u);
+    for (const u64 idx : boundary) {
+        nodeCoordinates(Var, idx, xPoint);
+        u[idx] = g(xPoint[0], xPoint[1], xPoint[2]);
+    }
+
+    EigenDefs::Vector<f64> Au;
+    zeroBlockVector(Var, r);
+    sourceOmega(Var, f, r);
+    applyOmega(Var, u, Au);
+    r -= Au;
+    for (const u64 idx : boundary) r[idx] = 0.;
+}
+
+i32 Integrator::conjugateGradient(u8 Var, const std::vector<u64>& boundary, 
+                                  const std::function<void(const EigenDefs::Vector<f64>&, EigenDefs::Vector<f64>&)>& precond,
+                                  EigenDefs::Vector<f64>& u, EigenDefs::Vector<f64>& r, const char* caller) {
+
+    const std::vector<u64> owned = ownedBlockNodes(Var);
+    EigenDefs::Vector<f64> z, Ap;
+    precond(r, z);
+    EigenDefs::Vector<f64> p = z;
+    f64 rz = ownedDot(owned, r, z);
+    const f64 r0 = std::sqrt(ownedDot(owned, r, r));
+    f64 residual = (r0 > 0.) ? 1. : 0.;
+    i32 nIter = 0;
+    while (residual > params.tol && nIter < params.maxIter) {
+        applyOmega(Var, p, Ap);
+        for (const u64 idx : boundary) Ap[idx] = 0.;
+        const f64 alpha = rz / ownedDot(owned, p, Ap);
+        u += alpha*p;
+        r -= alpha*Ap;
+        nIter++;
+
+        residual = std::sqrt(ownedDot(owned, r, r)) / r0;
+        if (residual <= params.tol) break;
+        precond(r, z);
+        const f64 rzNew = ownedDot(owned, r, z);
+        p = z + (rzNew/rz)*p;
+        rz = rzNew;
+    }
+    if (residual > params.tol) WARN_MSG("%s : not converged, relative residual %e after %i iterations", caller, residual, nIter)
+    else                       INFO_MSG("%s : converged, relative residual %e after %i iterations", caller, residual, nIter)
+
+    return nIter;
+}
+
+i32 Integrator::blockConjugateGradient(u8 Var, const std::vector<u64>& boundary, 
+                                       const std::function<void(const EigenDefs::Matrix<f64>&, EigenDefs::Matrix<f64>&)>& precond,
+                                       EigenDefs::Matrix<f64>& U, EigenDefs::Matrix<f64>& R, const char* caller) {
+
+    const std::vector<u64> owned = ownedBlockNodes(Var);
+    const Eigen::Index nBatch = U.cols();
+    EigenDefs::Matrix<f64> Z, AP;
+    precond(R, Z);
+    EigenDefs::Matrix<f64> P = Z;
+    EigenDefs::Vector<f64> rz = ownedDots(owned, R, Z);
+    const EigenDefs::Vector<f64> r0 = ownedDots(owned, R, R).cwiseSqrt();
+    EigenDefs::Vector<f64> residual(nBatch);
+    for (Eigen::Index c=0; c<nBatch; c++) residual[c] = (r0[c] > 0.) ? 1. : 0.;
+
+    // Column i of P, R and rz belongs to right-hand side active[i], converged ones are moved out of the block
+    std::vector<Eigen::Index> active(nBatch);
+    for (Eigen::Index c=0; c<nBatch; c++) active[c] = c;
+    auto compact = [&]() {
+        Eigen::Index nActive = 0;
+        for (Eigen::Index i=0; i<static_cast<Eigen::Index>(active.size()); i++) {
+            if (residual[active[i]] <= params.tol) continue;
+            if (nActive != i) {
+                P.col(nActive) = P.col(i);
+                R.col(nActive) = R.col(i);
+                rz[nActive]    = rz[i];
+            }
+            active[nActive++] = active[i];
+        }
+        if (nActive == static_cast<Eigen::Index>(active.size())) return;
+        active.resize(nActive);
+        P.conservativeResize(Eigen::NoChange, nActive);
+        R.conservativeResize(Eigen::NoChange, nActive);
+        rz.conservativeResize(nActive);
+    };
+
+    compact();
+    i32 nIter = 0;
+    while (!active.empty() && nIter < params.maxIter) {
+        applyOmega(Var, P, AP);
+        for (const u64 idx : boundary) AP.row(idx).setZero();
+        const EigenDefs::Vector<f64> pAp = ownedDots(owned, P, AP);
+        for (Eigen::Index i=0; i<P.cols(); i++) {
+            const f64 alpha = rz[i] / pAp[i];
+            U.col(active[i]) += alpha*P.col(i);
+            R.col(i)         -= alpha*AP.col(i);
+        }
+        nIter++;
+
+        const EigenDefs::Vector<f64> rr = ownedDots(owned, R, R);
+        for (Eigen::Index i=0; i<R.cols(); i++) residual[active[i]] = std::sqrt(rr[i]) / r0[active[i]];
+        compact();
+        if (active.empty()) break;
+        precond(R, Z);
+        const EigenDefs::Vector<f64> rzNew = ownedDots(owned, R, Z);
+        for (Eigen::Index i=0; i<P.cols(); i++) P.col(i) = Z.col(i) + (rzNew[i]/rz[i])*P.col(i);
+        rz = rzNew;
+    }
+    const f64 worst = residual.maxCoeff();
+    if (worst > params.tol) WARN_MSG("%s : not converged, largest relative residual %e of %lli right-hand sides after %i iterations", 
+                                     caller, worst, (i64) nBatch, nIter)
+    else                    INFO_MSG("%s : %lli right-hand sides converged, largest relative residual %e after %i iterations", 
+                                     caller, (i64) nBatch, worst, nIter)
+
+    return nIter;
+}
+
+f64 Integrator::ownedDot(const std::vector<u64>& owned, const EigenDefs::Vector<f64>& a, const EigenDefs::Vector<f64>& b) const {
+
+    f64 sum = 0.;
+    for (const u64 idx : owned) sum += a[idx]*b[idx];
+    MPI_Allreduce(MPI_IN_PLACE, &sum, 1, MPI_DOUBLE, MPI_SUM, comm);
+    return sum;
+}
+
+EigenDefs::Vector<f64> Integrator::ownedDots(const std::vector<u64>& owned, const EigenDefs::Matrix<f64>& A, 
+                                             const EigenDefs::Matrix<f64>& B) const {
+
+    EigenDefs::Vector<f64> sums = EigenDefs::Vector<f64>::Zero(A.cols());
+    for (Eigen::Index c=0; c<A.cols(); c++) {
+        const f64* a = A.col(c).data();
+        const f64* b = B.col(c).data();
+        for (const u64 idx : owned) sums[c] += a[idx]*b[idx];
+    }
+    MPI_Allreduce(MPI_IN_PLACE, sums.data(), sums.size(), MPI_DOUBLE, MPI_SUM, comm);
+    return sums;
+}
+
+} // end Physics
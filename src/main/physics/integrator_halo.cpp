@@ -0,0 +1,93 @@
+#include "CoreIncludes.hpp"
+#include "integrator.hpp"
+
+namespace Physics {
+
+void Integrator::startHaloExchange(u8 Var, const EigenDefs::Vector<f64>& y) {
+
+    PROFILE_SCOPE("Integrator.startHaloExchange")
+
+    const u64 nNeighbours = geometry.neighbourRanks.size();
+    for (u64 n=0; n<nNeighbours; n++) {
+        const std::vector<u64>& nodes = haloNodes[Var][n];
+        MPI_Irecv(recvBuf[n].data(), nodes.size(), MPI_DOUBLE, geometry.neighbourRanks[n], Var, comm, &haloRequests[n]);
+    }
+    for (u64 n=0; n<nNeighbours; n++) {
+        const std::vector<u64>& nodes = haloNodes[Var][n];
+        for (u64 i=0; i<nodes.size(); i++) sendBuf[n][i] = y[nodes[i]];
+        MPI_Isend(sendBuf[n].data(), nodes.size(), MPI_DOUBLE, geometry.neighbourRanks[n], Var, comm, &haloRequests[nNeighbours+n]);
+    }
+}
+
+void Integrator::finishHaloExchange(u8 Var, EigenDefs::Vector<f64>& y) {
+
+    PROFILE_SCOPE("Integrator.finishHaloExchange")
+
+    const u64 nNeighbours = geometry.neighbourRanks.size();
+    if (nNeighbours == 0) return;
+    MPI_Waitall(2*nNeighbours, haloRequests.data(), MPI_STATUSES_IGNORE);
+
+    // Every neighbour sends its own contribution only, so edge and corner nodes are summed exactly once per rank
+    for (u64 n=0; n<nNeighbours; n++) {
+        const std::vector<u64>& nodes = haloNodes[Var][n];
+        for (u64 i=0; i<nodes.size(); i++) y[nodes[i]] += recvBuf[n][i];
+    }
+}
+
+void Integrator::startHaloExchange(u8 Var, const EigenDefs::Matrix<f64>& Y) {
+
+    PROFILE_SCOPE("Integrator.startHaloExchange")
+
+    // Node-major packing, the k values of a node are adjacent in the message
+    const u64 nNeighbours = geometry.neighbourRanks.size();
+    const u64 nBatch      = Y.cols();
+    for (u64 n=0; n<nNeighbours; n++) {
+        const u64 count = haloNodes[Var][n].size()*nBatch;
+        if (recvBuf[n].size() < count) recvBuf[n].resize(count);
+        if (sendBuf[n].size() < count) sendBuf[n].resize(count);
+        MPI_Irecv(recvBuf[n].data(), count, MPI_DOUBLE, geometry.neighbourRanks[n], Var, comm, &haloRequests[n]);
+    }
+    for (u64 n=0; n<nNeighbours; n++) {
+        const std::vector<u64>& nodes = haloNodes[Var][n];
+        for (u64 c=0; c<nBatch; c++) {
+            for (u64 i=0; i<nodes.size(); i++) sendBuf[n][i*nBatch + c] = Y(nodes[i], c);
+        }
+        MPI_Isend(sendBuf[n].data(), nodes.size()*nBatch, MPI_DOUBLE, geometry.neighbourRanks[n], Var, comm, 
+                  &haloRequests[nNeighbours+n]);
+    }
+}
+
+void Integrator::finishHaloExchange(u8 Var, EigenDefs::Matrix<f64>& Y) {
+
+    PROFILE_SCOPE("Integrator.finishHaloExchange")
+
+    const u64 nNeighbours = geometry.neighbourRanks.size();
+    const u64 nBatch      = Y.cols();
+    if (nNeighbours == 0) return;
+    MPI_Waitall(2*nNeighbours, haloRequests.data(), MPI_STATUSES_IGNORE);
+
+    for (u64 n=0; n<nNeighbours; n++) {
+        const std::vector<u64>& nodes = haloNodes[Var][n];
+        for (u64 c=0; c<nBatch; c++) {
+            for (u64 i=0; i<nodes.size(); i++) Y(nodes[i], c) += recvBuf[n][i*nBatch + c];
+        }
+    }
+}
+
+void Integrator::sumShared(u8 Var, EigenDefs::Vector<f64>& y) {
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(static_cast<u64>(y.rows()) == nDOFs(Var), "Vector does not match the number of DOFs")
+    startHaloExchange(Var, y);
+    finishHaloExchange(Var, y);
+}
+
+void Integrator::sumShared(u8 Var, EigenDefs::Matrix<f64>& Y) {
+
+    CHECK_FATAL_ASSERT(nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(static_cast<u64>(Y.rows()) == nDOFs(Var), "Block vectors do not match the number of DOFs")
+    startHaloExchange(Var, Y);
+    finishHaloExchange(Var, Y);
+}
+
+} // end Physics
@@ -0,0 +1,309 @@
+#include "CoreIncludes.hpp"
+#include "pmultigrid.hpp"
+
+namespace Physics {
+
+PMultigrid::PMultigrid(Integrator& fine_, u8 Var_) : fine(fine_), Var(Var_), nDims(fine_.nDims), isSet(FALSE),
+                                                     massCoeff(0.), diffCoeff(0.), revision(0) {
+
+    CHECK_FATAL_ASSERT(fine.nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(fine.geometry.isCartesian, "p-multigrid requires a Cartesian geometry")
+
+    // ------------------------ //
+    // Order hierarchy          //
+    // ------------------------ //
+    // Orders are halved per axis down to 1, the last level has order 1 along every axis
+    std::vector<u64> order(3, 1);
+    for (u8 axis=0; axis<nDims; axis++) order[axis] = fine.nNodes[Var][axis]-1;
+    orders.push_back(order);
+    while (*std::max_element(order.begin(), order.begin()+nDims) > 1) {
+        for (u8 axis=0; axis<nDims; axis++) order[axis] = std::max<u64>(1, order[axis]/2);
+        orders.push_back(order);
+    }
+
+    for (u64 l=1; l<orders.size(); l++) {
+        masters.push_back(std::make_unique<Mesh::MasterElement>(nDims));
+        masters.back()->setnVars(1);
+        masters.back()->setLGLOrder(0, orders[l][0], orders[l][1], orders[l][2]); // only the first nDims orders are read
+        coarse.push_back(std::make_unique<Integrator>(fine.geometry, *masters.back()));
+    }
+
+    // ------------------------ //
+    // Transfer operators       //
+    // ------------------------ //
+    // Column j of P holds the j-th coarse Lagrange polynomial at the fine LGL nodes, unused axes are 1x1 identities
+    P.assign(orders.size()-1, std::vector<EigenDefs::Matrix<f64>>(3, EigenDefs::Matrix<f64>::Ones(1,1)));
+    Pt = P;
+    for (u64 l=0; l+1<orders.size(); l++) {
+        Mesh::MasterElement& fineMaster = level(l).master;
+        for (u8 axis=0; axis<nDims; axis++) {
+            P[l][axis]  = masters[l]->lagrangeMatrix(0, axis, fineMaster.getNodes(levelVar(l), axis));
+            Pt[l][axis] = P[l][axis].transpose();
+        }
+    }
+    INFO_MSG("p-multigrid established with %llu levels", (u64) orders.size())
+}
+
+void PMultigrid::setup() {
+
+    PROFILE_SCOPE("PMultigrid.setup")
+
+    const u64 nLevel = orders.size();
+    massCoeff = fine.massCoeff;
+    diffCoeff = fine.diffCoeff;
+    revision  = fine.geometry.revision;
+    SolverParameters coarseParams = fine.params;
+    coarseParams.staticCondensation = FALSE;
+    for (std::unique_ptr<Integrator>& op : coarse) {
+        op->setHeatCoefficients(massCoeff, diffCoeff);
+        op->setnThreads(fine.nThreads);
+        op->setSolverParameters(coarseParams);
+    }
+
+    invDiag.resize(nLevel);
+    invMult.resize(nLevel);
+    lambdaMax.assign(nLevel, 0.);
+    boundary.resize(nLevel);
+    for (u64 l=0; l<nLevel; l++) {
+        Integrator& op = level(l);
+        const u8 v = levelVar(l);
+        boundary[l] = op.boundaryDOFs(v);
+        if (l == nLevel-1) break;
+
+        // ------------------------ //
+        // Jacobi scaling           //
+        // ------------------------ //
+        op.diagonalOmega(v, invDiag[l]);
+        invDiag[l] = invDiag[l].cwiseInverse();
+        for (const u64 idx : boundary[l]) invDiag[l][idx] = 0.;
+
+        // Restriction weights, nodes on element interfaces are seen by two elements per axis
+        invMult[l].resize(op.nDOFs(v));
+        u64 g[3];
+        for (u64 idx=0; idx<op.nDOFs(v); idx++) {
+            op.globalNode(v, idx, g);
+            f64 w = 1.;
+            for (u8 axis=0; axis<nDims; axis++) {
+                const u64 p = op.nNodes[v][axis]-1;
+                if (g[axis]%p == 0 && g[axis] > 0 && g[axis] < op.nGlobal[v][axis]-1) w *= 0.5;
+            }
+            invMult[l][idx] = w;
+        }
+
+        // ------------------------ //
+        // Spectral bound           //
+        // ------------------------ //
+        // Lanczos through Jacobi-preconditioned CG on A x = r, started from a vector depending on the global node only
+        // (consistent across ranks). Its extreme Ritz values converge much faster than a power iteration.
+        const std::vector<u64> owned = op.ownedBlockNodes(v);
+        EigenDefs::Vector<f64> r(op.nDOFs(v)), z, p, Ap;
+        for (u64 idx=0; idx<op.nDOFs(v); idx++) {
+            op.globalNode(v, idx, g);
+            r[idx] = (invDiag[l][idx] != 0.) ? std::sin(1. + g[0] + 3.*g[1] + 7.*g[2]) : 0.;
+        }
+        const i32 nSteps = fine.params.lanczosIterations;
+        EigenDefs::Matrix<f64> T = EigenDefs::Matrix<f64>::Zero(nSteps, nSteps);
+        z = (invDiag[l].array() * r.array()).matrix();
+        p = z;
+        f64 rz = op.ownedDot(owned, r, z), alphaOld = 1., betaOld = 0.;
+        i32 nT = 0;
+        for (i32 it=0; it<nSteps && rz > 0.; it++, nT++) {
+            op.applyOmega(v, p, Ap);
+            const f64 alpha = rz / op.ownedDot(owned, p, Ap);
+            T(it,it) = 1./alpha + ((it > 0) ? betaOld/alphaOld : 0.);
+            r -= alpha*Ap;
+            z  = (invDiag[l].array() * r.array()).matrix();
+            const f64 rzNew = op.ownedDot(owned, r, z);
+            const f64 beta  = rzNew / rz;
+            if (it+1 < nSteps) T(it,it+1) = T(it+1,it) = std::sqrt(beta)/alpha;
+            p = z + beta*p;
+            rz = rzNew; alphaOld = alpha; betaOld = beta;
+        }
+        Eigen::SelfAdjointEigenSolver<EigenDefs::Matrix<f64>> eig(T.topLeftCorner(nT, nT), Eigen::EigenvaluesOnly);
+        // Ritz values approach lambdaMax from below
+        lambdaMax[l] = 1.1*eig.eigenvalues().maxCoeff();
+        TRACE_MSG("PMultigrid.setup : level %llu - lambdaMax(D^{-1}A) ~ %e", l, lambdaMax[l])
+    }
+
+    // ------------------------ //
+    // Coarse BoomerAMG         //
+    // ------------------------ //
+    Integrator& op = level(nLevel-1);
+    op.assemble(levelVar(nLevel-1), [](f64, f64, f64) { return 0.; }, [](f64, f64, f64) { return 0.; });
+    op.setupAMG();
+    isSet = TRUE;
+}
+
+void PMultigrid::vcycle(const EigenDefs::Vector<f64>& r, EigenDefs::Vector<f64>& z) {
+
+    PROFILE_SCOPE("PMultigrid.vcycle")
+
+    CHECK_FATAL_ASSERT(isSet, "setup must be called first before calling upon this function")
+    vcycleLevel(0, r, z);
+}
+
+i32 PMultigrid::solve(PointFunction f, PointFunction g, EigenDefs::Vector<f64>& u) {
+
+    if (!isSet || massCoeff != fine.massCoeff || diffCoeff != fine.diffCoeff || revision != fine.geometry.revision) setup();
+
+    EigenDefs::Vector<f64> r;
+    fine.liftDirichlet(Var, f, g, boundary[0], u, r);
+    return fine.conjugateGradient(Var, boundary[0],
+                                  [&](const EigenDefs::Vector<f64>& rIn, EigenDefs::Vector<f64>& zOut) { vcycleLevel(0, rIn, zOut); },
+                                  u, r, "PMultigrid.solve");
+}
+
+void PMultigrid::vcycleLevel(u64 l, const EigenDefs::Vector<f64>& r, EigenDefs::Vector<f64>& z) {
+
+    Integrator& op = level(l);
+    const u8 v = levelVar(l);
+    if (l == orders.size()-1) {
+        op.applyAMG(r, z);
+        return;
+    }
+
+    // Pre-smoothing from a zero guess, coarse correction of the remaining residual, post-smoothing
+    EigenDefs::Vector<f64> t, rc, zc, e;
+    op.zeroBlockVector(v, z);
+    smooth(l, r, z);
+
+    op.applyOmega(v, z, t);
+    t = r - t;
+    for (const u64 idx : boundary[l]) t[idx] = 0.;
+    restrictResidual(l, t, rc);
+    vcycleLevel(l+1, rc, zc);
+    prolongate(l, zc, e);
+    z += e;
+
+    smooth(l, r, z);
+}
+
+void PMultigrid::smooth(u64 l, const EigenDefs::Vector<f64>& b, EigenDefs::Vector<f64>& x) {
+
+    // Chebyshev iteration on [lambdaMax/range, lambdaMax] of D^{-1}A (Saad, Iterative Methods, Alg. 12.1)
+    Integrator& op = level(l);
+    const u8  v      = levelVar(l);
+    const f64 upper  = lambdaMax[l];
+    const f64 lower  = upper / fine.params.chebyshevRange;
+    const f64 theta  = 0.5*(upper + lower);
+    const f64 delta  = 0.5*(upper - lower);
+    const f64 sigma  = theta/delta;
+    f64 rho = 1./sigma;
+
+    EigenDefs::Vector<f64> r, Ad;
+    op.applyOmega(v, x, r);
+    r = b - r;
+    EigenDefs::Vector<f64> d = (invDiag[l].array() * r.array() / theta).matrix();
+    for (i32 it=0; it<fine.params.chebyshevDegree; it++) {
+        x += d;
+        if (it == fine.params.chebyshevDegree-1) break;
+        op.applyOmega(v, d, Ad);
+        r -= Ad;
+        const f64 rhoNew = 1./(2.*sigma - rho);
+        d = rhoNew*rho*d + (2.*rhoNew/delta) * (invDiag[l].array() * r.array()).matrix();
+        rho = rhoNew;
+    }
+}
+
+void PMultigrid::prolongate(u64 l, const EigenDefs::Vector<f64>& uc, EigenDefs::Vector<f64>& uf) {
+
+    Integrator& opF = level(l);
+    Integrator& opC = level(l+1);
+    const u8 vF = levelVar(l), vC = levelVar(l+1);
+    Mesh::Geometry& geometry = fine.geometry;
+    opF.zeroBlockVector(vF, uf);
+
+    // Interface nodes are written by every element holding them, with the same value: elements of a color share no nodes
+    #pragma omp parallel num_threads(fine.nThreads)
+    {
+        std::vector<f64> bufA(opF.nLocalMax), bufB(opF.nLocalMax);
+        u64 elemAxis[3];
+        for (const std::vector<std::vector<u64>>* colors : {&geometry.interfaceColors, &geometry.interiorColors}) {
+            for (const std::vector<u64>& elems : *colors) {
+                #pragma omp for schedule(static)
+                for (u64 n=0; n<elems.size(); n++) {
+                    geometry.localElemIndex(elems[n], elemAxis);
+                    opC.gather(vC, elemAxis, uc, bufA.data());
+
+                    u64 nIn[3] = {opC.nNodes[vC][0], opC.nNodes[vC][1], opC.nNodes[vC][2]};
+                    f64* in  = bufA.data();
+                    f64* out = bufB.data();
+                    for (u8 axis=0; axis<nDims; axis++) {
+                        transferAxis(P[l][axis], axis, nIn, in, out);
+                        nIn[axis] = opF.nNodes[vF][axis];
+                        std::swap(in, out);
+                    }
+
+                    u64 local = 0;
+                    for (u64 k=0; k<nIn[2]; k++) {
+                        for (u64 j=0; j<nIn[1]; j++) {
+                            for (u64 i=0; i<nIn[0]; i++, local++) uf[opF.localIndex(vF, elemAxis, i, j, k)] = in[local];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void PMultigrid::restrictResidual(u64 l, const EigenDefs::Vector<f64>& rf, EigenDefs::Vector<f64>& rc) {
+
+    Integrator& opF = level(l);
+    Integrator& opC = level(l+1);
+    const u8 vF = levelVar(l), vC = levelVar(l+1);
+    Mesh::Geometry& geometry = fine.geometry;
+
+    // rf is summed over the elements, so each element restricts its share rf/multiplicity
+    const EigenDefs::Vector<f64> rw = (rf.array() * invMult[l].array()).matrix();
+    EigenDefs::Vector<f64> rLocal;
+    opC.zeroBlockVector(vC, rLocal);
+
+    #pragma omp parallel num_threads(fine.nThreads)
+    {
+        std::vector<f64> bufA(opF.nLocalMax), bufB(opF.nLocalMax);
+        u64 elemAxis[3];
+        for (const std::vector<std::vector<u64>>* colors : {&geometry.interfaceColors, &geometry.interiorColors}) {
+            for (const std::vector<u64>& elems : *colors) {
+                #pragma omp for schedule(static)
+                for (u64 n=0; n<elems.size(); n++) {
+                    geometry.localElemIndex(elems[n], elemAxis);
+                    opF.gather(vF, elemAxis, rw, bufA.data());
+
+                    u64 nIn[3] = {opF.nNodes[vF][0], opF.nNodes[vF][1], opF.nNodes[vF][2]};
+                    f64* in  = bufA.data();
+                    f64* out = bufB.data();
+                    for (u8 axis=0; axis<nDims; axis++) {
+                        transferAxis(Pt[l][axis], axis, nIn, in, out);
+                        nIn[axis] = opC.nNodes[vC][axis];
+                        std::swap(in, out);
+                    }
+                    opC.scatterAdd(vC, elemAxis, in, rLocal);
+                }
+            }
+        }
+    }
+    opC.sumShared(vC, rLocal);
+    for (const u64 idx : boundary[l+1]) rLocal[idx] = 0.;
+    rc.swap(rLocal);
+}
+
+void PMultigrid::transferAxis(const EigenDefs::Matrix<f64>& T, u8 axis, const u64 nIn[3], const f64* in, f64* out) {
+
+    using MapC = Eigen::Map<const EigenDefs::Matrix<f64>>;
+    using Map  = Eigen::Map<EigenDefs::Matrix<f64>>;
+    const u64 m = T.rows();
+
+    if (axis == 0) {
+        Map(out, m, nIn[1]*nIn[2]).noalias() = T * MapC(in, nIn[0], nIn[1]*nIn[2]);
+    }
+    else if (axis == 1) {
+        for (u64 k=0; k<nIn[2]; k++) {
+            Map(out + k*nIn[0]*m, nIn[0], m).noalias() = MapC(in + k*nIn[0]*nIn[1], nIn[0], nIn[1]) * T.transpose();
+        }
+    }
+    else {
+        Map(out, nIn[0]*nIn[1], m).noalias() = MapC(in, nIn[0]*nIn[1], nIn[2]) * T.transpose();
+    }
+}
+
+} // end Physics
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "CoreIncludes.hpp"
+#include "mesh.hpp"
+#include "integrator.hpp"
+
+#include <memory>
+
+namespace Physics {
+
+/************************************************************************************************************************
+ *  @brief p-multigrid preconditioner of the heat operator over a hierarchy of LGL orders.
+ *
+ *  @details
+ *  Level 0 is the (fine) integrator of the problem, the coarser levels use their own MasterElement and Integrator on the
+ *  same geometry at orders p, p/2, ..., 1 per axis. Between levels, the coarse LGL-Lagrange basis is interpolated to the
+ *  fine LGL nodes (prolongation P, applied per element through tensor products) and residuals are restricted with P^T.
+ *  Each level but the last is smoothed with a Chebyshev-Jacobi polynomial, the p=1 level is solved with one BoomerAMG
+ *  V-cycle on its assembled hypre matrix. High-order SEM matrices are poorly suited to AMG directly, whereas the
+ *  p-multigrid iteration counts are nearly independent of p.
+ *  Requires a Cartesian geometry (element metrics are only given at the fine nodes).
+ ************************************************************************************************************************/
+class PMultigrid {
+
+    public:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /************************************************************************************************************************
+         *  @brief Builds the order hierarchy of variable \p Var_ of an existing integrator.
+         *
+         *  @details
+         *  The integrator is held by reference and must outlive the p-multigrid. Its heat coefficients, thread count and
+         *  solver parameters are copied to the coarser levels by @ref setup.
+         *
+         *  @param fine_      Integrator of the fine level.
+         *  @param Var_       Variable who's operator is preconditioned.
+         ************************************************************************************************************************/
+        PMultigrid(Integrator& fine_, u8 Var_);
+
+        /**< Disabled construction using another PMultigrid */
+        PMultigrid(const PMultigrid&) = delete;
+
+        /**< Disabled construction by equating to another PMultigrid */
+        PMultigrid& operator =(const PMultigrid&) = delete;
+
+        /************************************************************************************************************************
+         *  @brief (Re)builds the level operators, smoothers and the coarse BoomerAMG for the current heat coefficients.
+         *
+         *  @details
+         *  Estimates the largest eigenvalue of D^{-1}A per level with SolverParameters::lanczosIterations Lanczos steps and
+         *  assembles the p=1 operator into hypre. Called by @ref solve whenever the heat coefficients or the geometry of the
+         *  fine integrator changed.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void setup();
+
+        /************************************************************************************************************************
+         *  @brief Applies one V-cycle to a fine residual, z = P r.
+         *
+         *  @param r          Fine block residual (size nDOFs(Var)), zero on the domain boundary and consistent across ranks.
+         *  @param z          Output, fine block correction, zero on the domain boundary and consistent across ranks.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void vcycle(const EigenDefs::Vector<f64>& r, EigenDefs::Vector<f64>& z);
+
+        /************************************************************************************************************************
+         *  @brief Solves the heat problem with the matrix-free conjugate gradient of the fine integrator, preconditioned by
+         *         one V-cycle per iteration.
+         *
+         *  @param f          Source term f(x,y,z), called concurrently from all threads.
+         *  @param g          Dirichlet boundary value g(x,y,z).
+         *  @param u          Output, fine block solution vector, consistent across ranks on interface nodes.
+         *
+         *  @return Number of conjugate gradient iterations.
+         ************************************************************************************************************************/
+        i32 solve(PointFunction f, PointFunction g, EigenDefs::Vector<f64>& u);
+
+        /**< Returns the number of levels, the fine level included */
+        u64 nLevels() const { return orders.size(); }
+
+    private:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /**< Returns the integrator of level l, level 0 is the fine integrator */
+        Integrator& level(u64 l) { return (l == 0) ? fine : *coarse[l-1]; }
+
+        /**< Returns the variable of level l */
+        u8 levelVar(u64 l) const { return (l == 0) ? Var : 0; }
+
+        /**< V-cycle from level l down to the coarsest level */
+        void vcycleLevel(u64 l, const EigenDefs::Vector<f64>& r, EigenDefs::Vector<f64>& z);
+
+        /**< Chebyshev-Jacobi smoothing of A x = b on level l, SolverParameters::chebyshevDegree operator applications */
+        void smooth(u64 l, const EigenDefs::Vector<f64>& b, EigenDefs::Vector<f64>& x);
+
+        /**< Interpolates uc of level l+1 to uf of level l */
+        void prolongate(u64 l, const EigenDefs::Vector<f64>& uc, EigenDefs::Vector<f64>& uf);
+
+        /**< Restricts the residual rf of level l to rc of level l+1 with P^T */
+        void restrictResidual(u64 l, const EigenDefs::Vector<f64>& rf, EigenDefs::Vector<f64>& rc);
+
+        /**< Applies the rectangular 1D operator T along one axis of an element-local tensor of nIn nodes per axis */
+        static void transferAxis(const EigenDefs::Matrix<f64>& T, u8 axis, const u64 nIn[3], const f64* in, f64* out);
+
+        // ---------------- //
+        // member variables //
+        // ---------------- //
+
+        Integrator& fine;
+        u8  Var, nDims;
+        b8  isSet;
+        f64 massCoeff, diffCoeff;                               /**< Heat coefficients of the current setup */
+        u64 revision;                                           /**< Geometry revision of the current setup */
+        std::vector<std::vector<u64>> orders;                   /**< LGL order per level per axis, access is orders[l][axis] (size 3) */
+        std::vector<std::unique_ptr<Mesh::MasterElement>> masters; /**< Master elements of levels 1, 2, ... */
+        std::vector<std::unique_ptr<Integrator>> coarse;        /**< Integrators of levels 1, 2, ... */
+        std::vector<std::vector<EigenDefs::Matrix<f64>>> P, Pt; /**< Prolongation from level l+1 to l per axis, access is P[l][axis] */
+        std::vector<EigenDefs::Vector<f64>> invDiag;            /**< Inverse operator diagonal per level, 0 on the boundary */
+        std::vector<EigenDefs::Vector<f64>> invMult;            /**< Inverse number of elements sharing each node, per level */
+        std::vector<f64> lambdaMax;                             /**< Largest eigenvalue estimate of D^{-1}A per level */
+        std::vector<std::vector<u64>> boundary;                 /**< Domain boundary nodes per level */
+
+};
+
+} // end Physics
@@ -0,0 +1,105 @@
+#include "CoreIncludes.hpp"
+#include "revolve.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace Physics {
+
+Revolve::Revolve(u64 nSteps_, u32 nSnapshots_) : steps(nSteps_), snapshots(nSnapshots_), capoStep(0), oldCapoStep(0),
+                                                 advanced(0), slotNumber(0), started(FALSE), turned(FALSE) {
+
+    CHECK_FATAL_ASSERT(steps > 0, "Revolve requires at least one time step")
+    CHECK_FATAL_ASSERT(snapshots > 0, "Revolve requires at least one checkpoint slot for the initial state")
+    TRACE_MSG("Revolve : %llu steps with %u checkpoint slots, %llu forward steps scheduled", steps, snapshots,
+              forwardSteps(steps, snapshots))
+}
+
+revolveAction Revolve::next() {
+
+    // The initial state always goes into slot 0
+    if (!started) {
+        started    = TRUE;
+        slotNumber = 0;
+        frames.push_back({0, steps, 0, snapshots-1});
+        return REVOLVE_TAKESHOT;
+    }
+
+    while (!frames.empty()) {
+        Frame& frame = frames.back();
+        const u64 l = frame.to - frame.from;
+        if (l == 0) { frames.pop_back(); continue; }
+
+        // Without unused slots, the last step of the range is recomputed from its first checkpoint, otherwise the state
+        // at the binomial split is checkpointed and the upper part is reversed first
+        const b8  recompute = (frame.nFree == 0 || l == 1);
+        const u64 target    = recompute ? frame.to-1 : frame.from + split(l, frame.nFree);
+
+        if (capoStep == target) {
+            if (recompute) {
+                frame.to--;
+                const b8 first = !turned;
+                turned = TRUE;
+                return first ? REVOLVE_FIRSTURN : REVOLVE_YOUTURN;
+            }
+            const Frame upper = {target, frame.to, frame.slot+1, frame.nFree-1};
+            frame.to   = target;
+            slotNumber = upper.slot;
+            frames.push_back(upper);
+            return REVOLVE_TAKESHOT;
+        }
+
+        // The forward state only moves forward, a state past the target (or before the range) is restored first
+        if (capoStep >= frame.from && capoStep < target) {
+            oldCapoStep = capoStep;
+            advanced   += target - capoStep;
+            capoStep    = target;
+            return REVOLVE_ADVANCE;
+        }
+        capoStep   = frame.from;
+        slotNumber = frame.slot;
+        return REVOLVE_RESTORE;
+    }
+    return REVOLVE_TERMINATE;
+}
+
+u64 Revolve::forwardSteps(u64 nSteps_, u32 nSnapshots_) {
+
+    if (nSteps_ <= 1) return 0;
+    const u64 t = repetitions(nSteps_, nSnapshots_);
+    return t*nSteps_ - binomial(nSnapshots_+1, t-1);
+}
+
+u64 Revolve::binomial(u64 s, u64 t) {
+
+    // beta(s,k) = beta(s,k-1) (s+k)/k, each partial product being an integer
+    const u64 largest = std::numeric_limits<u64>::max();
+    u64 beta = 1;
+    for (u64 k=1; k<=t; k++) {
+        if (beta > largest/(s+k)) return largest;
+        beta = beta*(s+k)/k;
+    }
+    return beta;
+}
+
+u64 Revolve::repetitions(u64 l, u64 s) {
+
+    u64 t = 0;
+    while (binomial(s, t) < l) t++;
+    return t;
+}
+
+u64 Revolve::split(u64 l, u32 nFree) {
+
+    // With s = nFree+1 slots (the range's own checkpoint included) and t repetitions, any split m with
+    // beta(s,t-2) <= m <= beta(s,t-1) and l-m <= beta(s-1,t-1) keeps the schedule optimal
+    const u64 s = nFree+1;
+    const u64 t = repetitions(l, s);
+    const u64 upper = binomial(s-1, t-1);
+    u64 m = (t >= 2) ? binomial(s, t-2) : 1;
+    if (l > upper) m = std::max(m, l-upper);
+    m = std::min(m, binomial(s, t-1));
+    return std::clamp<u64>(m, 1, l-1);
+}
+
+} // end Physics
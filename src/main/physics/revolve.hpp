@@ -0,0 +1,122 @@
+#pragma once
+
+#include "CoreIncludes.hpp"
+
+#include <vector>
+
+namespace Physics {
+
+/* list of actions requested by the Revolve checkpointing schedule */
+typedef enum revolveAction{
+    REVOLVE_ADVANCE   = 0, /**< advance the forward state from step oldCapo() to step capo() */
+    REVOLVE_TAKESHOT  = 1, /**< store the forward state of step capo() in checkpoint slot() */
+    REVOLVE_RESTORE   = 2, /**< restore the forward state of step capo() from checkpoint slot() */
+    REVOLVE_FIRSTURN  = 3, /**< first reversal, the forward state is at step nSteps-1: run the last forward step, then the adjoint of step capo() */
+    REVOLVE_YOUTURN   = 4, /**< run the adjoint of step capo(), using the forward state of step capo() */
+    REVOLVE_TERMINATE = 5, /**< all adjoint steps are done */
+} revolveAction;
+
+/************************************************************************************************************************
+ *  @brief Binomial checkpointing schedule of an adjoint sweep over a fixed number of time steps (Griewank's revolve).
+ *
+ *  @details
+ *  The adjoint of step n, u^n -> u^{n+1}, needs the forward state u^n, in reverse order n = nSteps-1, ..., 0. Storing
+ *  every state costs memory linear in nSteps, whereas with s checkpoint slots and t forward recomputations per step,
+ *  beta(s,t) = (s+t)!/(s!t!) steps can be reversed. The schedule places each checkpoint at the binomially optimal split
+ *  of the remaining range, which minimizes the number of forward steps for the given slots: for a fixed number of
+ *  recomputations, the slots needed grow logarithmically with nSteps.
+ *
+ *  The caller owns the forward state and the checkpoints and repeatedly calls @ref next, performing the returned
+ *  action, until REVOLVE_TERMINATE. Slot 0 holds the initial state and is requested first. Slots are numbered by
+ *  nesting depth, low slots hold the longest-lived and least often restored checkpoints (candidates for slower storage).
+ ************************************************************************************************************************/
+class Revolve {
+
+    public:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /************************************************************************************************************************
+         *  @brief Sets up the schedule of an adjoint sweep.
+         *
+         *  @param nSteps_     Number of forward time steps, must be bigger than 0.
+         *  @param nSnapshots_ Number of checkpoint slots, the initial state included, must be bigger than 0.
+         ************************************************************************************************************************/
+        Revolve(u64 nSteps_, u32 nSnapshots_);
+
+        /************************************************************************************************************************
+         *  @brief Returns the next action of the schedule and updates capo(), oldCapo() and slot() accordingly.
+         *
+         *  @return Action the caller has to perform.
+         ************************************************************************************************************************/
+        revolveAction next();
+
+        /**< Returns the step of the forward state after the last action */
+        u64 capo() const { return capoStep; }
+
+        /**< Returns the step of the forward state before the last REVOLVE_ADVANCE */
+        u64 oldCapo() const { return oldCapoStep; }
+
+        /**< Returns the checkpoint slot of the last REVOLVE_TAKESHOT or REVOLVE_RESTORE */
+        u32 slot() const { return slotNumber; }
+
+        /**< Returns the number of checkpoint slots, the initial state included */
+        u32 nSnapshots() const { return snapshots; }
+
+        /**< Returns the number of forward steps advanced so far, the last step of REVOLVE_FIRSTURN excluded */
+        u64 nAdvanced() const { return advanced; }
+
+        /**< Returns TRUE while no adjoint step was requested yet, i.e. during the first forward sweep */
+        b8 isFirstSweep() const { return !turned; }
+
+        /************************************************************************************************************************
+         *  @brief Returns the number of forward steps of the binomial schedule, the last step of REVOLVE_FIRSTURN excluded.
+         *
+         *  @details
+         *  With t the smallest number of recomputations such that beta(nSnapshots_, t) >= nSteps_, the schedule advances
+         *  t*nSteps_ - beta(nSnapshots_+1, t-1) steps, which is optimal (Griewank & Walther, ACM TOMS 26, 2000).
+         *
+         *  @param nSteps_     Number of forward time steps.
+         *  @param nSnapshots_ Number of checkpoint slots, the initial state included.
+         *
+         *  @return Number of forward steps.
+         ************************************************************************************************************************/
+        static u64 forwardSteps(u64 nSteps_, u32 nSnapshots_);
+
+        /**< Returns beta(s,t) = (s+t)!/(s!t!), saturating at the largest u64 */
+        static u64 binomial(u64 s, u64 t);
+
+    private:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /**< Returns the smallest number of recomputations t such that beta(s,t) >= l */
+        static u64 repetitions(u64 l, u64 s);
+
+        /**< Returns the optimal offset of the next checkpoint when reversing l steps with nFree unused slots */
+        static u64 split(u64 l, u32 nFree);
+
+        // ---------------- //
+        // member variables //
+        // ---------------- //
+
+        /**< Reversal of steps [from, to), the state of step from is in checkpoint slot, nFree slots above it are unused */
+        struct Frame{
+            u64 from, to;
+            u32 slot, nFree;
+        };
+
+        u64 steps;
+        u32 snapshots;
+        u64 capoStep, oldCapoStep, advanced;
+        u32 slotNumber;
+        b8  started, turned;
+        std::vector<Frame> frames;                /**< Pending reversals, the back is processed first */
+
+};
+
+} // end Physics
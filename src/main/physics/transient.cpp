@@ -0,0 +1,318 @@
+#include "CoreIncludes.hpp"
+#include "transient.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+namespace Physics {
+
+Transient::Transient(Integrator& integrator_, u8 Var_, timeScheme scheme_, f64 dt_, f64 diffusivity_) :
+    integrator(integrator_), Var(Var_), scheme(scheme_), dt(dt_), diffusivity(diffusivity_),
+    preconditioner(TRANSIENT_PRECOND_FDM), active(0),
+    f(nullptr), g(nullptr), hasProblem(FALSE) {
+
+    CHECK_FATAL_ASSERT(integrator.nVars > Var, "Variable number accessed too large")
+    CHECK_FATAL_ASSERT(dt > 0., "Time step must be bigger than 0")
+    CHECK_FATAL_ASSERT(diffusivity > 0., "Diffusivity must be bigger than 0")
+
+    // The lumped mass matrix is diagonal, its products with the old states need no operator application
+    boundary = integrator.boundaryDOFs(Var);
+    integrator.setHeatCoefficients(1., 0.);
+    integrator.diagonalOmega(Var, mass);
+    massRevision = integrator.geometry.revision;
+    INFO_MSG("Transient established with scheme %i and time step %e", scheme, dt)
+}
+
+void Transient::setPreconditioner(transientPreconditioner preconditioner_) {
+
+    preconditioner = preconditioner_;
+    if (preconditioner == TRANSIENT_PRECOND_PMG && !operators[0].pmg) operators[0].pmg = std::make_unique<PMultigrid>(integrator, Var);
+    invalidateOperators();
+}
+
+void Transient::setProblem(PointFunction f_, PointFunction g_) {
+
+    PROFILE_SCOPE("Transient.setProblem")
+
+    f = f_;
+    g = g_;
+    source.setZero(integrator.nDOFs(Var));
+    integrator.sourceOmega(Var, f, source);
+    hasProblem = TRUE;
+}
+
+void Transient::initialize(PointFunction u0, TransientState& state) {
+
+    CHECK_FATAL_ASSERT(hasProblem, "setProblem must be called first before calling upon this function")
+
+    f64 xPoint[3];
+    state.step = 0;
+    state.uPrev.resize(0);
+    state.u.resize(integrator.nDOFs(Var));
+    for (u64 idx=0; idx<integrator.nDOFs(Var); idx++) {
+        integrator.nodeCoordinates(Var, idx, xPoint);
+        state.u[idx] = u0(xPoint[0], xPoint[1], xPoint[2]);
+    }
+    for (const u64 idx : boundary) {
+        integrator.nodeCoordinates(Var, idx, xPoint);
+        state.u[idx] = g(xPoint[0], xPoint[1], xPoint[2]);
+    }
+}
+
+i32 Transient::step(TransientState& state) {
+
+    PROFILE_SCOPE("Transient.step")
+
+    CHECK_FATAL_ASSERT(hasProblem, "setProblem must be called first before calling upon this function")
+    CHECK_FATAL_ASSERT(static_cast<u64>(state.u.rows()) == integrator.nDOFs(Var), "State does not match the number of DOFs")
+
+    const u64 n = state.step;
+    setOperator(n);
+    integrator.applyOmega(Var, state.u, Au);
+
+    // ------------------------ //
+    // Right-hand side          //
+    // ------------------------ //
+    // Mass, source and applyOmega are all consistent across ranks, so is the right-hand side
+    if (scheme == TIME_CRANK_NICOLSON) {
+        // (M - dt/2 K) u^n = 2 M u^n - (M + dt/2 K) u^n
+        rhs = 2.*mass.cwiseProduct(state.u) - Au;
+    } else if (stepOperator(n) == 1) {
+        rhs = mass.cwiseProduct(2.*state.u - 0.5*state.uPrev);
+    } else {
+        rhs = mass.cwiseProduct(state.u);
+    }
+    rhs += dt*source;
+    if (scheme == TIME_BDF2) state.uPrev = state.u;
+
+    // ------------------------ //
+    // Implicit solve           //
+    // ------------------------ //
+    // Warm start from u^n, whose boundary values already are g
+    r = rhs - Au;
+    for (const u64 idx : boundary) r[idx] = 0.;
+    const i32 nIter = integrator.conjugateGradient(Var, boundary,
+                                                   [this](const EigenDefs::Vector<f64>& rIn, EigenDefs::Vector<f64>& zOut) { precondition(rIn, zOut); },
+                                                   state.u, r, "Transient.step");
+    state.step++;
+    return nIter;
+}
+
+i32 Transient::advance(TransientState& state, u64 nSteps) {
+
+    i32 nIter = 0;
+    for (u64 n=0; n<nSteps; n++) nIter += step(state);
+    return nIter;
+}
+
+void Transient::adjoint(TransientState& state, u64 nSteps, const CheckpointParameters& checkpoint_,
+                        const std::function<void(const TransientState&)>& forward,
+                        const std::function<void(const TransientState&)>& adjointStep) {
+
+    PROFILE_SCOPE("Transient.adjoint")
+
+    CHECK_FATAL_ASSERT(checkpoint_.nMemory + checkpoint_.nDisk > 0, "Adjoint sweep requires at least one checkpoint")
+
+    checkpoint = checkpoint_;
+    memorySlots.assign(checkpoint.nMemory, TransientState());
+    if (checkpoint.nDisk > 0) std::filesystem::create_directories(checkpoint.diskDirectory);
+
+    // ------------------------ //
+    // Revolve schedule         //
+    // ------------------------ //
+    Revolve schedule(nSteps, checkpoint.nMemory + checkpoint.nDisk);
+    TransientState last;
+    revolveAction action;
+    while ((action = schedule.next()) != REVOLVE_TERMINATE) {
+        switch (action) {
+            case REVOLVE_ADVANCE:
+                for (u64 n=schedule.oldCapo(); n<schedule.capo(); n++) {
+                    step(state);
+                    if (schedule.isFirstSweep() && forward) forward(state);
+                }
+                break;
+            case REVOLVE_TAKESHOT:
+                store(schedule.slot(), state);
+                break;
+            case REVOLVE_RESTORE:
+                load(schedule.slot(), state);
+                break;
+            case REVOLVE_FIRSTURN:
+                // The last state is only needed once, e.g. by the objective, and is never checkpointed
+                last = state;
+                step(last);
+                if (forward) forward(last);
+                adjointStep(state);
+                break;
+            case REVOLVE_YOUTURN:
+                adjointStep(state);
+                break;
+            default:
+                break;
+        }
+    }
+
+    for (u32 slot=0; slot<checkpoint.nDisk; slot++) std::filesystem::remove(slotFile(slot));
+    memorySlots.clear();
+    INFO_MSG("Transient.adjoint : %llu steps reversed with %u memory and %u disk checkpoints, %llu forward steps", nSteps,
+             checkpoint.nMemory, checkpoint.nDisk, schedule.nAdvanced()+1)
+}
+
+i32 Transient::solveAdjoint(u64 n, const EigenDefs::Vector<f64>& rhs_, EigenDefs::Vector<f64>& lambda) {
+
+    CHECK_FATAL_ASSERT(static_cast<u64>(rhs_.rows()) == integrator.nDOFs(Var), "Input vector does not match the number of DOFs")
+
+    setOperator(n);
+    if (static_cast<u64>(lambda.rows()) != integrator.nDOFs(Var)) lambda.setZero(integrator.nDOFs(Var));
+    for (const u64 idx : boundary) lambda[idx] = 0.;
+
+    integrator.applyOmega(Var, lambda, Au);
+    r = rhs_ - Au;
+    for (const u64 idx : boundary) r[idx] = 0.;
+    return integrator.conjugateGradient(Var, boundary,
+                                        [this](const EigenDefs::Vector<f64>& rIn, EigenDefs::Vector<f64>& zOut) { precondition(rIn, zOut); },
+                                        lambda, r, "Transient.solveAdjoint");
+}
+
+i32 Transient::solveAdjoint(u64 n, const EigenDefs::Matrix<f64>& rhs_, EigenDefs::Matrix<f64>& lambda) {
+
+    CHECK_FATAL_ASSERT(static_cast<u64>(rhs_.rows()) == integrator.nDOFs(Var), "Input block vectors do not match the number of DOFs")
+
+    setOperator(n);
+    if (lambda.rows() != rhs_.rows() || lambda.cols() != rhs_.cols()) lambda.setZero(rhs_.rows(), rhs_.cols());
+    for (const u64 idx : boundary) lambda.row(idx).setZero();
+
+    EigenDefs::Matrix<f64> R;
+    integrator.applyOmega(Var, lambda, R);
+    R = rhs_ - R;
+    for (const u64 idx : boundary) R.row(idx).setZero();
+    return integrator.blockConjugateGradient(Var, boundary,
+                                             [this](const EigenDefs::Matrix<f64>& rIn, EigenDefs::Matrix<f64>& zOut) { precondition(rIn, zOut); },
+                                             lambda, R, "Transient.solveAdjoint");
+}
+
+void Transient::applyOperator(u64 n, const EigenDefs::Vector<f64>& u, EigenDefs::Vector<f64>& y) {
+
+    setOperator(n);
+    integrator.applyOmega(Var, u, y);
+}
+
+void Transient::applyMass(const EigenDefs::Vector<f64>& u, EigenDefs::Vector<f64>& y) const {
+
+    CHECK_FATAL_ASSERT(u.rows() == mass.rows(), "Input vector does not match the number of DOFs")
+    y = mass.cwiseProduct(u);
+}
+
+void Transient::setOperator(u64 n) {
+
+    // New metrics change the mass and source integrals as well
+    const u64 revision = integrator.geometry.revision;
+    if (revision != massRevision) {
+        integrator.setHeatCoefficients(1., 0.);
+        integrator.diagonalOmega(Var, mass);
+        if (hasProblem) {
+            source.setZero();
+            integrator.sourceOmega(Var, f, source);
+        }
+        massRevision = revision;
+    }
+
+    const u8  op        = stepOperator(n);
+    const f64 massCoeff = (op == 1) ? 1.5 : 1.;
+    const f64 diffCoeff = (scheme == TIME_CRANK_NICOLSON) ? 0.5*dt*diffusivity : dt*diffusivity;
+    integrator.setHeatCoefficients(massCoeff, diffCoeff);
+
+    // The fast diagonalization of the inactive operator is parked in its slot, swapping moves the arrays only
+    if (op != active) {
+        std::swap(integrator.fdm[Var], operators[active].fdm);
+        std::swap(integrator.fdm[Var], operators[op].fdm);
+        active = op;
+    }
+
+    StepOperator& S = operators[op];
+    if (massCoeff == S.precondMass && diffCoeff == S.precondDiff && revision == S.precondRevision) return;
+
+    if (preconditioner == TRANSIENT_PRECOND_PMG) {
+        if (!S.pmg) S.pmg = std::make_unique<PMultigrid>(integrator, Var);
+        S.pmg->setup();
+    } else {
+        integrator.setupFastDiagonalization(Var);
+    }
+    S.precondMass = massCoeff;
+    S.precondDiff = diffCoeff;
+    S.precondRevision = revision;
+    TRACE_MSG("Transient.setOperator : preconditioner of operator %u rebuilt for heat coefficients (%e, %e)", op, massCoeff, diffCoeff)
+}
+
+void Transient::invalidateOperators() {
+
+    for (StepOperator& S : operators) {
+        S.precondMass = -1.;
+        S.precondDiff = -1.;
+    }
+}
+
+void Transient::precondition(const EigenDefs::Vector<f64>& rIn, EigenDefs::Vector<f64>& zOut) {
+
+    if (preconditioner == TRANSIENT_PRECOND_PMG) operators[active].pmg->vcycle(rIn, zOut);
+    else                                         integrator.applyFastDiagonalization(Var, rIn, zOut);
+}
+
+void Transient::precondition(const EigenDefs::Matrix<f64>& R, EigenDefs::Matrix<f64>& Z) {
+
+    if (preconditioner != TRANSIENT_PRECOND_PMG) {
+        integrator.applyFastDiagonalization(Var, R, Z);
+        return;
+    }
+
+    // The V-cycle works on single vectors
+    EigenDefs::Vector<f64> rCol, zCol;
+    Z.resize(R.rows(), R.cols());
+    for (Eigen::Index c=0; c<R.cols(); c++) {
+        rCol = R.col(c);
+        operators[active].pmg->vcycle(rCol, zCol);
+        Z.col(c) = zCol;
+    }
+}
+
+void Transient::store(u32 slot, const TransientState& state) {
+
+    if (slot >= checkpoint.nDisk) {
+        memorySlots[slot-checkpoint.nDisk] = state;
+        return;
+    }
+
+    std::ofstream file(slotFile(slot), std::ios::out | std::ios::binary | std::ios::trunc);
+    CHECK_FATAL_ASSERT(file.is_open(), "Could not open the checkpoint file for writing")
+    const u64 header[3] = {state.step, (u64) state.u.size(), (u64) state.uPrev.size()};
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(state.u.data()), header[1]*sizeof(f64));
+    file.write(reinterpret_cast<const char*>(state.uPrev.data()), header[2]*sizeof(f64));
+    CHECK_FATAL_ASSERT(file.good(), "Could not write the checkpoint file")
+}
+
+void Transient::load(u32 slot, TransientState& state) {
+
+    if (slot >= checkpoint.nDisk) {
+        state = memorySlots[slot-checkpoint.nDisk];
+        return;
+    }
+
+    std::ifstream file(slotFile(slot), std::ios::in | std::ios::binary);
+    CHECK_FATAL_ASSERT(file.is_open(), "Could not open the checkpoint file for reading")
+    u64 header[3];
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    state.step = header[0];
+    state.u.resize(header[1]);
+    state.uPrev.resize(header[2]);
+    file.read(reinterpret_cast<char*>(state.u.data()), header[1]*sizeof(f64));
+    file.read(reinterpret_cast<char*>(state.uPrev.data()), header[2]*sizeof(f64));
+    CHECK_FATAL_ASSERT(file.good(), "Could not read the checkpoint file")
+}
+
+std::string Transient::slotFile(u32 slot) const {
+
+    return checkpoint.diskDirectory + "/checkpoint_r" + std::to_string(integrator.rankid) + "_s" + std::to_string(slot) + ".bin";
+}
+
+} // end Physics
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "CoreIncludes.hpp"
+#include "integrator.hpp"
+#include "pmultigrid.hpp"
+#include "revolve.hpp"
+
+#include <memory>
+#include <string>
+
+namespace Physics {
+
+/* list of implicit time integration schemes */
+typedef enum timeScheme{
+    TIME_IMPLICIT_EULER   = 0, /**< first order, (M + dt K) u^{n+1} = M u^n + dt b */
+    TIME_BDF2             = 1, /**< second order, (3/2 M + dt K) u^{n+1} = M (2 u^n - 1/2 u^{n-1}) + dt b, implicit Euler first step */
+    TIME_CRANK_NICOLSON   = 2, /**< second order, (M + dt/2 K) u^{n+1} = (M - dt/2 K) u^n + dt b */
+} timeScheme;
+
+/* list of preconditioners of the implicit step solves */
+typedef enum transientPreconditioner{
+    TRANSIENT_PRECOND_FDM = 0, /**< fast diagonalization, see Integrator::applyFastDiagonalization */
+    TRANSIENT_PRECOND_PMG = 1, /**< p-multigrid V-cycle, Cartesian geometries only, see PMultigrid */
+} transientPreconditioner;
+
+/************************************************************************************************************************
+ *  @brief Checkpoint storage of the adjoint sweep, see Transient::adjoint.
+ *
+ *  @details
+ *  The Revolve schedule gets nMemory + nDisk slots. The outermost nDisk slots, which are the longest lived and least often
+ *  restored, are written to one file per rank and slot in diskDirectory, the others are kept in memory.
+ ************************************************************************************************************************/
+struct CheckpointParameters{
+    u32  nMemory       = 8;             /**< checkpoints held in memory, the initial state included */
+    u32  nDisk         = 0;             /**< additional checkpoints spilled to disk */
+    std::string diskDirectory = ".";    /**< directory of the spilled checkpoints, local to each rank */
+};
+
+/**< Forward state of the time integration */
+struct TransientState{
+    u64 step = 0;                       /**< time step n of u, the time is n*dt */
+    EigenDefs::Vector<f64> u;           /**< block vector of u^n */
+    EigenDefs::Vector<f64> uPrev;       /**< block vector of u^{n-1}, BDF2 only (empty at step 0) */
+};
+
+/************************************************************************************************************************
+ *  @brief Implicit time integration of the heat equation, du/dt - kappa div(grad(u)) = f with u = g on the boundary,
+ *         and the checkpointed forward sweep of its adjoint.
+ *
+ *  @details
+ *  Each step solves the SEM system (a M + c K) u^{n+1} = rhs, M the LGL-lumped mass and K the stiffness matrix, with the
+ *  matrix-free conjugate gradient of the integrator, warm-started from u^n and preconditioned by the fast diagonalization
+ *  or p-multigrid. The transient owns the heat coefficients of the integrator, they are set before every solve. BDF2's first
+ *  step has its own operator, so each of the two operators keeps its preconditioner and switching between them (e.g. adjoint
+ *  sweeps restarting from step 0) rebuilds nothing, a preconditioner is only rebuilt when the geometry changes.
+ *  The source f and the boundary values g are constant in time.
+ ************************************************************************************************************************/
+class Transient {
+
+    public:
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /************************************************************************************************************************
+         *  @brief Sets up the time integration of variable \p Var_ of an existing integrator.
+         *
+         *  @param integrator_  Integrator of the spatial operator, held by reference and must outlive the transient.
+         *  @param Var_         Variable who's heat equation is integrated.
+         *  @param scheme_      Time integration scheme.
+         *  @param dt_          Time step, must be bigger than 0.
+         *  @param diffusivity_ Diffusivity kappa, must be bigger than 0.
+         ************************************************************************************************************************/
+        Transient(Integrator& integrator_, u8 Var_, timeScheme scheme_, f64 dt_, f64 diffusivity_ = 1.);
+
+        /**< Disabled construction using another Transient */
+        Transient(const Transient&) = delete;
+
+        /**< Disabled construction by equating to another Transient */
+        Transient& operator =(const Transient&) = delete;
+
+        /**< Selects the preconditioner of the step solves, defaults to TRANSIENT_PRECOND_FDM */
+        void setPreconditioner(transientPreconditioner preconditioner_);
+
+        /************************************************************************************************************************
+         *  @brief Sets the source and boundary values, integrating the source once.
+         *
+         *  @param f_         Source term f(x,y,z), called concurrently from all threads.
+         *  @param g_         Dirichlet boundary value g(x,y,z).
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void setProblem(PointFunction f_, PointFunction g_);
+
+        /************************************************************************************************************************
+         *  @brief Sets a state to the initial condition at step 0, u^0 = u0 inside the domain and g on the boundary.
+         *
+         *  @param u0         Initial condition u0(x,y,z).
+         *  @param state      Output, initial forward state.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void initialize(PointFunction u0, TransientState& state);
+
+        /************************************************************************************************************************
+         *  @brief Advances a state by one time step.
+         *
+         *  @param state      Forward state, updated in place.
+         *
+         *  @return Number of conjugate gradient iterations.
+         ************************************************************************************************************************/
+        i32 step(TransientState& state);
+
+        /**< Advances a state by nSteps time steps, returns the total number of conjugate gradient iterations */
+        i32 advance(TransientState& state, u64 nSteps);
+
+        /************************************************************************************************************************
+         *  @brief Runs nSteps forward steps and hands the forward states to an adjoint in reverse order, under a fixed
+         *         checkpoint budget.
+         *
+         *  @details
+         *  The forward states are recomputed from checkpoints following the binomial Revolve schedule, so that the memory
+         *  stays at CheckpointParameters::nMemory states regardless of nSteps, with about t*nSteps forward steps for
+         *  beta(nMemory+nDisk, t) >= nSteps (see Revolve::forwardSteps). The adjoint is a callback, e.g. with J = sum_n
+         *  j(u^{n+1}) the discrete implicit Euler adjoint is (M + dt K) lambda^n = M lambda^{n+1} + dj/du^{n+1}, solved
+         *  with @ref solveAdjoint.
+         *
+         *  @param state        Forward state of the first step, restored to it on return.
+         *  @param nSteps       Number of time steps, must be bigger than 0.
+         *  @param checkpoint   Checkpoint storage.
+         *  @param forward      Called once per new forward state u^{n+1}, n = 0, ..., nSteps-1, in increasing order during the
+         *                      first sweep, may be empty.
+         *  @param adjointStep  Called once per step n = nSteps-1, ..., 0 with the forward state u^n.
+         *
+         *  @return None
+         ************************************************************************************************************************/
+        void adjoint(TransientState& state, u64 nSteps, const CheckpointParameters& checkpoint,
+                     const std::function<void(const TransientState&)>& forward,
+                     const std::function<void(const TransientState&)>& adjointStep);
+
+        /************************************************************************************************************************
+         *  @brief Solves the (symmetric) implicit operator of step \p n with homogeneous Dirichlet conditions, e.g. for the
+         *         adjoint variable.
+         *
+         *  @param n          Time step whose operator (a M + c K) is solved, which only differs for BDF2's first step.
+         *  @param rhs        Right-hand side block vector, consistent across ranks, ignored on the domain boundary.
+         *  @param lambda     Initial guess (if sized) and output, zero on the domain boundary.
+         *
+         *  @return Number of conjugate gradient iterations.
+         ************************************************************************************************************************/
+        i32 solveAdjoint(u64 n, const EigenDefs::Vector<f64>& rhs, EigenDefs::Vector<f64>& lambda);
+
+        /************************************************************************************************************************
+         *  @brief Solves the implicit operator of step \p n for several right-hand sides at once, e.g. the adjoints of
+         *         several objective functionals, with the multi-vector conjugate gradient of the integrator.
+         *
+         *  @param n          Time step whose operator is solved.
+         *  @param rhs        Right-hand side block vectors as columns, consistent across ranks, ignored on the domain boundary.
+         *  @param lambda     Initial guesses (if sized like rhs) and output, zero on the domain boundary.
+         *
+         *  @return Number of conjugate gradient iterations of the slowest column.
+         ************************************************************************************************************************/
+        i32 solveAdjoint(u64 n, const EigenDefs::Matrix<f64>& rhs, EigenDefs::Matrix<f64>& lambda);
+
+        /**< Applies the implicit operator (a M + c K) of step n to u, y consistent across ranks */
+        void applyOperator(u64 n, const EigenDefs::Vector<f64>& u, EigenDefs::Vector<f64>& y);
+
+        /**< Applies the lumped mass matrix to u, y consistent across ranks */
+        void applyMass(const EigenDefs::Vector<f64>& u, EigenDefs::Vector<f64>& y) const;
+
+        /**< Returns the time step */
+        f64 timeStep() const { return dt; }
+
+    private:
+
+        friend class IO::RestartReader;
+        friend class IO::RestartWriter;
+
+        // ---------------- //
+        // member functions //
+        // ---------------- //
+
+        /**< Returns the operator of step n, 1 for BDF2 after the first step and 0 otherwise */
+        u8 stepOperator(u64 n) const { return (scheme == TIME_BDF2 && n > 0) ? 1 : 0; }
+
+        /**< Sets the heat coefficients of step n on the integrator and activates its preconditioner, rebuilding it if the geometry changed */
+        void setOperator(u64 n);
+
+        /**< Marks the preconditioners of both step operators as outdated */
+        void invalidateOperators();
+
+        /**< Applies the selected preconditioner, z = P r */
+        void precondition(const EigenDefs::Vector<f64>& r, EigenDefs::Vector<f64>& z);
+
+        /**< Applies the selected preconditioner to every column, Z = P R */
+        void precondition(const EigenDefs::Matrix<f64>& R, EigenDefs::Matrix<f64>& Z);
+
+        /**< Stores a forward state in checkpoint slot */
+        void store(u32 slot, const TransientState& state);
+
+        /**< Restores a forward state from checkpoint slot */
+        void load(u32 slot, TransientState& state);
+
+        /**< Returns the file of a disk checkpoint slot of this rank */
+        std::string slotFile(u32 slot) const;
+
+        // ---------------- //
+        // member variables //
+        // ---------------- //
+
+        Integrator& integrator;
+        u8  Var;
+        timeScheme scheme;
+        f64 dt, diffusivity;
+        transientPreconditioner preconditioner;
+        /**< Preconditioner of one step operator, built once per geometry revision */
+        struct StepOperator{
+            f64 precondMass = -1., precondDiff = -1.;   /**< Heat coefficients the preconditioner was built for, negative if none */
+            u64 precondRevision = 0;                    /**< Geometry revision the preconditioner was built for */
+            std::unique_ptr<PMultigrid> pmg;
+            Integrator::FastDiagonalization fdm;        /**< Fast diagonalization, parked here while the other operator is active */
+        };
+        StepOperator operators[2];                      /**< Access is operators[stepOperator(n)], 1 for BDF2 after the first step */
+        u8  active;                                     /**< Operator whose heat coefficients and fast diagonalization are in the integrator */
+        u64 massRevision;                               /**< Geometry revision of mass and source */
+
+        PointFunction f, g;
+        b8  hasProblem;
+        std::vector<u64> boundary;                      /**< Domain boundary nodes */
+        EigenDefs::Vector<f64> mass;                    /**< Lumped mass diagonal, consistent across ranks */
+        EigenDefs::Vector<f64> source;                  /**< Source integral, consistent across ranks */
+        EigenDefs::Vector<f64> rhs, r, Au;              /**< Step workspaces */
+
+        CheckpointParameters checkpoint;
+        std::vector<TransientState> memorySlots;        /**< In-memory checkpoints, slot nDisk + s is memorySlots[s] */
+
+};
+
+} // end Physics
@@ -2,8 +2,40 @@
 
 #include "CoreIncludes.hpp"
 
-/**< Simplistic value source f(x,y). */
-f64 valueSource(f64 x, f64 y){
+#include <cmath>
+
+/**< Simplistic value source f(x,y,z), a Physics::PointFunction. */
+inline f64 valueSource(f64, f64, f64){
     f64 f = -2.2;
     return f;
-}
\ No newline at end of file
+}
+
+/************************************************************************************************************************
+ *  @brief Manufactured solution u = sin(x) sin(y) sin(z) (first nDims factors) of -div(grad(u)) = f, a Physics::PointFunction.
+ *
+ *  @details
+ *  Vanishes on the boundary of the domain [0,pi]^nDims of main.cpp, so that it is solved with g = 0 and the source
+ *  @ref manufacturedSource. Unused coordinates are ignored.
+ ************************************************************************************************************************/
+template<u8 nDims>
+inline f64 manufacturedSolution(f64 x, f64 y, f64 z){
+    f64 u = std::sin(x);
+    if constexpr (nDims > 1) u *= std::sin(y);
+    if constexpr (nDims > 2) u *= std::sin(z);
+    return u;
+}
+
+/**< Source f = -div(grad(u)) = nDims u of the manufactured solution */
+template<u8 nDims>
+inline f64 manufacturedSource(f64 x, f64 y, f64 z){
+    return nDims * manufacturedSolution<nDims>(x, y, z);
+}
+
+/**< Gradient component du/dx_Axis of the manufactured solution */
+template<u8 nDims, u8 Axis>
+inline f64 manufacturedGradient(f64 x, f64 y, f64 z){
+    const f64 xa[3] = {x, y, z};
+    f64 du = 1.;
+    for (u8 axis=0; axis<nDims; axis++) du *= (axis == Axis) ? std::cos(xa[axis]) : std::sin(xa[axis]);
+    return du;
+}
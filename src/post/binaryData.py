@@ -1,43 +1,86 @@
-import struct
 import numpy as np
 import numpy.typing as npt
 
-## @brief Reads output of main.cpp executable, a binary data file, and outputs 2d arrays.
+## Header of a solution file, see IO::SolutionHeader (src/main/io/solutionWriter.hpp)
+headerType = np.dtype([("magic",      "S8"),
+                       ("version",    "<u4"),
+                       ("nDims",      "<u4"),
+                       ("nFields",    "<u4"),
+                       ("valueBytes", "<u4"),
+                       ("nNodes",     "<u8", (3,)),
+                       ("dataOffset", "<u8")])
+nameLength = 32
+
+## @brief Memory-maps the coordinates and fields of a solution file written by IO::SolutionWriter.
 #
 #  @details
 #  The binary file holds data in the form:
 #
-#  u32  u32    f32  f32  f32    f32  f32  f32    ...   f32  f32  f32
-#  jmax imax   x[0] y[0] u[0]   x[1] y[1] u[1]   ...   x[K] y[K] u[K],
+#  header   nFields names (char[32])   padding   x[nx] (y[ny] (z[nz]))   field_0[nz,ny,nx]   ...   field_{nFields-1}[nz,ny,nx],
+#
+#  where all values are f32 or f64 (header valueBytes) and x runs fastest within a field. Nothing is read besides the
+#  header and names: the arrays are read-only np.memmap views of the file, so that slicing a large field only loads the
+#  accessed pages.
+#
+#  @param fileName Name of the binary file to read
+#
+#  @return coords List of 1D arrays of the global node coordinates per axis (x, y, z)
+#  @return fields Dictionary of the fields by name, shaped (ny,nx) in 2D and (nz,ny,nx) in 3D
+def readFields(fileName: str) -> tuple[list[npt.NDArray[np.floating]],
+                                       dict[str, npt.NDArray[np.floating]]]:
+
+    ## =========== ##
+    ## Read Header ##
+    ## =========== ##
+    header = np.fromfile(fileName, dtype=headerType, count=1)[0]
+    if header["magic"] != b"HEATSOL":
+        raise ValueError(f"{fileName} is not a solution file")
+    if header["version"] != 1:
+        raise ValueError(f"{fileName} has unsupported version {header['version']}")
+
+    nDims   = int(header["nDims"])
+    nFields = int(header["nFields"])
+    nNodes  = [int(n) for n in header["nNodes"][:nDims]]
+    dtype   = np.dtype("<f4") if header["valueBytes"] == 4 else np.dtype("<f8")
+    names   = np.fromfile(fileName, dtype=f"S{nameLength}", count=nFields, offset=headerType.itemsize)
+
+    ## ======== ##
+    ## Map Data ##
+    ## ======== ##
+    offset = int(header["dataOffset"])
+    coords = []
+    for n in nNodes:
+        coords.append(np.memmap(fileName, dtype=dtype, mode='r', offset=offset, shape=(n,)))
+        offset += n*dtype.itemsize
+
+    shape  = tuple(reversed(nNodes)) # x fastest
+    fields = {}
+    for name in names:
+        fields[name.decode()] = np.memmap(fileName, dtype=dtype, mode='r', offset=offset, shape=shape)
+        offset += int(np.prod(shape))*dtype.itemsize
+
+    return coords, fields
+
+## @brief Reads output of main.cpp executable, a solution file, and outputs 2d arrays of its first field.
 #
-#  where K = (jmax-1)*(imax-1). Reshapes x,y,u to (jmax,imax)
+#  @details
+#  See readFields for the file layout. 3D solutions are cut at the z-plane of index k, the middle plane by default.
+#  u is a view of the memory-mapped field, x and y are built from the 1D coordinates.
 #
 #  @param fileName Name of the binary file to read
+#  @param k        z-plane index of 3D solutions, None for the middle plane
 #
 #  @return x 2D numpy array of data x-positions
 #  @return y 2D numpy array of data y-positions
 #  @return u 2D numpy array of data values
-def read(fileName: str) -> tuple[npt.NDArray[np.float32], 
-                                 npt.NDArray[np.float32],
-                                 npt.NDArray[np.float32]]:
-
-    # Open file
-    with open(fileName, mode='rb') as file: # b is important -> binary
-        fileContent = file.read()
-
-    ## ========= ##
-    ## Read Data ##
-    ## ========= ##
-    # see link for more details on data types: https://docs.python.org/3/library/struct.html
-    # Read jmax, imax as u32
-    jmax = struct.unpack("I", fileContent[0:4])[0]
-    imax = struct.unpack("I", fileContent[4:8])[0]
-
-    # Read rest of data as f32, reshape it to the correct size.
-    data = list( struct.unpack('f'*((len(fileContent) - 8) // 4), fileContent[8:]) )
-    data = np.asarray(data, dtype=np.float32)
-    data = data.reshape((-1,3))
-
-    return  data[:,0].reshape((jmax,imax)), \
-            data[:,1].reshape((jmax,imax)), \
-            data[:,2].reshape((jmax,imax))  # (x,y,u)
+def read(fileName: str, k: int | None = None) -> tuple[npt.NDArray[np.floating],
+                                                      npt.NDArray[np.floating],
+                                                      npt.NDArray[np.floating]]:
+
+    coords, fields = readFields(fileName)
+    u = next(iter(fields.values()))
+    if u.ndim == 3:
+        u = u[u.shape[0]//2 if k is None else k]
+
+    x, y = np.meshgrid(coords[0], coords[1]) # (ny,nx), as u
+    return x, y, u  # (x,y,u)
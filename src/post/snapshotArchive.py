@@ -0,0 +1,117 @@
+import numpy as np
+import numpy.typing as npt
+
+## Header, field entry, index entry and footer of a snapshot archive, see IO::SnapshotArchive (src/main/io/snapshotArchive.hpp)
+headerType = np.dtype([("magic",       "S8"),
+                       ("version",     "<u4"),
+                       ("nDims",       "<u4"),
+                       ("nFields",     "<u4"),
+                       ("padding",     "<u4"),
+                       ("nNodes",      "<u8", (3,)),
+                       ("dataOffset",  "<u8"),
+                       ("recordBytes", "<u8")])
+fieldType  = np.dtype([("name",        "S28"),
+                       ("valueBytes",  "<u4")])
+entryType  = np.dtype([("step",        "<u8"),
+                       ("time",        "<f8"),
+                       ("offset",      "<u8")])
+footerType = np.dtype([("nSnapshots",  "<u8"),
+                       ("indexOffset", "<u8"),
+                       ("magic",       "S8")])
+
+## @brief Reads the index of a snapshot archive written by IO::SnapshotArchive.
+#
+#  @details
+#  Only the footer and the index at the end of the file are read.
+#
+#  @param fileName Name of the archive file to read
+#
+#  @return index Structured array of the snapshots, with fields step, time and offset (bytes of the record)
+def readIndex(fileName: str) -> npt.NDArray[np.void]:
+
+    with open(fileName, mode='rb') as file: # b is important -> binary
+        file.seek(-footerType.itemsize, 2)
+        footer = np.frombuffer(file.read(footerType.itemsize), dtype=footerType)[0]
+    if footer["magic"] != b"HEATIDX":
+        raise ValueError(f"{fileName} has no snapshot index, was the archive closed?")
+
+    return np.fromfile(fileName, dtype=entryType, count=int(footer["nSnapshots"]), offset=int(footer["indexOffset"]))
+
+## @brief Memory-maps the coordinates and fields of a single snapshot of an archive written by IO::SnapshotArchive.
+#
+#  @details
+#  The archive holds data in the form:
+#
+#  header   fields   x[nx] (y[ny] (z[nz]))   padding   record_0   ...   record_{N-1}   index   footer,
+#
+#  where the coordinates are f64 and a record holds every field over all global nodes in its own precision (f32 or f64),
+#  x fastest. Besides the header, field entries and index, only the pages of the snapshot that are accessed are read.
+#
+#  @param fileName Name of the archive file to read
+#  @param step     Time step of the snapshot, the last snapshot of that step if appended several times
+#
+#  @return coords List of 1D arrays of the global node coordinates per axis (x, y, z)
+#  @return fields Dictionary of the fields by name, shaped (ny,nx) in 2D and (nz,ny,nx) in 3D
+#  @return time   Time of the snapshot
+def readStep(fileName: str, step: int) -> tuple[list[npt.NDArray[np.float64]],
+                                                dict[str, npt.NDArray[np.floating]],
+                                                float]:
+
+    ## =========== ##
+    ## Read Header ##
+    ## =========== ##
+    header = np.fromfile(fileName, dtype=headerType, count=1)[0]
+    if header["magic"] != b"HEATSNP":
+        raise ValueError(f"{fileName} is not a snapshot archive")
+    if header["version"] != 1:
+        raise ValueError(f"{fileName} has unsupported version {header['version']}")
+
+    nDims   = int(header["nDims"])
+    nNodes  = [int(n) for n in header["nNodes"][:nDims]]
+    entries = np.fromfile(fileName, dtype=fieldType, count=int(header["nFields"]), offset=headerType.itemsize)
+
+    index   = readIndex(fileName)
+    matches = np.flatnonzero(index["step"] == step)
+    if matches.size == 0:
+        raise KeyError(f"{fileName} holds no snapshot of step {step}")
+    entry   = index[matches[-1]]
+
+    ## ======== ##
+    ## Map Data ##
+    ## ======== ##
+    offset = headerType.itemsize + entries.size*fieldType.itemsize
+    coords = []
+    for n in nNodes:
+        coords.append(np.memmap(fileName, dtype="<f8", mode='r', offset=offset, shape=(n,)))
+        offset += n*8
+
+    shape  = tuple(reversed(nNodes)) # x fastest
+    offset = int(entry["offset"])
+    fields = {}
+    for field in entries:
+        dtype = np.dtype("<f4") if field["valueBytes"] == 4 else np.dtype("<f8")
+        fields[field["name"].decode()] = np.memmap(fileName, dtype=dtype, mode='r', offset=offset, shape=shape)
+        offset += int(np.prod(shape))*dtype.itemsize
+
+    return coords, fields, float(entry["time"])
+
+## @brief Reads one snapshot of an archive and outputs 2d arrays of its first field, see binaryData.read.
+#
+#  @param fileName Name of the archive file to read
+#  @param step     Time step of the snapshot
+#  @param k        z-plane index of 3D solutions, None for the middle plane
+#
+#  @return x 2D numpy array of data x-positions
+#  @return y 2D numpy array of data y-positions
+#  @return u 2D numpy array of data values
+def read(fileName: str, step: int, k: int | None = None) -> tuple[npt.NDArray[np.floating],
+                                                                 npt.NDArray[np.floating],
+                                                                 npt.NDArray[np.floating]]:
+
+    coords, fields, _ = readStep(fileName, step)
+    u = next(iter(fields.values()))
+    if u.ndim == 3:
+        u = u[u.shape[0]//2 if k is None else k]
+
+    x, y = np.meshgrid(coords[0], coords[1]) # (ny,nx), as u
+    return x, y, u  # (x,y,u)
@@ -0,0 +1,206 @@
+/************************************************************************************************************************
+ * Regression checks of the solver, run by ctest (or directly, e.g. mpiexec -n 2 bin/HeatAdjointChecks).
+ *
+ * Every check prints one PASS/FAIL line on rank 0, the executable returns EXIT_FAILURE if any check failed on any rank.
+ ************************************************************************************************************************/
+#include "CoreIncludes.hpp"
+#include "mesh/mesh.hpp"
+#include "mesh/polynomials.hpp"
+#include "physics/integrator.hpp"
+#include "physics/valueSource.hpp"
+
+#include <mpi.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static i32 rankid = 0;
+static u32 nFailed = 0;
+
+/**< Reports a check on rank 0, a check fails if it fails on any rank */
+static void check(b8 isPassed, const char* name) {
+
+    i32 passed = isPassed ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &passed, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!passed) nFailed++;
+    if (rankid == 0) printf("%s : %s\n", passed ? "PASS" : "FAIL", name);
+}
+
+static f64 zero(f64, f64, f64) { return 0.; }
+
+// ------------------------ //
+// Static condensation      //
+// ------------------------ //
+
+/**< Assembles and solves the 2D manufactured problem on 4x4 elements of order 3, returns the L2 error */
+static f64 solveManufactured2D(b8 condense, i32 nThreads, i32 nAssemblies) {
+
+    EigenDefs::Array1D<f64> xe = EigenDefs::Array1D<f64>::LinSpaced(5, 0., 1.*EIGEN_PI);
+    Mesh::Geometry geometry(xe, xe);
+    geometry.decompose(MPI_COMM_WORLD);
+    geometry.MasterElement.setnVars(1);
+    geometry.MasterElement.setLGLOrder(0, 3, 3);
+
+    Physics::Integrator heat(geometry);
+    heat.setnThreads(nThreads);
+    Physics::SolverParameters params;
+    params.staticCondensation = condense;
+    heat.setSolverParameters(params);
+
+    // Repeated assemblies reuse the cached element factors of the condensation
+    EigenDefs::Vector<f64> u;
+    for (i32 n=0; n<nAssemblies; n++) {
+        heat.assemble(0, manufacturedSource<2>, zero);
+        heat.solve(u);
+    }
+    const Physics::ExactSolution exact = {manufacturedSolution<2>, {manufacturedGradient<2,0>, manufacturedGradient<2,1>, nullptr}};
+    return heat.errorOmega(0, u, exact).L2;
+}
+
+/**< More elements than threads, so that every thread condenses several elements */
+static void checkCondensedAssembly() {
+
+    const f64 full      = solveManufactured2D(FALSE, 2, 1);
+    const f64 condensed = solveManufactured2D(TRUE,  2, 2);
+    check(std::isfinite(condensed) && condensed < 1e-2, "condensed assembly solves the 2D manufactured problem");
+    check(std::abs(condensed - full) <= 1e-6*full, "condensed and full assembly give the same error");
+}
+
+// ------------------------ //
+// General metrics          //
+// ------------------------ //
+
+/**< Applies the heat operator of a tensor grid with its Cartesian metrics and again with the same metrics given as general
+  *  Jacobians, returns the largest relative difference */
+static f64 generalMetricsDifference(Mesh::Geometry& geometry) {
+
+    const u8 nDims = geometry.nDims;
+    geometry.decompose(MPI_COMM_WORLD);
+    geometry.MasterElement.setnVars(1);
+    if (nDims == 2) geometry.MasterElement.setLGLOrder(0, 3, 4);
+    else            geometry.MasterElement.setLGLOrder(0, 3, 4, 2);
+
+    Physics::Integrator heat(geometry);
+    heat.setHeatCoefficients(1., 1.);
+    EigenDefs::Vector<f64> u(heat.nDOFs(0)), yCartesian, yGeneral;
+    f64 xPoint[3];
+    for (u64 idx=0; idx<heat.nDOFs(0); idx++) {
+        heat.nodeCoordinates(0, idx, xPoint);
+        u[idx] = std::exp(xPoint[0]) * std::cos(xPoint[1] + xPoint[2]);
+    }
+    heat.applyOmega(0, u, yCartesian);
+
+    // dx/dxi = h/2 on the diagonal, at every node of every element
+    u64 nQuad = 1;
+    for (u8 axis=0; axis<nDims; axis++) nQuad *= geometry.MasterElement.getPolyOrder(0, axis) + 1;
+    EigenDefs::Array2D<f64> jac = EigenDefs::Array2D<f64>::Zero(geometry.nElemsLocal()*nQuad, nDims*nDims);
+    u64 elemAxis[3];
+    for (u64 elem=0; elem<geometry.nElemsLocal(); elem++) {
+        geometry.localElemIndex(elem, elemAxis);
+        for (u8 axis=0; axis<nDims; axis++) {
+            jac.block(elem*nQuad, axis*(nDims+1), nQuad, 1).setConstant(geometry.halfWidths[axis][elemAxis[axis]]);
+        }
+    }
+    geometry.setMetrics(nQuad, jac);
+    heat.applyOmega(0, u, yGeneral);
+
+    f64 diff = (yGeneral - yCartesian).cwiseAbs().maxCoeff() / yCartesian.cwiseAbs().maxCoeff();
+    MPI_Allreduce(MPI_IN_PLACE, &diff, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return diff;
+}
+
+/**< The dimension-templated general stiffness kernels reproduce the Cartesian ones on axis-aligned, graded elements */
+static void checkGeneralMetrics() {
+
+    const EigenDefs::Array1D<f64> xe = EigenDefs::Array1D<f64>::LinSpaced(4, 0., 1.).square();
+    Mesh::Geometry plane(xe, xe+1.);
+    check(generalMetricsDifference(plane) < 1e-12, "general metrics kernel matches the Cartesian kernel in 2D");
+    Mesh::Geometry box(xe, xe+1., 2.*xe);
+    check(generalMetricsDifference(box) < 1e-12, "general metrics kernel matches the Cartesian kernel in 3D");
+}
+
+// ------------------------ //
+// Zero-copy views          //
+// ------------------------ //
+// Heap allocations are counted with threadAllocations (allocations.hpp), so these checks are only meaningful in builds
+// with ALLOCATION_CHECK_ENABLED, they pass trivially otherwise
+
+/**< Moving the endpoints into a Geometry saves exactly the copies of a copied construction and keeps their storage */
+static void checkGeometryMove() {
+
+    const EigenDefs::Array1D<f64> xe = EigenDefs::Array1D<f64>::LinSpaced(9, 0., 1.);
+    { Mesh::Geometry warmup(xe, xe); } // the first log message sets up the thread's ring
+
+    u64 start = threadAllocations();
+    { Mesh::Geometry copied(xe, xe); }
+    const u64 nCopied = threadAllocations() - start;
+
+    EigenDefs::Array1D<f64> x1 = xe, x2 = xe;
+    const f64* x1Data = x1.data();
+    start = threadAllocations();
+    Mesh::Geometry moved(std::move(x1), std::move(x2));
+    const u64 nMoved = threadAllocations() - start;
+
+    check(moved.xe[0].data() == x1Data, "Geometry takes ownership of moved endpoints");
+    check(nMoved + 2*ALLOCATION_CHECK_ENABLED == nCopied, "Geometry construction from moved endpoints makes no copy");
+}
+
+/**< Views of caller-owned blocks bind without temporaries, evaluation and the accessors do not allocate */
+static void checkPolynomialViews() {
+
+    Mesh::MasterElement master(1);
+    master.setnVars(1);
+    master.setLGLOrder(0, 4);
+
+    // Contiguous blocks of larger caller-owned arrays
+    const EigenDefs::Array1D<f64> X = EigenDefs::Array1D<f64>::LinSpaced(16, -1., 1.);
+    const EigenDefs::Array1D<f64> Y = X.sin();
+    EigenDefs::Array1D<f64> out = EigenDefs::Array1D<f64>::Zero(16);
+    const EigenDefs::Array1D<f64> Xfit = X.segment(3, 5), Yfit = Y.segment(3, 5);
+
+    { const Polynomials::PolyInterp1D warmup(Xfit, Yfit); } // the first fit registers its profiling region
+
+    u64 start = threadAllocations();
+    { const Polynomials::PolyInterp1D fit(Xfit, Yfit); }
+    const u64 nArrays = threadAllocations() - start;
+    start = threadAllocations();
+    const Polynomials::PolyInterp1D poly(X.segment(3, 5), Y.segment(3, 5));
+    const u64 nBlocks = threadAllocations() - start;
+    check(nBlocks == nArrays, "PolyInterp1D fits blocks without copying them");
+
+    start = threadAllocations();
+    poly.evaluate(X.segment(4, 8), out.segment(4, 8));
+    f64 sum = poly(0.5);
+    check(threadAllocations() == start, "PolyInterp1D evaluates blocks into a caller-owned block without allocating");
+
+    start = threadAllocations();
+    const EigenDefs::Array1D<f64>& nodes   = master.getNodes(0);
+    const EigenDefs::Array1D<f64>& weights = master.getWeights(0);
+    sum += nodes.sum() + weights.sum();
+    check(threadAllocations() == start && &nodes == &master.getNodes(0) && &weights == &master.getWeights(0), 
+          "MasterElement accessors return the stored arrays");
+
+    start = threadAllocations();
+    const EigenDefs::Matrix<f64> L = master.lagrangeMatrix(0, 0, X.segment(2, 6));
+    check(threadAllocations() - start == ALLOCATION_CHECK_ENABLED && std::isfinite(sum + L.sum()), 
+          "lagrangeMatrix of a block allocates its result only");
+}
+
+int main(int argc, char *argv[]){
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rankid);
+    initLogging("log", rankid, LOG_LEVEL_INFO, LOG_LEVEL_FATAL);
+    HYPRE_Init();
+
+    checkCondensedAssembly();
+    checkGeneralMetrics();
+    checkGeometryMove();
+    checkPolynomialViews();
+
+    if (rankid == 0) printf("%u check(s) failed\n", nFailed);
+    HYPRE_Finalize();
+    shutdownLogging();
+    MPI_Finalize();
+    return nFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}